@@ -0,0 +1,767 @@
+#include <drivers/block/ahci.h>
+#include <drivers/block/blk_dev.h>
+#include <drivers/pci/pci.h>
+#include <x86/interrupt.h>
+#include <mm/mm.h>
+#include <mm/paging.h>
+#include <stderr.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dev.h>
+
+#define AHCI_TIMEOUT		1000000			/* polling loops before giving up */
+
+/* ahci devices */
+static struct ahci_device ahci_devices[NR_AHCI_DEVICES];
+static int nr_ahci_devices = 0;
+
+/* host bus adapter registers and capabilities */
+static uint32_t ahci_abar = 0;
+static uint32_t ahci_cap = 0;
+
+/* ahci block sizes */
+static size_t ahci_blksizes[NR_AHCI_DEVICES * NR_PARTITIONS] = { 0, };
+static size_t ahci_sizes[NR_AHCI_DEVICES * NR_PARTITIONS] = { 0, };
+
+/*
+ * Read a host bus adapter register.
+ */
+static inline uint32_t ahci_readl(uint32_t reg)
+{
+	return *((volatile uint32_t *) (ahci_abar + reg));
+}
+
+/*
+ * Write a host bus adapter register.
+ */
+static inline void ahci_writel(uint32_t reg, uint32_t value)
+{
+	*((volatile uint32_t *) (ahci_abar + reg)) = value;
+}
+
+/*
+ * Get an ahci device.
+ */
+static struct ahci_device *ahci_get_device(dev_t dev)
+{
+	int id;
+
+	/* check major number */
+	if (major(dev) != DEV_AHCI_MAJOR)
+		return NULL;
+
+	/* get device id */
+	id = minor(dev) >> PARTITION_MINOR_SHIFT;
+	if (id >= nr_ahci_devices)
+		return NULL;
+
+	return &ahci_devices[id];
+}
+
+/*
+ * Get partition start sector.
+ */
+static uint32_t ahci_get_start_sector(struct ahci_device *device, dev_t dev)
+{
+	int partition_nr;
+
+	/* get partition number */
+	partition_nr = dev - device->hd.dev;
+	if (!partition_nr)
+		return 0;
+
+	return device->hd.partitions[partition_nr].start_sect;
+}
+
+/*
+ * Get number of sectors.
+ */
+static uint32_t ahci_get_nr_sectors(struct ahci_device *device, dev_t dev)
+{
+	int partition_nr;
+
+	/* get partition number */
+	partition_nr = dev - device->hd.dev;
+	if (!partition_nr)
+		return 0;
+
+	return device->hd.partitions[partition_nr].nr_sects;
+}
+
+/*
+ * Get physical address of a buffer.
+ */
+static uint64_t ahci_buffer_phys(struct buffer_head *bh)
+{
+	uint64_t pfn = bh->b_page - page_array;
+
+	return (pfn << PAGE_SHIFT) + ((uint32_t) bh->b_data & ~PAGE_MASK);
+}
+
+/*
+ * Build PRDT of a command slot from next buffers of its request (returns number of sectors).
+ */
+static uint32_t ahci_build_prdt(struct ahci_slot *slot, uint32_t *nr_prd)
+{
+	struct ahci_prd *prd = (struct ahci_prd *) (slot->cmd_table + AHCI_CMD_TABLE_PRDT);
+	struct buffer_head *bh = slot->rq_bh;
+	uint32_t nsect = 0, size = 0, i = 0;
+	uint64_t phys, start = 0;
+
+	slot->bounce_bh = NULL;
+
+	for (; bh != NULL; bh = list_next_entry_or_null(bh, &slot->request->bhs_list, b_list_req)) {
+		/* 32 bits controller can't reach memory above 4 GB : transfer buffer alone through slot bounce page */
+		phys = ahci_buffer_phys(bh);
+		if ((phys >> 32) && !(ahci_cap & AHCI_CAP_S64A)) {
+			if (nsect)
+				break;
+
+			slot->bounce_bh = bh;
+			if (slot->request->cmd == WRITE)
+				memcpy(slot->bounce, bh->b_data, bh->b_size);
+			phys = __pa(slot->bounce);
+		}
+
+		/* contiguous to previous entry : extend it */
+		if (i && start + size == phys && size + bh->b_size <= AHCI_PRD_MAX_BYTES) {
+			size += bh->b_size;
+		} else {
+			/* PRDT full */
+			if (i == NR_AHCI_PRD_ENTRIES)
+				break;
+
+			prd[i].dba = (uint32_t) phys;
+			prd[i].dbau = (uint32_t) (phys >> 32);
+			prd[i].reserved = 0;
+			start = phys;
+			size = bh->b_size;
+			i++;
+		}
+
+		/* set entry size */
+		prd[i - 1].dbc = size - 1;
+		nsect += bh->b_size >> 9;
+
+		/* bounced buffer is transfered alone */
+		if (slot->bounce_bh) {
+			bh = list_next_entry_or_null(bh, &slot->request->bhs_list, b_list_req);
+			break;
+		}
+	}
+
+	/* remember next buffer */
+	slot->rq_bh = bh;
+	*nr_prd = i;
+
+	return nsect;
+}
+
+/*
+ * Issue a read/write command on a slot (completion is signaled by an interrupt).
+ */
+static int ahci_start_slot(struct ahci_device *device, int tag)
+{
+	struct ahci_slot *slot = &device->slots[tag];
+	uint32_t sector = slot->rq_sector, nsect, nr_prd;
+	int write = slot->request->cmd == WRITE;
+	struct ahci_fis_h2d *fis;
+
+	/* build PRDT */
+	nsect = ahci_build_prdt(slot, &nr_prd);
+	if (!nsect)
+		return -EINVAL;
+	slot->nr_sectors = nsect;
+
+	/* build command FIS */
+	fis = (struct ahci_fis_h2d *) slot->cmd_table;
+	memset(fis, 0, sizeof(struct ahci_fis_h2d));
+	fis->type = AHCI_FIS_TYPE_REG_H2D;
+	fis->flags = AHCI_FIS_H2D_CMD;
+	fis->device = AHCI_FIS_DEV_LBA;
+	fis->lba0 = (uint8_t) sector;
+	fis->lba1 = (uint8_t) (sector >> 8);
+	fis->lba2 = (uint8_t) (sector >> 16);
+	fis->lba3 = (uint8_t) (sector >> 24);
+
+	if (device->ncq) {
+		/* queued command : sectors count in features, tag in count */
+		fis->command = write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+		fis->features = (uint8_t) nsect;
+		fis->features_exp = (uint8_t) (nsect >> 8);
+		fis->count = tag << 3;
+	} else {
+		fis->command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+		fis->count = (uint8_t) nsect;
+		fis->count_exp = (uint8_t) (nsect >> 8);
+	}
+
+	/* set command header */
+	device->cmd_list[tag].flags = AHCI_CMD_FIS_LEN | (write ? AHCI_CMD_WRITE : 0) | (nr_prd << AHCI_CMD_PRDTL_SHIFT);
+	device->cmd_list[tag].prdbc = 0;
+
+	/* issue command (queued commands must be marked active first) */
+	device->slots_active |= 1U << tag;
+	if (device->ncq)
+		ahci_writel(device->port_base + AHCI_PREG_SACT, 1U << tag);
+	ahci_writel(device->port_base + AHCI_PREG_CI, 1U << tag);
+
+	return 0;
+}
+
+/*
+ * Start a request on a free slot.
+ */
+static void ahci_start_request(struct ahci_device *device, int tag, struct request *request)
+{
+	struct ahci_slot *slot = &device->slots[tag];
+
+	/* set slot */
+	slot->request = request;
+	slot->rq_sector = ahci_get_start_sector(device, request->rq_dev) + request->sector;
+	slot->rq_bh = list_first_entry(&request->bhs_list, struct buffer_head, b_list_req);
+
+	/* issue first command */
+	if ((request->cmd == READ || request->cmd == WRITE) && !ahci_start_slot(device, tag))
+		return;
+
+	/* end this request */
+	printf("ahci_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
+	slot->request = NULL;
+	end_request(request);
+}
+
+/*
+ * End command of a slot : transfer next buffers or end request.
+ */
+static void ahci_end_slot(struct ahci_device *device, int tag, int error)
+{
+	struct ahci_slot *slot = &device->slots[tag];
+	struct request *request;
+
+	/* copy bounced buffer */
+	if (!error && slot->bounce_bh && slot->request->cmd == READ)
+		memcpy(slot->bounce_bh->b_data, slot->bounce, slot->bounce_bh->b_size);
+
+	/* transfer next buffers */
+	if (!error && slot->rq_bh) {
+		slot->rq_sector += slot->nr_sectors;
+		error = ahci_start_slot(device, tag);
+		if (!error)
+			return;
+	}
+
+	/* release slot */
+	request = slot->request;
+	slot->request = NULL;
+
+	/* print error */
+	if (error)
+		printf("ahci_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
+
+	end_request(request);
+}
+
+/*
+ * Get request queue of a device (one queue per port).
+ */
+static struct request_queue *ahci_get_queue(dev_t dev)
+{
+	struct ahci_device *device;
+
+	device = ahci_get_device(dev);
+	if (!device)
+		return NULL;
+
+	return &device->queue;
+}
+
+/*
+ * Handle read/write requests (fill free command slots of each port).
+ */
+static void ahci_request()
+{
+	struct ahci_device *device;
+	struct request *request;
+	uint32_t flags;
+	int i, tag;
+
+	/* queues are also updated by interrupt handler */
+	irq_save(flags);
+
+	/* requests on unknown devices */
+	while ((request = elv_next_request(&blk_dev[DEV_AHCI_MAJOR].queue)) != NULL) {
+		printf("ahci_request: can't find device 0x%x\n", request->rq_dev);
+		end_request(request);
+	}
+
+	/* start next requests on free slots */
+	for (i = 0; i < nr_ahci_devices; i++) {
+		device = &ahci_devices[i];
+
+		for (tag = 0; tag < device->nr_slots; tag++) {
+			if (device->slots_active & (1U << tag))
+				continue;
+
+			request = elv_next_request(&device->queue);
+			if (!request)
+				break;
+
+			ahci_start_request(device, tag, request);
+		}
+	}
+
+	irq_restore(flags);
+}
+
+/*
+ * Stop command processing of a port.
+ */
+static int ahci_stop_port(uint32_t port_base)
+{
+	uint32_t cmd;
+	int i;
+
+	/* stop command list */
+	cmd = ahci_readl(port_base + AHCI_PREG_CMD) & ~AHCI_PCMD_ST;
+	ahci_writel(port_base + AHCI_PREG_CMD, cmd);
+	for (i = 0; ahci_readl(port_base + AHCI_PREG_CMD) & AHCI_PCMD_CR; i++)
+		if (i == AHCI_TIMEOUT)
+			return -EBUSY;
+
+	/* stop FIS receive */
+	cmd = ahci_readl(port_base + AHCI_PREG_CMD) & ~AHCI_PCMD_FRE;
+	ahci_writel(port_base + AHCI_PREG_CMD, cmd);
+	for (i = 0; ahci_readl(port_base + AHCI_PREG_CMD) & AHCI_PCMD_FR; i++)
+		if (i == AHCI_TIMEOUT)
+			return -EBUSY;
+
+	return 0;
+}
+
+/*
+ * Start command processing of a port.
+ */
+static int ahci_start_port(uint32_t port_base)
+{
+	uint32_t cmd;
+	int i;
+
+	/* wait for device to be ready */
+	for (i = 0; ahci_readl(port_base + AHCI_PREG_TFD) & (ATA_SR_BSY | ATA_SR_DRQ); i++)
+		if (i == AHCI_TIMEOUT)
+			return -EBUSY;
+
+	/* start FIS receive, then command list */
+	cmd = ahci_readl(port_base + AHCI_PREG_CMD) | AHCI_PCMD_SUD | AHCI_PCMD_POD | AHCI_PCMD_FRE;
+	ahci_writel(port_base + AHCI_PREG_CMD, cmd);
+	ahci_writel(port_base + AHCI_PREG_CMD, cmd | AHCI_PCMD_ST);
+
+	return 0;
+}
+
+/*
+ * Handle a port error : restart port and fail all commands in flight.
+ */
+static void ahci_port_error(struct ahci_device *device, uint32_t status)
+{
+	uint32_t failed;
+	int tag;
+
+	printf("ahci: error on %s (status = 0x%x, task file = 0x%x)\n",
+	       device->hd.name, status, ahci_readl(device->port_base + AHCI_PREG_TFD));
+
+	/* restart port (clears issued and active commands) */
+	ahci_stop_port(device->port_base);
+	ahci_writel(device->port_base + AHCI_PREG_SERR, 0xFFFFFFFF);
+	ahci_writel(device->port_base + AHCI_PREG_IS, 0xFFFFFFFF);
+	ahci_start_port(device->port_base);
+
+	/* fail commands in flight */
+	failed = device->slots_active;
+	device->slots_active = 0;
+	for (tag = 0; tag < device->nr_slots; tag++)
+		if (failed & (1U << tag))
+			ahci_end_slot(device, tag, -EIO);
+}
+
+/*
+ * Irq handler : end completed commands and start next ones.
+ */
+static void ahci_irq_handler(struct registers *regs)
+{
+	struct ahci_device *device;
+	uint32_t is, status, done;
+	int i, tag;
+
+	UNUSED(regs);
+
+	/* interrupt not raised by this controller (shared line) */
+	is = ahci_readl(AHCI_REG_IS);
+	if (!is)
+		return;
+
+	for (i = 0; i < nr_ahci_devices; i++) {
+		device = &ahci_devices[i];
+		if (!(is & (1U << device->port)))
+			continue;
+
+		/* acknowledge port */
+		status = ahci_readl(device->port_base + AHCI_PREG_IS);
+		ahci_writel(device->port_base + AHCI_PREG_IS, status);
+
+		/* error */
+		if (status & AHCI_PIS_ERRORS) {
+			ahci_port_error(device, status);
+			continue;
+		}
+
+		/* completed commands are no more issued nor active */
+		done = device->slots_active & ~(ahci_readl(device->port_base + AHCI_PREG_SACT)
+						| ahci_readl(device->port_base + AHCI_PREG_CI));
+		device->slots_active &= ~done;
+
+		for (tag = 0; tag < device->nr_slots; tag++)
+			if (done & (1U << tag))
+				ahci_end_slot(device, tag, 0);
+	}
+
+	/* acknowledge controller and start next requests */
+	ahci_writel(AHCI_REG_IS, is);
+	ahci_request();
+}
+
+/*
+ * Identify a disk (polled command on slot 0).
+ */
+static int ahci_identify(struct ahci_device *device)
+{
+	struct ahci_slot *slot = &device->slots[0];
+	struct ahci_fis_h2d *fis;
+	struct ahci_prd *prd;
+	void *buf;
+	int i, ret = 0;
+
+	/* allocate identification buffer */
+	buf = get_free_page();
+	if (!buf)
+		return -ENOMEM;
+
+	/* build command */
+	fis = (struct ahci_fis_h2d *) slot->cmd_table;
+	memset(fis, 0, sizeof(struct ahci_fis_h2d));
+	fis->type = AHCI_FIS_TYPE_REG_H2D;
+	fis->flags = AHCI_FIS_H2D_CMD;
+	fis->command = ATA_CMD_IDENTIFY;
+	prd = (struct ahci_prd *) (slot->cmd_table + AHCI_CMD_TABLE_PRDT);
+	prd->dba = __pa(buf);
+	prd->dbau = 0;
+	prd->dbc = sizeof(struct ata_identify) - 1;
+	device->cmd_list[0].flags = AHCI_CMD_FIS_LEN | (1 << AHCI_CMD_PRDTL_SHIFT);
+	device->cmd_list[0].prdbc = 0;
+
+	/* issue command and wait for completion */
+	ahci_writel(device->port_base + AHCI_PREG_CI, 1);
+	for (i = 0; ahci_readl(device->port_base + AHCI_PREG_CI) & 1; i++) {
+		if (i == AHCI_TIMEOUT || (ahci_readl(device->port_base + AHCI_PREG_IS) & AHCI_PIS_TFES)) {
+			ret = -EIO;
+			goto out;
+		}
+	}
+
+	/* copy identification */
+	memcpy(&device->identify, buf, sizeof(struct ata_identify));
+out:
+	ahci_writel(device->port_base + AHCI_PREG_IS, 0xFFFFFFFF);
+	free_page(buf);
+	return ret;
+}
+
+/*
+ * Free memory of a port.
+ */
+static void ahci_free_port(struct ahci_device *device)
+{
+	int tag;
+
+	for (tag = 0; tag < NR_AHCI_SLOTS; tag++) {
+		if (device->slots[tag].cmd_table) {
+			free_page(device->slots[tag].cmd_table);
+			device->slots[tag].cmd_table = NULL;
+		}
+
+		if (device->slots[tag].bounce) {
+			free_page(device->slots[tag].bounce);
+			device->slots[tag].bounce = NULL;
+		}
+	}
+
+	if (device->cmd_list) {
+		free_page(device->cmd_list);
+		device->cmd_list = NULL;
+	}
+}
+
+/*
+ * Allocate a command table (and a bounce page if the controller can't reach memory above 4 GB).
+ */
+static int ahci_alloc_slot(struct ahci_device *device, int tag)
+{
+	void *cmd_table;
+
+	cmd_table = get_free_page();
+	if (!cmd_table)
+		return -ENOMEM;
+
+	memset(cmd_table, 0, PAGE_SIZE);
+	device->slots[tag].cmd_table = cmd_table;
+	device->cmd_list[tag].ctba = __pa(cmd_table);
+	device->cmd_list[tag].ctbau = 0;
+
+	/* 32 bits controller : buffers above 4 GB are bounced through a low memory page */
+	if (!(ahci_cap & AHCI_CAP_S64A)) {
+		device->slots[tag].bounce = get_free_page();
+		if (!device->slots[tag].bounce)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Init a port : set command list and FIS receive area, identify disk and choose queue depth.
+ */
+static int ahci_port_init(struct ahci_device *device)
+{
+	uint32_t depth;
+	int ret, tag;
+
+	/* stop port (firmware may have left it running on its own memory) */
+	ret = ahci_stop_port(device->port_base);
+	if (ret)
+		return ret;
+
+	/* allocate command list and received FIS area (one page) */
+	device->cmd_list = (struct ahci_cmd_header *) get_free_page();
+	if (!device->cmd_list)
+		return -ENOMEM;
+	memset(device->cmd_list, 0, PAGE_SIZE);
+	device->rx_fis = (void *) device->cmd_list + AHCI_CMD_LIST_SIZE;
+
+	/* allocate identification slot */
+	ret = ahci_alloc_slot(device, 0);
+	if (ret)
+		goto err;
+
+	/* set port memory */
+	ahci_writel(device->port_base + AHCI_PREG_CLB, __pa(device->cmd_list));
+	ahci_writel(device->port_base + AHCI_PREG_CLBU, 0);
+	ahci_writel(device->port_base + AHCI_PREG_FB, __pa(device->rx_fis));
+	ahci_writel(device->port_base + AHCI_PREG_FBU, 0);
+
+	/* clear errors and start port */
+	ahci_writel(device->port_base + AHCI_PREG_SERR, 0xFFFFFFFF);
+	ahci_writel(device->port_base + AHCI_PREG_IS, 0xFFFFFFFF);
+	ret = ahci_start_port(device->port_base);
+	if (ret)
+		goto err;
+
+	/* identify disk */
+	ret = ahci_identify(device);
+	if (ret)
+		goto err_stop;
+
+	/* no sectors */
+	if (!device->identify.sectors_28 && !device->identify.sectors_48) {
+		ret = -EINVAL;
+		goto err_stop;
+	}
+
+	/* use native command queuing if both controller and disk support it */
+	device->ncq = (ahci_cap & AHCI_CAP_SNCQ) && (device->identify.sata_capabilities & ATA_SATA_CAP_NCQ);
+	device->nr_slots = 1;
+	if (device->ncq) {
+		depth = (device->identify.queue_depth & ATA_QUEUE_DEPTH_MASK) + 1;
+		device->nr_slots = depth < AHCI_CAP_NCS(ahci_cap) ? depth : AHCI_CAP_NCS(ahci_cap);
+	}
+
+	/* allocate other slots */
+	for (tag = 1; tag < device->nr_slots; tag++) {
+		ret = ahci_alloc_slot(device, tag);
+		if (ret)
+			goto err_stop;
+	}
+
+	/* enable port interrupts */
+	ahci_writel(device->port_base + AHCI_PREG_IE, AHCI_PIS_DHRS | AHCI_PIS_SDBS | AHCI_PIS_ERRORS);
+
+	return 0;
+err_stop:
+	ahci_stop_port(device->port_base);
+err:
+	ahci_free_port(device);
+	return ret;
+}
+
+/*
+ * Detect an AHCI disk on a port.
+ */
+static int ahci_detect(int port)
+{
+	struct ahci_device *device = &ahci_devices[nr_ahci_devices];
+	uint32_t port_base = AHCI_PORT_BASE(port);
+	int ret;
+
+	/* no device or not an ATA disk */
+	if ((ahci_readl(port_base + AHCI_PREG_SSTS) & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT)
+		return -ENXIO;
+	if (ahci_readl(port_base + AHCI_PREG_SIG) != AHCI_SIG_ATA)
+		return -ENXIO;
+
+	/* set device */
+	memset(device, 0, sizeof(struct ahci_device));
+	device->id = nr_ahci_devices;
+	device->port = port;
+	device->port_base = port_base;
+
+	/* set gendisk */
+	device->hd.dev = mkdev(DEV_AHCI_MAJOR, device->id << PARTITION_MINOR_SHIFT);
+	sprintf(device->hd.name, "sd%c", 'a' + device->id);
+
+	/* init port */
+	ret = ahci_port_init(device);
+	if (ret)
+		return ret;
+
+	/* init request queue (sorted dispatch, commands of a batch are queued together on the disk) */
+	elv_init_queue(&device->queue, device->hd.name, ELEVATOR_DEADLINE);
+	device->queue.max_sectors = ATA_LBA48_MAX_SECTORS;
+	nr_ahci_devices++;
+
+	printf("[Kernel] AHCI disk %s on port %d (%s, queue depth %d)\n",
+	       device->hd.name, port, device->ncq ? "NCQ" : "no NCQ", device->nr_slots);
+
+	return 0;
+}
+
+/*
+ * Ioctl write.
+ */
+static int ahci_ioctl(struct inode *inode, struct file *filp, int request, unsigned long arg)
+{
+	struct ahci_device *device;
+	dev_t dev = inode->i_rdev;
+
+	UNUSED(filp);
+
+	/* get ahci device */
+	device = ahci_get_device(dev);
+	if (!device)
+		return -EINVAL;
+
+	switch (request) {
+		case BLKGETSIZE:
+			*((uint32_t *) arg) = ahci_get_nr_sectors(device, dev);
+			break;
+		case BLKGETSIZE64:
+			*((uint64_t *) arg) = ahci_get_nr_sectors(device, dev) * ATA_SECTOR_SIZE;
+			break;
+		case BLKSSZGET:
+		 	*((uint32_t *) arg) = blksize_size[major(dev)][minor(dev)];
+			break;
+		case BLKROGET:
+		 	*((int *) arg) = is_read_only(dev);
+			break;
+		case BLKDISCARDZEROES:
+			break;
+		case BLKELVGET:
+		case BLKELVSET:
+			return blk_elv_ioctl(dev, request, arg);
+		default:
+			printf("Unknown ioctl request (0x%x) on device 0x%x\n", request, (int) dev);
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * AHCI file operations.
+ */
+static struct file_operations ahci_fops = {
+	.read		= generic_block_read,
+	.write		= generic_block_write,
+	.ioctl		= ahci_ioctl,
+};
+
+/*
+ * Init ahci devices.
+ */
+int init_ahci()
+{
+	struct pci_device *pci_dev;
+	uint32_t pci_cmd, abar, pi;
+	int ret, port, i, j;
+
+	/* get pci device */
+	pci_dev = pci_get_device(AHCI_VENDOR_ID, AHCI_DEVICE_ID);
+	if (!pci_dev)
+		return -EINVAL;
+
+	/* enable memory space and bus mastering */
+	pci_cmd = pci_read_field(pci_dev->address, PCI_CMD);
+	if ((pci_cmd & (PCI_CMD_REG_MEMORY_SPACE | PCI_CMD_REG_BUS_MASTER)) != (PCI_CMD_REG_MEMORY_SPACE | PCI_CMD_REG_BUS_MASTER)) {
+		pci_cmd |= PCI_CMD_REG_MEMORY_SPACE | PCI_CMD_REG_BUS_MASTER;
+		pci_write_field(pci_dev->address, PCI_CMD, pci_cmd);
+	}
+
+	/* identity map host bus adapter registers (uncached) */
+	abar = pci_read_field(pci_dev->address, PCI_BAR5) & ~0xF;
+	ret = remap_page_range(abar, abar, AHCI_ABAR_SIZE, PAGE_KERNEL | PAGE_PCD);
+	if (ret)
+		return ret;
+	ahci_abar = abar;
+
+	/* switch controller to AHCI mode */
+	ahci_writel(AHCI_REG_GHC, ahci_readl(AHCI_REG_GHC) | AHCI_GHC_AE);
+	ahci_cap = ahci_readl(AHCI_REG_CAP);
+
+	/* register ahci device */
+	ret = register_blkdev(DEV_AHCI_MAJOR, "ahci", &ahci_fops);
+	if (ret)
+		return ret;
+
+	/* set default block size */
+	blksize_size[DEV_AHCI_MAJOR] = ahci_blksizes;
+	blk_size[DEV_AHCI_MAJOR] = ahci_sizes;
+
+	/* register block device (requests buffers are transfered by scatter gather DMA) */
+	blk_dev[DEV_AHCI_MAJOR].request = ahci_request;
+	blk_dev[DEV_AHCI_MAJOR].get_queue = ahci_get_queue;
+	blk_dev[DEV_AHCI_MAJOR].scatter_gather = 1;
+
+	/* detect disks on implemented ports */
+	pi = ahci_readl(AHCI_REG_PI);
+	for (port = 0; port < NR_AHCI_PORTS && nr_ahci_devices < NR_AHCI_DEVICES; port++)
+		if (pi & (1U << port))
+			ahci_detect(port);
+
+	/* register interrupt handler (no MSI support : legacy interrupt line) and enable interrupts */
+	request_irq(pci_read_field(pci_dev->address, PCI_INTERRUPT_LINE) & 0xFF, ahci_irq_handler, SA_SHIRQ, "ahci", NULL);
+	ahci_writel(AHCI_REG_IS, 0xFFFFFFFF);
+	ahci_writel(AHCI_REG_GHC, ahci_readl(AHCI_REG_GHC) | AHCI_GHC_IE);
+
+	for (i = 0; i < nr_ahci_devices; i++) {
+		/* set default block size */
+		ahci_blksizes[i << PARTITION_MINOR_SHIFT] = BLOCK_SIZE;
+
+		/* discover partitions */
+		check_partition(&ahci_devices[i].hd);
+
+		/* set partitions size */
+		for (j = 0; j < NR_PARTITIONS; j++)
+			ahci_sizes[(i << PARTITION_MINOR_SHIFT) + j] = ahci_devices[i].hd.partitions[j].nr_sects >> (BLOCK_SIZE_BITS - 9);
+	}
+
+	return 0;
+}
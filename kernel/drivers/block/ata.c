@@ -36,6 +36,11 @@ static struct ata_device ata_devices[NR_ATA_DEVICES] = {
 	},
 };
 
+/* device running a DMA request, polled request left by interrupt handler and request queue of each bus */
+static struct ata_device *ata_bus_devices[2] = { NULL, NULL };
+static struct request *ata_bus_polled[2] = { NULL, NULL };
+static struct request_queue ata_queues[2];
+
 /* ata block sizes */
 static size_t ata_blksizes[NR_ATA_DEVICES * NR_PARTITIONS] = { 0, };
 static size_t ata_sizes[NR_ATA_DEVICES * NR_PARTITIONS] = { 0, };
@@ -90,57 +95,137 @@ static uint32_t ata_get_nr_sectors(struct ata_device *device, dev_t dev)
 }
 
 /*
- * Handle a read/write request.
+ * Is a request transfered by DMA ?
  */
-static void ata_request()
+static inline int ata_request_dma(struct ata_device *device, struct request *request)
 {
-	uint32_t start_sector, sector, nr_sectors;
-	struct ata_device *device;
-	struct request *request;
-	int ret;
-
-repeat:
-	/* get next request */
-	request = blk_dev[DEV_ATA_MAJOR].current_request;
-	if (!request)
-		return;
-
-	/* remove it from queue */
-	blk_dev[DEV_ATA_MAJOR].current_request = request->next;
+	return device->start_dma && (request->cmd == READ || request->cmd == WRITE);
+}
 
-	/* get ata device */
-	device = ata_get_device(request->rq_dev);
-	if (!device) {
-		printf("ata_request: can't find device 0x%x\n", request->rq_dev);
-		goto next;
-	}
+/*
+ * Start a request (hard disks requests end on interrupt, cd roms requests are polled).
+ */
+static void ata_start_request(struct ata_device *device, struct request *request)
+{
+	uint32_t start_sector, sector, nr_sectors;
+	struct buffer_head *bh;
+	struct list_head *pos;
+	int ret = -EINVAL;
 
 	/* get partition start sector */
 	start_sector = ata_get_start_sector(device, request->rq_dev);
 	sector = start_sector + (request->sector << 9) / device->sector_size;
 	nr_sectors = (request->nr_sectors << 9) / device->sector_size;
 
-	/* find request function */
-	switch (request->cmd) {
-		case READ:
-			ret = device->read(device, sector, nr_sectors, request->buf);
-			break;
-		case WRITE:
-			ret = device->write(device, sector, nr_sectors, request->buf);
+	/* DMA transfer : bus is busy until end of request */
+	if (ata_request_dma(device, request)) {
+		device->request = request;
+		device->rq_sector = sector;
+		device->rq_nr_sectors = nr_sectors;
+		device->rq_bh = list_first_entry(&request->bhs_list, struct buffer_head, b_list_req);
+
+		ret = device->start_dma(device);
+		if (!ret) {
+			ata_bus_devices[device->bus] = device;
+			return;
+		}
+
+		device->request = NULL;
+		goto out;
+	}
+
+	/* polled transfer, buffer by buffer (buffers may not be contiguous) */
+	list_for_each(pos, &request->bhs_list) {
+		bh = list_entry(pos, struct buffer_head, b_list_req);
+		sector = start_sector + (bh->b_rsector << 9) / device->sector_size;
+		nr_sectors = bh->b_size / device->sector_size;
+
+		if (request->cmd == READ && device->read)
+			ret = device->read(device, sector, nr_sectors, bh->b_data);
+		else if (request->cmd == WRITE && device->write)
+			ret = device->write(device, sector, nr_sectors, bh->b_data);
+		else
+			ret = -EINVAL;
+
+		if (ret)
 			break;
-		default:
-			printf("ata_request: can't handle request %x\n", request->cmd);
-			goto next;
 	}
 
+out:
 	/* print error */
 	if (ret)
 		printf("ata_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
 
-next:
 	/* end this request */
 	end_request(request);
-	goto repeat;
+}
+
+/*
+ * Get request queue of a device (one queue per bus).
+ */
+static struct request_queue *ata_get_queue(dev_t dev)
+{
+	struct ata_device *device;
+
+	device = ata_get_device(dev);
+	if (!device)
+		return NULL;
+
+	return &ata_queues[device->bus];
+}
+
+/*
+ * Start a request on each idle bus (polled requests busy wait : interrupt handler leaves them to process context).
+ */
+static void ata_start_requests(int from_irq)
+{
+	struct request *request;
+	uint32_t flags;
+	int bus;
+
+	/* queues are also updated by interrupt handler */
+	irq_save(flags);
+
+	/* requests on unknown devices */
+	while ((request = elv_next_request(&blk_dev[DEV_ATA_MAJOR].queue)) != NULL) {
+		printf("ata_request: can't find device 0x%x\n", request->rq_dev);
+		end_request(request);
+	}
+
+	/* start next request on idle buses */
+	for (bus = 0; bus < 2; bus++) {
+		/* polled request left by interrupt handler */
+		if (!from_irq && ata_bus_polled[bus]) {
+			request = ata_bus_polled[bus];
+			ata_bus_polled[bus] = NULL;
+			ata_start_request(ata_get_device(request->rq_dev), request);
+		}
+
+		while (!ata_bus_devices[bus] && !ata_bus_polled[bus]) {
+			request = elv_next_request(&ata_queues[bus]);
+			if (!request)
+				break;
+
+			/* keep bus busy and let completion thread start polled request */
+			if (from_irq && !ata_request_dma(ata_get_device(request->rq_dev), request)) {
+				ata_bus_polled[bus] = request;
+				kblockd_schedule();
+				break;
+			}
+
+			ata_start_request(ata_get_device(request->rq_dev), request);
+		}
+	}
+
+	irq_restore(flags);
+}
+
+/*
+ * Handle read/write requests.
+ */
+static void ata_request()
+{
+	ata_start_requests(0);
 }
 
 /*
@@ -250,6 +335,9 @@ static int ata_ioctl(struct inode *inode, struct file *filp, int request, unsign
 			break;
 		case BLKDISCARDZEROES:
 			break;
+		case BLKELVGET:
+		case BLKELVSET:
+			return blk_elv_ioctl(dev, request, arg);
 		default:
 			printf("Unknown ioctl request (0x%x) on device 0x%x\n", request, (int) dev);
 			break;
@@ -259,11 +347,48 @@ static int ata_ioctl(struct inode *inode, struct file *filp, int request, unsign
 }
 
 /*
- * Irq handler.
+ * Irq handler : end DMA transfer and start next one.
  */
 static void ata_irq_handler(struct registers *regs)
 {
-	UNUSED(regs);
+	struct ata_device *device;
+	struct request *request;
+	int bus, ret;
+
+	/* get device running a request on this bus */
+	bus = regs->int_no == 14 ? ATA_PRIMARY : ATA_SECONDARY;
+	device = ata_bus_devices[bus];
+
+	/* no DMA transfer (identification or polled command) : acknowledge drive */
+	if (!device) {
+		inb((bus == ATA_PRIMARY ? ATA_PRIMARY_IO : ATA_SECONDARY_IO) + ATA_REG_STATUS);
+		return;
+	}
+
+	/* end DMA transfer */
+	ret = device->end_dma(device);
+	if (ret > 0)
+		return;
+
+	/* transfer next sectors */
+	if (!ret && device->rq_nr_sectors) {
+		ret = device->start_dma(device);
+		if (!ret)
+			return;
+	}
+
+	/* release bus */
+	request = device->request;
+	device->request = NULL;
+	ata_bus_devices[bus] = NULL;
+
+	/* print error */
+	if (ret)
+		printf("ata_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
+
+	/* end request and start next DMA ones */
+	end_request(request);
+	ata_start_requests(1);
 }
 
 /*
@@ -295,8 +420,14 @@ int init_ata()
 	blksize_size[DEV_ATA_MAJOR] = ata_blksizes;
 	blk_size[DEV_ATA_MAJOR] = ata_sizes;
 
-	/* register block device */
+	/* register block device (requests buffers are transfered by scatter gather DMA) */
 	blk_dev[DEV_ATA_MAJOR].request = ata_request;
+	blk_dev[DEV_ATA_MAJOR].get_queue = ata_get_queue;
+	blk_dev[DEV_ATA_MAJOR].scatter_gather = 1;
+
+	/* init request queues (sorted dispatch for disks) */
+	elv_init_queue(&ata_queues[ATA_PRIMARY], "ata0", ELEVATOR_DEADLINE);
+	elv_init_queue(&ata_queues[ATA_SECONDARY], "ata1", ELEVATOR_DEADLINE);
 
 	/* detect hard drives */
 	for (i = 0; i < NR_ATA_DEVICES; i++) {
@@ -307,6 +438,10 @@ int init_ata()
 		/* set default block size */
 		ata_blksizes[i << PARTITION_MINOR_SHIFT] = BLOCK_SIZE;
 
+		/* 48 bits disks : allow requests as large as a command (smaller disks on same bus split them) */
+		if (ata_devices[i].lba48)
+			ata_queues[ata_devices[i].bus].max_sectors = ATA_LBA48_MAX_SECTORS;
+
 		/* discover partitions */
 		check_partition(&ata_devices[i].hd);
 
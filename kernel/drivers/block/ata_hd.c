@@ -3,123 +3,165 @@
 #include <x86/io.h>
 #include <stderr.h>
 
-#define ORDER_DMA_PAGES		2
-#define NR_DMA_PAGES		(1 << (ORDER_DMA_PAGES))
-#define NR_DMA_SECTORS		((NR_DMA_PAGES) * PAGE_SIZE / ATA_SECTOR_SIZE)
+#define NR_PRD_ENTRIES		(PAGE_SIZE / sizeof(struct ata_prdt))
+#define ATA_PRD_BOUNDARY	0x10000			/* a PRD entry can't cross a 64 KB boundary */
 
 /*
- * Wait for operation completion.
+ * Get physical address of a buffer (returns 0 if the controller can't reach it).
  */
-static void ata_hd_wait(struct ata_device *device)
+static uint32_t ata_hd_buffer_phys(struct buffer_head *bh)
 {
-	int status, dstatus;
+	uint32_t pfn = bh->b_page - page_array;
 
-	for (;;) {
-		status = inb(device->bar4 + 2);
-		dstatus = inb(device->io_base + ATA_REG_STATUS);
+	/* 32 bits bus master : memory above 4 GB must be bounced */
+	if (pfn >= (1UL << (32 - PAGE_SHIFT)))
+		return 0;
 
-		if (!(status & 0x04))
-			continue;
-
-		if (!(dstatus & ATA_SR_BSY))
-			break;
-	}
+	return (pfn << PAGE_SHIFT) + ((uint32_t) bh->b_data & ~PAGE_MASK);
 }
 
 /*
- * Read from an ata device.
+ * Build PRDT from next buffers of current request (returns number of sectors).
  */
-static int ata_hd_read(struct ata_device *device, uint32_t sector, size_t nr_sectors, char *buf)
+static uint32_t ata_hd_build_prdt(struct ata_device *device)
 {
-	uint32_t nsect;
+	uint32_t max_sectors = device->lba48 ? ATA_LBA48_MAX_SECTORS : ATA_LBA28_MAX_SECTORS;
+	struct buffer_head *bh = device->rq_bh;
+	uint32_t nsect = 0, phys, size = 0, i = 0;
+
+	device->bounce_bh = NULL;
+
+	for (; bh != NULL; bh = list_next_entry_or_null(bh, &device->request->bhs_list, b_list_req)) {
+		/* command full */
+		if (nsect + (bh->b_size >> 9) > max_sectors)
+			break;
 
-	while (nr_sectors) {
-		/* limit transfert to buffer size */
-		nsect = nr_sectors;
-		if (nsect > NR_DMA_SECTORS)
-			nsect = NR_DMA_SECTORS;
+		/* unreachable buffer : transfer it alone through device buffer */
+		phys = ata_hd_buffer_phys(bh);
+		if (!phys) {
+			if (nsect)
+				break;
+
+			device->bounce_bh = bh;
+			if (device->request->cmd == WRITE)
+				memcpy(device->buf, bh->b_data, bh->b_size);
+			phys = __pa(device->buf);
+		}
+
+		/* contiguous to previous entry in the same 64 KB area : extend it */
+		if (i && device->prdt[i - 1].buffer_phys + size == phys
+		    && (device->prdt[i - 1].buffer_phys & ~(ATA_PRD_BOUNDARY - 1)) == ((phys + bh->b_size - 1) & ~(ATA_PRD_BOUNDARY - 1))) {
+			size += bh->b_size;
+		} else {
+			/* PRDT full */
+			if (i == NR_PRD_ENTRIES)
+				break;
+
+			device->prdt[i].buffer_phys = phys;
+			device->prdt[i].mark_end = 0;
+			size = bh->b_size;
+			i++;
+		}
+
+		/* set entry size (0 = 64 KB) */
+		device->prdt[i - 1].transfert_size = size & 0xFFFF;
+		nsect += bh->b_size >> 9;
+
+		/* bounced buffer is transfered alone */
+		if (device->bounce_bh) {
+			bh = list_next_entry_or_null(bh, &device->request->bhs_list, b_list_req);
+			break;
+		}
+	}
 
-		/* set transfert size */
-		device->prdt[0].transfert_size = nsect * ATA_SECTOR_SIZE;
+	/* mark last entry and remember next buffer */
+	if (i)
+		device->prdt[i - 1].mark_end = 0x8000;
+	device->rq_bh = bh;
+
+	return nsect;
+}
 
-		/* prepare DMA transfert */
-		outb(device->bar4, 0);
-		outl(device->bar4 + 0x04, __pa(device->prdt));
-		outb(device->bar4 + 0x02, inb(device->bar4 + 0x02) | 0x02 | 0x04);
+/*
+ * Start DMA transfer of next buffers of current request (completion is signaled by an interrupt).
+ */
+static int ata_hd_start_dma(struct ata_device *device)
+{
+	uint32_t sector = device->rq_sector, nsect;
+	int write = device->request->cmd == WRITE;
 
-		/* select sector */
-		outb(device->io_base + ATA_REG_CONTROL, 0x00);
+	/* build PRDT */
+	nsect = ata_hd_build_prdt(device);
+	if (!nsect)
+		return -EINVAL;
+	device->dma_sectors = nsect;
+
+	/* prepare DMA transfert */
+	outb(device->bar4 + ATA_BM_REG_COMMAND, 0);
+	outl(device->bar4 + ATA_BM_REG_PRDT, __pa(device->prdt));
+	outb(device->bar4 + ATA_BM_REG_STATUS, inb(device->bar4 + ATA_BM_REG_STATUS) | ATA_BM_SR_ERR | ATA_BM_SR_IRQ);
+
+	/* enable interrupts */
+	outb(device->io_base + ATA_REG_CONTROL, 0x00);
+	outb(device->io_base + ATA_REG_FEATURES, 0x00);
+
+	/* select sector */
+	if (device->lba48) {
+		/* 48 bits : high order bytes first (sector count 0 = 65536 sectors) */
+		outb(device->io_base + ATA_REG_HDDEVSEL, device->drive == ATA_MASTER ? 0x40 : 0x50);
+		outb(device->io_base + ATA_REG_SECCOUNT0, (uint8_t) (nsect >> 8));
+		outb(device->io_base + ATA_REG_LBA0, (uint8_t) (sector >> 24));
+		outb(device->io_base + ATA_REG_LBA1, 0);
+		outb(device->io_base + ATA_REG_LBA2, 0);
+	} else {
+		/* 28 bits : high order bits in device register (sector count 0 = 256 sectors) */
 		outb(device->io_base + ATA_REG_HDDEVSEL, (device->drive == ATA_MASTER ? 0xE0 : 0xF0) | ((sector >> 24) & 0x0F));
-		outb(device->io_base + ATA_REG_FEATURES, 0x00);
-		outb(device->io_base + ATA_REG_SECCOUNT0, nsect);
-		outb(device->io_base + ATA_REG_LBA0, (uint8_t) sector);
-		outb(device->io_base + ATA_REG_LBA1, (uint8_t) (sector >> 8));
-		outb(device->io_base + ATA_REG_LBA2, (uint8_t) (sector >> 16));
-
-		/* issue read DMA command */
-		outb(device->io_base + ATA_REG_COMMAND, ATA_CMD_READ_DMA);
-		outb(device->bar4, 0x8 | 0x1);
-
-		/* wait for completion */
-		ata_hd_wait(device);
-
-		/* copy buffer */
-		memcpy(buf, device->buf, nsect * ATA_SECTOR_SIZE);
-
-		/* update size */
-		buf += nsect * ATA_SECTOR_SIZE;
-		sector += nsect;
-		nr_sectors -= nsect;
+	}
+	outb(device->io_base + ATA_REG_SECCOUNT0, (uint8_t) nsect);
+	outb(device->io_base + ATA_REG_LBA0, (uint8_t) sector);
+	outb(device->io_base + ATA_REG_LBA1, (uint8_t) (sector >> 8));
+	outb(device->io_base + ATA_REG_LBA2, (uint8_t) (sector >> 16));
+
+	/* issue DMA command and start bus master */
+	if (write) {
+		outb(device->io_base + ATA_REG_COMMAND, device->lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA);
+		outb(device->bar4 + ATA_BM_REG_COMMAND, ATA_BM_CMD_START);
+	} else {
+		outb(device->io_base + ATA_REG_COMMAND, device->lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+		outb(device->bar4 + ATA_BM_REG_COMMAND, ATA_BM_CMD_READ | ATA_BM_CMD_START);
 	}
 
 	return 0;
 }
 
 /*
- * Write to an ata device.
+ * End DMA transfer on interrupt (returns 1 if the interrupt was not raised by this transfer).
  */
-static int ata_hd_write(struct ata_device *device, uint32_t sector, size_t nr_sectors, char *buf)
+static int ata_hd_end_dma(struct ata_device *device)
 {
-	uint32_t nsect;
+	uint8_t status, dstatus;
 
-	while (nr_sectors) {
-		/* limit transfert to buffer size */
-		nsect = nr_sectors;
-		if (nsect > NR_DMA_SECTORS)
-			nsect = NR_DMA_SECTORS;
+	/* transfer still running */
+	status = inb(device->bar4 + ATA_BM_REG_STATUS);
+	if (!(status & ATA_BM_SR_IRQ))
+		return 1;
 
-		/* copy buffer */
-		memcpy(device->buf, buf, nsect * ATA_SECTOR_SIZE);
+	/* stop bus master and acknowledge interrupt */
+	outb(device->bar4 + ATA_BM_REG_COMMAND, 0);
+	dstatus = inb(device->io_base + ATA_REG_STATUS);
+	outb(device->bar4 + ATA_BM_REG_STATUS, status | ATA_BM_SR_ERR | ATA_BM_SR_IRQ);
 
-		/* set transfert size */
-		device->prdt[0].transfert_size = nsect * ATA_SECTOR_SIZE;
+	/* check errors */
+	if ((status & ATA_BM_SR_ERR) || (dstatus & (ATA_SR_ERR | ATA_SR_DF)))
+		return -EIO;
 
-		/* prepare DMA transfert */
-		outb(device->bar4, 0);
-		outl(device->bar4 + 0x04, __pa(device->prdt));
-		outb(device->bar4 + 0x02, inb(device->bar4 + 0x02) | 0x02 | 0x04);
+	/* copy bounced buffer */
+	if (device->bounce_bh && device->request->cmd == READ)
+		memcpy(device->bounce_bh->b_data, device->buf, device->bounce_bh->b_size);
 
-		/* select sector */
-		outb(device->io_base + ATA_REG_CONTROL, 0x00);
-		outb(device->io_base + ATA_REG_HDDEVSEL, (device->drive == ATA_MASTER ? 0xE0 : 0xF0) | ((sector >> 24) & 0x0F));
-		outb(device->io_base + ATA_REG_FEATURES, 0x00);
-		outb(device->io_base + ATA_REG_SECCOUNT0, nsect);
-		outb(device->io_base + ATA_REG_LBA0, (uint8_t) sector);
-		outb(device->io_base + ATA_REG_LBA1, (uint8_t) (sector >> 8));
-		outb(device->io_base + ATA_REG_LBA2, (uint8_t) (sector >> 16));
-
-		/* issue write DMA command */
-		outb(device->io_base + ATA_REG_COMMAND, ATA_CMD_WRITE_DMA);
-		outb(device->bar4, 0x1);
-
-		/* wait for completion */
-		ata_hd_wait(device);
-
-		/* update size */
-		buf += nsect * ATA_SECTOR_SIZE;
-		sector += nsect;
-		nr_sectors -= nsect;
-	}
+	/* update position */
+	device->rq_sector += device->dma_sectors;
+	device->rq_nr_sectors -= device->dma_sectors;
 
 	return 0;
 }
@@ -141,25 +183,20 @@ int ata_hd_init(struct ata_device *device)
 	if (!ata_pci_device)
 		return -EINVAL;
 
-	/* allocate prdt */
-	device->prdt = kmalloc(sizeof(struct ata_prdt));
+	/* allocate prdt (one page : can't cross a 64 KB boundary) */
+	device->prdt = (struct ata_prdt *) get_free_page();
 	if (!device->prdt)
 		return -ENOMEM;
 
-	/* allocate buffer */
-	device->buf = get_free_pages(ORDER_DMA_PAGES);
+	/* allocate bounce buffer (for memory out of controller reach) */
+	device->buf = get_free_page();
 	if (!device->buf) {
-		kfree(device->prdt);
+		free_page(device->prdt);
 		return -ENOMEM;
 	}
 
-	/* clear prdt and buffer */
-	memset(device->prdt, 0, sizeof(struct ata_prdt));
-	memset(device->buf, 0, NR_DMA_PAGES * PAGE_SIZE);
-
-	/* set prdt */
-	device->prdt[0].buffer_phys = __pa(device->buf);
-	device->prdt[0].mark_end = 0x8000;
+	/* clear prdt */
+	memset(device->prdt, 0, PAGE_SIZE);
 
 	/* activate pci */
 	cmd_reg = pci_read_field(ata_pci_device->address, PCI_CMD);
@@ -173,10 +210,17 @@ int ata_hd_init(struct ata_device *device)
 	if (device->bar4 & 0x00000001)
 		device->bar4 &= 0xFFFFFFFC;
 
+	/* secondary bus has its own bus master registers */
+	if (device->bus == ATA_SECONDARY)
+		device->bar4 += ATA_BM_SECONDARY;
+
+	/* use 48 bits addressing if supported (disks larger than 128 GB, commands larger than 256 sectors) */
+	device->lba48 = (device->identify.command_sets[1] & ATA_CMDSET_LBA48) && device->identify.sectors_48;
+
 	/* set operations */
 	device->sector_size = ATA_SECTOR_SIZE;
-	device->read = ata_hd_read;
-	device->write = ata_hd_write;
+	device->start_dma = ata_hd_start_dma;
+	device->end_dma = ata_hd_end_dma;
 
 	return 0;
 }
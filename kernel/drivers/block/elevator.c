@@ -0,0 +1,233 @@
+#include <drivers/block/elevator.h>
+#include <drivers/block/blk_dev.h>
+#include <stderr.h>
+#include <stdio.h>
+#include <time.h>
+
+/* elevators names */
+static const char *elevator_names[NR_ELEVATORS] = { "noop", "deadline" };
+
+/* registered queues */
+static LIST_HEAD(queues_list);
+
+/*
+ * Init a request queue (named queues are listed in /proc/iosched).
+ */
+void elv_init_queue(struct request_queue *q, const char *name, int elevator)
+{
+	memset(q, 0, sizeof(struct request_queue));
+	q->name = name;
+	q->elevator = elevator;
+	q->max_sectors = ELV_MAX_SECTORS;
+	INIT_LIST_HEAD(&q->queue_head);
+	INIT_LIST_HEAD(&q->fifo[READ]);
+	INIT_LIST_HEAD(&q->fifo[WRITE]);
+
+	if (name)
+		list_add_tail(&q->list, &queues_list);
+}
+
+/*
+ * Change scheduler of a queue (queued requests are kept : deadline dispatch doesn't rely on sort order).
+ */
+int elv_set_elevator(struct request_queue *q, int elevator)
+{
+	if (elevator < 0 || elevator >= NR_ELEVATORS)
+		return -EINVAL;
+
+	q->elevator = elevator;
+	q->batch_count = 0;
+	q->starved = 0;
+
+	return 0;
+}
+
+/*
+ * Compare position of a request to a sector.
+ */
+static inline int elv_before(struct request *req, dev_t dev, uint32_t sector)
+{
+	return req->rq_dev < dev || (req->rq_dev == dev && req->sector < sector);
+}
+
+/*
+ * Try to merge a buffer with a queued request (returns 1 on success).
+ */
+int elv_merge(struct request_queue *q, int rw, struct buffer_head *bh, int scatter_gather)
+{
+	uint32_t sector = bh->b_rsector, count = bh->b_size >> 9;
+	struct list_head *pos;
+	struct request *req;
+
+	list_for_each(pos, &q->queue_head) {
+		req = list_entry(pos, struct request, queuelist);
+
+		/* different device or command, or request full */
+		if (req->cmd != rw || req->rq_dev != bh->b_dev || req->nr_sectors + count > q->max_sectors)
+			continue;
+
+		/* back merge */
+		if (req->sector + req->nr_sectors == sector
+		    && (scatter_gather || req->buf + (req->nr_sectors << 9) == bh->b_data)) {
+			list_add_tail(&bh->b_list_req, &req->bhs_list);
+			req->nr_sectors += count;
+			q->nr_back_merges++;
+			return 1;
+		}
+
+		/* front merge */
+		if (sector + count == req->sector
+		    && (scatter_gather || bh->b_data + bh->b_size == req->buf)) {
+			list_add(&bh->b_list_req, &req->bhs_list);
+			req->sector = sector;
+			req->buf = bh->b_data;
+			req->nr_sectors += count;
+			q->nr_front_merges++;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Queue a request.
+ */
+void elv_add_request(struct request_queue *q, struct request *req)
+{
+	struct list_head *pos;
+	struct request *next;
+	int dir = req->cmd == WRITE ? WRITE : READ;
+
+	/* set deadline and add to fifo */
+	req->deadline = jiffies + (dir == READ ? DEADLINE_READ_EXPIRE : DEADLINE_WRITE_EXPIRE);
+	list_add_tail(&req->fifo, &q->fifo[dir]);
+	q->nr_queued++;
+
+	/* noop : arrival order */
+	if (q->elevator == ELEVATOR_NOOP) {
+		list_add_tail(&req->queuelist, &q->queue_head);
+		return;
+	}
+
+	/* deadline : sector order */
+	list_for_each(pos, &q->queue_head) {
+		next = list_entry(pos, struct request, queuelist);
+		if (elv_before(req, next->rq_dev, next->sector))
+			break;
+	}
+
+	list_add_tail(&req->queuelist, pos);
+}
+
+/*
+ * Find next request of a direction following last dispatched request.
+ */
+static struct request *deadline_next_sorted(struct request_queue *q, int dir)
+{
+	struct list_head *pos;
+	struct request *req;
+
+	list_for_each(pos, &q->queue_head) {
+		req = list_entry(pos, struct request, queuelist);
+		if (req->cmd == dir && !elv_before(req, q->head_dev, q->head_sector))
+			return req;
+	}
+
+	return NULL;
+}
+
+/*
+ * Choose next request : batches of requests in sector order, reads preferred to writes,
+ * oldest request first when its deadline is over.
+ */
+static struct request *deadline_next_request(struct request_queue *q)
+{
+	struct request *req, *next;
+	int reads, writes, dir;
+
+	/* go on with current batch */
+	if (q->batch_count && q->batch_count < DEADLINE_FIFO_BATCH) {
+		req = deadline_next_sorted(q, q->batch_dir);
+		if (req)
+			goto out;
+	}
+
+	/* choose direction : reads first, unless writes have been starved too long */
+	reads = !list_empty(&q->fifo[READ]);
+	writes = !list_empty(&q->fifo[WRITE]);
+	if (reads && (!writes || q->starved++ < DEADLINE_WRITES_STARVED)) {
+		dir = READ;
+	} else if (writes) {
+		dir = WRITE;
+		q->starved = 0;
+	} else {
+		return NULL;
+	}
+
+	/* start a new batch : oldest request if expired, else next one in sector order */
+	q->batch_dir = dir;
+	q->batch_count = 0;
+	req = list_first_entry(&q->fifo[dir], struct request, fifo);
+	if (jiffies >= req->deadline) {
+		q->nr_expired++;
+	} else {
+		next = deadline_next_sorted(q, dir);
+		if (next)
+			req = next;
+	}
+
+out:
+	q->batch_count++;
+	return req;
+}
+
+/*
+ * Dequeue next request to dispatch.
+ */
+struct request *elv_next_request(struct request_queue *q)
+{
+	struct request *req;
+
+	if (elv_queue_empty(q))
+		return NULL;
+
+	/* choose request */
+	if (q->elevator == ELEVATOR_DEADLINE)
+		req = deadline_next_request(q);
+	else
+		req = list_first_entry(&q->queue_head, struct request, queuelist);
+
+	/* remove it from queue */
+	list_del(&req->queuelist);
+	list_del(&req->fifo);
+
+	/* update head position and statistics */
+	q->head_dev = req->rq_dev;
+	q->head_sector = req->sector + req->nr_sectors;
+	q->nr_queued--;
+	q->nr_dispatched++;
+
+	return req;
+}
+
+/*
+ * Get request queues informations.
+ */
+size_t elv_get_info(char *page)
+{
+	struct request_queue *q;
+	struct list_head *pos;
+	char *ptr = page;
+
+	ptr += sprintf(ptr, "queue      scheduler  max_sect queued   dispatched back_merges front_merges expired\n");
+
+	list_for_each(pos, &queues_list) {
+		q = list_entry(pos, struct request_queue, list);
+		ptr += sprintf(ptr, "%-10s %-10s %-8u %-8u %-10u %-11u %-12u %u\n",
+			       q->name, elevator_names[q->elevator], q->max_sectors, q->nr_queued, q->nr_dispatched,
+			       q->nr_back_merges, q->nr_front_merges, q->nr_expired);
+	}
+
+	return ptr - page;
+}
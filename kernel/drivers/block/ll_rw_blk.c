@@ -13,6 +13,13 @@ size_t *blksize_size[MAX_BLKDEV];
 
 /* requests */
 static struct request all_requests[NR_REQUEST];
+static LIST_HEAD(free_requests);
+static DECLARE_WAIT_QUEUE_HEAD(wait_for_request);
+
+/* ended requests (completed in process context) */
+static LIST_HEAD(done_requests);
+static DECLARE_WAIT_QUEUE_HEAD(kblockd_wait);
+static int kblockd_run_pending = 0;
 
 /*
  * Is a device read only ?
@@ -51,52 +58,173 @@ void set_device_ro(dev_t dev, int flag)
 }
 
 /*
- * End a request.
+ * End a request (may be called from interrupt handlers : buffers and pages are completed later in process context).
  */
 void end_request(struct request *req)
+{
+	uint32_t flags;
+
+	/* queue request */
+	irq_save(flags);
+	list_add_tail(&req->queuelist, &done_requests);
+	irq_restore(flags);
+
+	/* wake up completion thread */
+	wake_up(&kblockd_wait);
+}
+
+/*
+ * Complete ended requests (process context only).
+ */
+void blk_run_completions()
 {
 	struct list_head *pos, *n;
 	struct buffer_head *bh;
+	struct request *req;
+	uint32_t flags;
+
+	if (list_empty(&done_requests))
+		return;
+
+	irq_save(flags);
+
+	while (!list_empty(&done_requests)) {
+		req = list_first_entry(&done_requests, struct request, queuelist);
+		list_del(&req->queuelist);
+
+		/* end i/o */
+		list_for_each_safe(pos, n, &req->bhs_list) {
+			bh = list_entry(pos, struct buffer_head, b_list_req);
+			bh->b_end_io(bh, 1);
+		}
+
+		/* mark request inactive and free it */
+		req->rq_status = RQ_INACTIVE;
+		list_add(&req->queuelist, &free_requests);
+	}
+
+	irq_restore(flags);
+	wake_up(&wait_for_request);
+}
+
+/*
+ * Ask completion thread to execute requests (used by interrupt handlers which can't start polled requests).
+ */
+void kblockd_schedule()
+{
+	kblockd_run_pending = 1;
+	wake_up(&kblockd_wait);
+}
+
+/*
+ * Start requests left by interrupt handlers and complete ended requests (process context only, used by waiters :
+ * kinit can't wait for completion thread).
+ */
+void blk_run_pending()
+{
+	/* starting requests completes ended ones first */
+	if (kblockd_run_pending) {
+		kblockd_run_pending = 0;
+		execute_block_requests();
+		return;
+	}
+
+	blk_run_completions();
+}
+
+/*
+ * Completion thread = complete ended requests and start requests left by interrupt handlers.
+ */
+int kblockd(void *arg)
+{
+	UNUSED(arg);
+
+	for (;;) {
+		/* wait for ended requests */
+		wait_event(&kblockd_wait, !list_empty(&done_requests) || kblockd_run_pending);
 
-	/* end i/o */
-	list_for_each_safe(pos, n, &req->bhs_list) {
-		bh = list_entry(pos, struct buffer_head, b_list_req);
-		bh->b_end_io(bh, 1);
+		/* start and complete requests */
+		blk_run_pending();
 	}
 
-	/* mark request inactive */
-	req->rq_status = RQ_INACTIVE;
+	return 0;
 }
 
 /*
- * Execute requests.
+ * Execute requests (drivers may return before end of requests : waiters must sleep).
  */
 void execute_block_requests()
 {
 	size_t i;
 
-	/* execute requests */
+	/* complete ended requests first (frees requests and buffers) */
+	blk_run_completions();
+
+	/* execute requests (drivers with per device queues check them) */
 	for (i = 0; i < MAX_BLKDEV; i++)
-		if (blk_dev[i].request && blk_dev[i].current_request)
+		if (blk_dev[i].request && (blk_dev[i].get_queue || !elv_queue_empty(&blk_dev[i].queue)))
 			blk_dev[i].request();
 }
 
+/*
+ * Get request queue of a device.
+ */
+struct request_queue *blk_get_queue(dev_t dev)
+{
+	struct blk_dev *bdev = &blk_dev[major(dev)];
+	struct request_queue *q;
+
+	if (bdev->get_queue) {
+		q = bdev->get_queue(dev);
+		if (q)
+			return q;
+	}
+
+	return &bdev->queue;
+}
+
+/*
+ * Get/set scheduler of a device queue.
+ */
+int blk_elv_ioctl(dev_t dev, int request, unsigned long arg)
+{
+	struct request_queue *q = blk_get_queue(dev);
+	uint32_t flags;
+	int ret;
+
+	switch (request) {
+		case BLKELVGET:
+			*((int *) arg) = q->elevator;
+			return 0;
+		case BLKELVSET:
+			if (!suser())
+				return -EPERM;
+
+			irq_save(flags);
+			ret = elv_set_elevator(q, *((int *) arg));
+			irq_restore(flags);
+			return ret;
+		default:
+			return -EINVAL;
+	}
+}
+
 /*
  * Get a free request.
  */
 static struct request *get_request(dev_t dev)
 {
-	size_t i;
+	struct request *req;
 
-	for (i = 0; i < NR_REQUEST; i++)
-		if (all_requests[i].rq_status == RQ_INACTIVE)
-			goto found;
+	if (list_empty(&free_requests))
+		return NULL;
 
-	return NULL;
-found:
-	all_requests[i].rq_status = RQ_ACTIVE;
-	all_requests[i].rq_dev = dev;
-	return &all_requests[i];
+	req = list_first_entry(&free_requests, struct request, queuelist);
+	list_del(&req->queuelist);
+	req->rq_status = RQ_ACTIVE;
+	req->rq_dev = dev;
+
+	return req;
 }
 
 /*
@@ -106,15 +234,16 @@ static struct request *get_request_wait(dev_t dev)
 {
 	struct request *req;
 
-	for (;;) {
-		/* get a request */
-		req = get_request(dev);
-		if (req)
-			return req;
+	/* get a request */
+	req = get_request(dev);
+	if (req)
+		return req;
 
-		/* execute block requests */
-		execute_block_requests();
-	}
+	/* start queued requests and sleep until one of them ends */
+	execute_block_requests();
+	wait_event(&wait_for_request, (blk_run_pending(), (req = get_request(dev)) != NULL));
+
+	return req;
 }
 
 /*
@@ -122,9 +251,10 @@ static struct request *get_request_wait(dev_t dev)
  */
 static void make_request(int rw, struct buffer_head *bh)
 {
-	struct request *req, *prev;
+	struct request_queue *q;
+	struct request *req;
 	struct blk_dev *bdev;
-	uint32_t sector;
+	uint32_t sector, flags;
 	size_t count;
 
 	/* update i/o accounting */
@@ -140,18 +270,14 @@ static void make_request(int rw, struct buffer_head *bh)
 	sector = bh->b_rsector;
 	count = bh->b_size >> 9;
 
-	/* get block device and current request */
+	/* get block device and queue (queue is also updated by interrupt handlers) */
 	bdev = &blk_dev[major(bh->b_dev)];
-	prev = bdev->current_request;
-
-	/* merge with previous request */
-	if (prev
-		&& prev->cmd == rw
-		&& prev->rq_dev == bh->b_dev
-		&& prev->sector + prev->nr_sectors == sector
-		&& prev->buf + (prev->nr_sectors << 9) == bh->b_data) {
-		list_add_tail(&bh->b_list_req, &prev->bhs_list);
-		prev->nr_sectors += count;
+	q = blk_get_queue(bh->b_dev);
+	irq_save(flags);
+
+	/* merge with a queued request */
+	if (elv_merge(q, rw, bh, bdev->scatter_gather)) {
+		irq_restore(flags);
 		return;
 	}
 
@@ -164,16 +290,14 @@ static void make_request(int rw, struct buffer_head *bh)
 	req->sector = sector;
 	req->nr_sectors = count;
 	req->buf = bh->b_data;
-	req->next = NULL;
 
 	/* add buffer to request */
 	INIT_LIST_HEAD(&req->bhs_list);
 	list_add_tail(&bh->b_list_req, &req->bhs_list);
 
-	/* add request to block device */
-	if (bdev->current_request)
-		req->next = bdev->current_request;
-	bdev->current_request = req;
+	/* queue request */
+	elv_add_request(q, req);
+	irq_restore(flags);
 }
 
 /*
@@ -237,11 +361,13 @@ void init_blk_dev()
 {
 	size_t i;
 
-	/* init block devices */
+	/* init block devices queues */
 	for (i = 0; i < MAX_BLKDEV; i++)
-		blk_dev[i].current_request = NULL;
+		elv_init_queue(&blk_dev[i].queue, NULL, ELEVATOR_NOOP);
 
 	/* init requests */
-	for (i = 0; i < NR_REQUEST; i++)
+	for (i = 0; i < NR_REQUEST; i++) {
 		all_requests[i].rq_status = RQ_INACTIVE;
+		list_add_tail(&all_requests[i].queuelist, &free_requests);
+	}
 }
\ No newline at end of file
@@ -82,13 +82,10 @@ static void loop_request()
 
 repeat:
 	/* get next request */
-	request = blk_dev[DEV_LOOP_MAJOR].current_request;
+	request = elv_next_request(&blk_dev[DEV_LOOP_MAJOR].queue);
 	if (!request)
 		return;
 
-	/* remove it from queue */
-	blk_dev[DEV_LOOP_MAJOR].current_request = request->next;
-
 	/* check device */
 	if (minor(request->rq_dev) >= MAX_LOOP)
 		goto err;
@@ -489,6 +486,9 @@ static int lo_ioctl(struct inode *inode, struct file *filp, int request, unsigne
 				return -ENXIO;
 			*((uint64_t *) arg) = loop_sizes[lo->lo_number] * BLOCK_SIZE;
 			break;
+		case BLKELVGET:
+		case BLKELVSET:
+			return blk_elv_ioctl(inode->i_rdev, request, arg);
 		default:
 			printf("Unknown ioctl request (0x%x) on device 0x%x\n", request, (int) inode->i_rdev);
 			return -EINVAL;
@@ -522,6 +522,7 @@ int init_loop()
 
 	/* set request function */
 	blk_dev[DEV_LOOP_MAJOR].request = loop_request;
+	elv_init_queue(&blk_dev[DEV_LOOP_MAJOR].queue, "loop", ELEVATOR_NOOP);
 
 	/* init block size */
 	memset(&loop_sizes, 0, sizeof(loop_sizes));
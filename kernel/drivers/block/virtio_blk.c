@@ -0,0 +1,481 @@
+#include <drivers/block/virtio_blk.h>
+#include <drivers/block/blk_dev.h>
+#include <x86/interrupt.h>
+#include <mm/mm.h>
+#include <stderr.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dev.h>
+
+/* virtio block devices */
+static struct virtio_blk_device virtio_blk_devices[NR_VIRTIO_BLK_DEVICES];
+static int nr_virtio_blk_devices = 0;
+
+/* virtio block sizes */
+static size_t virtio_blk_blksizes[NR_VIRTIO_BLK_DEVICES * NR_PARTITIONS] = { 0, };
+static size_t virtio_blk_sizes[NR_VIRTIO_BLK_DEVICES * NR_PARTITIONS] = { 0, };
+
+/*
+ * Get a virtio block device.
+ */
+static struct virtio_blk_device *virtio_blk_get_device(dev_t dev)
+{
+	int id;
+
+	/* check major number */
+	if (major(dev) != DEV_VIRTIO_BLK_MAJOR)
+		return NULL;
+
+	/* get device id */
+	id = minor(dev) >> PARTITION_MINOR_SHIFT;
+	if (id >= nr_virtio_blk_devices)
+		return NULL;
+
+	return &virtio_blk_devices[id];
+}
+
+/*
+ * Get partition start sector.
+ */
+static uint32_t virtio_blk_get_start_sector(struct virtio_blk_device *device, dev_t dev)
+{
+	int partition_nr;
+
+	/* get partition number */
+	partition_nr = dev - device->hd.dev;
+	if (!partition_nr)
+		return 0;
+
+	return device->hd.partitions[partition_nr].start_sect;
+}
+
+/*
+ * Get number of sectors.
+ */
+static uint32_t virtio_blk_get_nr_sectors(struct virtio_blk_device *device, dev_t dev)
+{
+	int partition_nr;
+
+	/* get partition number */
+	partition_nr = dev - device->hd.dev;
+	if (!partition_nr)
+		return device->capacity;
+
+	return device->hd.partitions[partition_nr].nr_sects;
+}
+
+/*
+ * Get physical address of a buffer.
+ */
+static uint64_t virtio_blk_buffer_phys(struct buffer_head *bh)
+{
+	uint64_t pfn = bh->b_page - page_array;
+
+	return (pfn << PAGE_SHIFT) + ((uint32_t) bh->b_data & ~PAGE_MASK);
+}
+
+/*
+ * Build data segments of a slot from next buffers of its request (returns number of sectors).
+ */
+static uint32_t virtio_blk_build_sg(struct virtio_blk_device *device, struct virtio_blk_slot *slot,
+				    struct virtio_sg *sg, int *nr_segs)
+{
+	struct buffer_head *bh = slot->rq_bh;
+	uint32_t nsect = 0;
+	uint64_t phys;
+	int i = 0;
+
+	for (; bh != NULL; bh = list_next_entry_or_null(bh, &slot->request->bhs_list, b_list_req)) {
+		phys = virtio_blk_buffer_phys(bh);
+
+		/* contiguous to previous segment : extend it */
+		if (i && sg[i - 1].addr + sg[i - 1].len == phys && sg[i - 1].len + bh->b_size <= device->size_max) {
+			sg[i - 1].len += bh->b_size;
+		} else {
+			/* command full */
+			if ((uint32_t) i == device->max_segs)
+				break;
+
+			sg[i].addr = phys;
+			sg[i].len = bh->b_size;
+			i++;
+		}
+
+		nsect += bh->b_size >> 9;
+	}
+
+	/* remember next buffer */
+	slot->rq_bh = bh;
+	*nr_segs = i;
+
+	return nsect;
+}
+
+/*
+ * Post a read/write command of a slot (device is notified by next kick).
+ */
+static int virtio_blk_start_slot(struct virtio_blk_device *device, int tag)
+{
+	struct virtio_sg sg[VIRTIO_BLK_MAX_SEGS + 2];
+	struct virtio_blk_slot *slot = &device->slots[tag];
+	int write = slot->request->cmd == WRITE, nr_segs, ret;
+	uint32_t nsect;
+
+	/* build data segments (after header) */
+	nsect = virtio_blk_build_sg(device, slot, &sg[1], &nr_segs);
+	if (!nsect)
+		return -EINVAL;
+	slot->nr_sectors = nsect;
+
+	/* header is read by device */
+	slot->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	slot->hdr.ioprio = 0;
+	slot->hdr.sector = slot->rq_sector;
+	sg[0].addr = __pa(&slot->hdr);
+	sg[0].len = sizeof(struct virtio_blk_outhdr);
+
+	/* status is written by device */
+	slot->status = 0xFF;
+	sg[nr_segs + 1].addr = __pa(&slot->status);
+	sg[nr_segs + 1].len = 1;
+
+	/* add buffers to virtqueue */
+	if (write)
+		ret = virtqueue_add(&device->vq, sg, nr_segs + 1, 1, slot);
+	else
+		ret = virtqueue_add(&device->vq, sg, 1, nr_segs + 1, slot);
+	if (ret)
+		return ret;
+
+	device->slots_active |= 1U << tag;
+	return 0;
+}
+
+/*
+ * Start a request on a free slot.
+ */
+static void virtio_blk_start_request(struct virtio_blk_device *device, int tag, struct request *request)
+{
+	struct virtio_blk_slot *slot = &device->slots[tag];
+
+	/* set slot */
+	slot->request = request;
+	slot->rq_sector = virtio_blk_get_start_sector(device, request->rq_dev) + request->sector;
+	slot->rq_bh = list_first_entry(&request->bhs_list, struct buffer_head, b_list_req);
+
+	/* post first command */
+	if ((request->cmd == READ || request->cmd == WRITE) && !virtio_blk_start_slot(device, tag))
+		return;
+
+	/* end this request */
+	printf("virtio_blk_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
+	slot->request = NULL;
+	end_request(request);
+}
+
+/*
+ * End command of a slot : transfer next buffers or end request.
+ */
+static void virtio_blk_end_slot(struct virtio_blk_device *device, int tag, int error)
+{
+	struct virtio_blk_slot *slot = &device->slots[tag];
+	struct request *request;
+
+	/* transfer next buffers */
+	if (!error && slot->rq_bh) {
+		slot->rq_sector += slot->nr_sectors;
+		error = virtio_blk_start_slot(device, tag);
+		if (!error)
+			return;
+	}
+
+	/* release slot */
+	request = slot->request;
+	slot->request = NULL;
+
+	/* print error */
+	if (error)
+		printf("virtio_blk_request: error on request (cmd = %x, sector = %ld)\n", request->cmd, request->sector);
+
+	end_request(request);
+}
+
+/*
+ * Get request queue of a device.
+ */
+static struct request_queue *virtio_blk_get_queue(dev_t dev)
+{
+	struct virtio_blk_device *device;
+
+	device = virtio_blk_get_device(dev);
+	if (!device)
+		return NULL;
+
+	return &device->queue;
+}
+
+/*
+ * Handle read/write requests (post all queued requests, then notify each device once).
+ */
+static void virtio_blk_request()
+{
+	struct virtio_blk_device *device;
+	struct request *request;
+	uint32_t flags;
+	int i, tag;
+
+	/* queues are also updated by interrupt handler */
+	irq_save(flags);
+
+	/* requests on unknown devices */
+	while ((request = elv_next_request(&blk_dev[DEV_VIRTIO_BLK_MAJOR].queue)) != NULL) {
+		printf("virtio_blk_request: can't find device 0x%x\n", request->rq_dev);
+		end_request(request);
+	}
+
+	for (i = 0; i < nr_virtio_blk_devices; i++) {
+		device = &virtio_blk_devices[i];
+
+		/* post next requests on free slots */
+		for (tag = 0; tag < device->nr_slots; tag++) {
+			if (device->slots_active & (1U << tag))
+				continue;
+
+			request = elv_next_request(&device->queue);
+			if (!request)
+				break;
+
+			virtio_blk_start_request(device, tag, request);
+		}
+
+		/* notify device */
+		virtqueue_kick(&device->vq);
+	}
+
+	irq_restore(flags);
+}
+
+/*
+ * Irq handler : end used commands and post next ones.
+ */
+static void virtio_blk_irq_handler(struct registers *regs)
+{
+	struct virtio_blk_device *device;
+	struct virtio_blk_slot *slot;
+	int i, tag;
+
+	UNUSED(regs);
+
+	for (i = 0; i < nr_virtio_blk_devices; i++) {
+		device = &virtio_blk_devices[i];
+
+		/* interrupt not raised by this device's queue (reading status acknowledges it) */
+		if (!(virtio_read_isr(&device->vdev) & VIRTIO_ISR_QUEUE))
+			continue;
+
+		/* end used commands */
+		while ((slot = virtqueue_get_buf(&device->vq, NULL)) != NULL) {
+			tag = slot - device->slots;
+			device->slots_active &= ~(1U << tag);
+			virtio_blk_end_slot(device, tag, slot->status == VIRTIO_BLK_S_OK ? 0 : -EIO);
+		}
+	}
+
+	/* post next requests */
+	virtio_blk_request();
+}
+
+/*
+ * Probe a virtio block device.
+ */
+static int virtio_blk_probe(struct pci_device *pci_dev)
+{
+	struct virtio_blk_device *device = &virtio_blk_devices[nr_virtio_blk_devices];
+	uint32_t limit;
+	uint64_t capacity;
+	int ret, i;
+
+	/* set device */
+	memset(device, 0, sizeof(struct virtio_blk_device));
+	device->id = nr_virtio_blk_devices;
+
+	/* init transport and negotiate features */
+	ret = virtio_pci_init(&device->vdev, pci_dev);
+	if (ret)
+		return ret;
+	virtio_negotiate_features(&device->vdev, (1U << VIRTIO_BLK_F_SIZE_MAX) | (1U << VIRTIO_BLK_F_SEG_MAX) | (1U << VIRTIO_BLK_F_RO));
+
+	/* get capacity (partitions are addressed on 32 bits) */
+	capacity = virtio_config_readq(&device->vdev, VIRTIO_BLK_CONFIG_CAPACITY);
+	device->capacity = capacity >> 32 ? 0xFFFFFFFF : (uint32_t) capacity;
+	if (!device->capacity) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	/* set up request virtqueue */
+	ret = virtio_find_vq(&device->vdev, 0, &device->vq);
+	if (ret)
+		goto err;
+
+	/* allocate slots (header and status must be reachable by device) */
+	device->slots = (struct virtio_blk_slot *) get_free_page();
+	if (!device->slots) {
+		ret = -ENOMEM;
+		goto err_vq;
+	}
+	memset(device->slots, 0, PAGE_SIZE);
+
+	/* share descriptors between slots (a command uses a header, data segments and a status) */
+	device->nr_slots = device->vq.num / 4 < NR_VIRTIO_BLK_SLOTS ? device->vq.num / 4 : NR_VIRTIO_BLK_SLOTS;
+	device->max_segs = device->vq.num / device->nr_slots - 2;
+	if (device->max_segs > VIRTIO_BLK_MAX_SEGS)
+		device->max_segs = VIRTIO_BLK_MAX_SEGS;
+
+	/* respect device limits */
+	if (virtio_has_feature(&device->vdev, VIRTIO_BLK_F_SEG_MAX)) {
+		limit = virtio_config_readl(&device->vdev, VIRTIO_BLK_CONFIG_SEG_MAX);
+		if (limit && limit < device->max_segs)
+			device->max_segs = limit;
+	}
+	device->size_max = 0xFFFFFFFF;
+	if (virtio_has_feature(&device->vdev, VIRTIO_BLK_F_SIZE_MAX)) {
+		limit = virtio_config_readl(&device->vdev, VIRTIO_BLK_CONFIG_SIZE_MAX);
+		if (limit >= PAGE_SIZE)
+			device->size_max = limit;
+	}
+	if (!device->nr_slots) {
+		ret = -EINVAL;
+		goto err_slots;
+	}
+
+	/* set gendisk */
+	device->hd.dev = mkdev(DEV_VIRTIO_BLK_MAJOR, device->id << PARTITION_MINOR_SHIFT);
+	sprintf(device->hd.name, "vd%c", 'a' + device->id);
+	if (virtio_has_feature(&device->vdev, VIRTIO_BLK_F_RO))
+		set_device_ro(device->hd.dev, 1);
+
+	/* init request queue (host schedules i/o : dispatch in arrival order) */
+	elv_init_queue(&device->queue, device->hd.name, ELEVATOR_NOOP);
+	device->queue.max_sectors = VIRTIO_BLK_MAX_SECTORS;
+
+	/* register interrupt handler once per line */
+	for (i = 0; i < nr_virtio_blk_devices; i++)
+		if (virtio_blk_devices[i].vdev.irq == device->vdev.irq)
+			break;
+	if (i == nr_virtio_blk_devices)
+		request_irq(device->vdev.irq, virtio_blk_irq_handler, SA_SHIRQ, "virtio_blk", NULL);
+
+	/* device is ready */
+	nr_virtio_blk_devices++;
+	virtio_driver_ok(&device->vdev);
+
+	printf("[Kernel] Virtio disk %s (%d requests in flight, %d segments per request)\n",
+	       device->hd.name, device->nr_slots, device->max_segs);
+
+	return 0;
+err_slots:
+	free_page(device->slots);
+err_vq:
+	virtio_del_vq(&device->vq);
+err:
+	virtio_reset(&device->vdev);
+	return ret;
+}
+
+/*
+ * Ioctl write.
+ */
+static int virtio_blk_ioctl(struct inode *inode, struct file *filp, int request, unsigned long arg)
+{
+	struct virtio_blk_device *device;
+	dev_t dev = inode->i_rdev;
+
+	UNUSED(filp);
+
+	/* get virtio block device */
+	device = virtio_blk_get_device(dev);
+	if (!device)
+		return -EINVAL;
+
+	switch (request) {
+		case BLKGETSIZE:
+			*((uint32_t *) arg) = virtio_blk_get_nr_sectors(device, dev);
+			break;
+		case BLKGETSIZE64:
+			*((uint64_t *) arg) = (uint64_t) virtio_blk_get_nr_sectors(device, dev) * VIRTIO_BLK_SECTOR_SIZE;
+			break;
+		case BLKSSZGET:
+		 	*((uint32_t *) arg) = blksize_size[major(dev)][minor(dev)];
+			break;
+		case BLKROGET:
+		 	*((int *) arg) = is_read_only(dev);
+			break;
+		case BLKDISCARDZEROES:
+			break;
+		case BLKELVGET:
+		case BLKELVSET:
+			return blk_elv_ioctl(dev, request, arg);
+		default:
+			printf("Unknown ioctl request (0x%x) on device 0x%x\n", request, (int) dev);
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Virtio block file operations.
+ */
+static struct file_operations virtio_blk_fops = {
+	.read		= generic_block_read,
+	.write		= generic_block_write,
+	.ioctl		= virtio_blk_ioctl,
+};
+
+/*
+ * Init virtio block devices.
+ */
+int init_virtio_blk()
+{
+	struct pci_device *pci_dev;
+	int ret, i, j;
+
+	/* no virtio block device */
+	pci_dev = pci_get_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID);
+	if (!pci_dev)
+		return -EINVAL;
+
+	/* register virtio block device */
+	ret = register_blkdev(DEV_VIRTIO_BLK_MAJOR, "virtblk", &virtio_blk_fops);
+	if (ret)
+		return ret;
+
+	/* set default block size */
+	blksize_size[DEV_VIRTIO_BLK_MAJOR] = virtio_blk_blksizes;
+	blk_size[DEV_VIRTIO_BLK_MAJOR] = virtio_blk_sizes;
+
+	/* register block device (requests buffers are transfered by scatter gather DMA) */
+	blk_dev[DEV_VIRTIO_BLK_MAJOR].request = virtio_blk_request;
+	blk_dev[DEV_VIRTIO_BLK_MAJOR].get_queue = virtio_blk_get_queue;
+	blk_dev[DEV_VIRTIO_BLK_MAJOR].scatter_gather = 1;
+
+	/* probe all devices */
+	for (; pci_dev && nr_virtio_blk_devices < NR_VIRTIO_BLK_DEVICES; pci_dev = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, pci_dev))
+		virtio_blk_probe(pci_dev);
+
+	for (i = 0; i < nr_virtio_blk_devices; i++) {
+		/* set default block size */
+		virtio_blk_blksizes[i << PARTITION_MINOR_SHIFT] = BLOCK_SIZE;
+
+		/* discover partitions */
+		check_partition(&virtio_blk_devices[i].hd);
+
+		/* set disk and partitions size */
+		virtio_blk_sizes[i << PARTITION_MINOR_SHIFT] = virtio_blk_devices[i].capacity >> (BLOCK_SIZE_BITS - 9);
+		for (j = 1; j < NR_PARTITIONS; j++)
+			virtio_blk_sizes[(i << PARTITION_MINOR_SHIFT) + j] = virtio_blk_devices[i].hd.partitions[j].nr_sects >> (BLOCK_SIZE_BITS - 9);
+	}
+
+	return 0;
+}
@@ -0,0 +1,615 @@
+#include <drivers/block/zram.h>
+#include <drivers/block/blk_dev.h>
+#include <fs/proc_fs.h>
+#include <mm/mm.h>
+#include <lib/lz4.h>
+#include <stdio.h>
+#include <stderr.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dev.h>
+
+/* global variables */
+static struct zram zram_dev[MAX_ZRAM];
+static size_t zram_sizes[MAX_ZRAM];
+static size_t zram_blksizes[MAX_ZRAM];
+
+/* compression buffers */
+static uint8_t zram_wrkmem[LZ4_MEM_COMPRESS];
+static uint8_t zram_cbuf[ZS_MAX_SIZE];
+static uint8_t zram_buffer[PAGE_SIZE];
+
+/*
+ * Allocate an object in the compressed pool.
+ */
+static void *zs_malloc(struct zram *zram, size_t size)
+{
+	struct zs_class *class;
+	struct zs_page *zpage;
+	struct page *page;
+	uint8_t *obj;
+	size_t i;
+
+	/* get size class */
+	class = &zram->classes[(size + ZS_ALIGN - 1) / ZS_ALIGN - 1];
+
+	/* no partial page : allocate a new one (never reclaim from i/o path) */
+	if (list_empty(&class->partial_pages)) {
+		page = __get_free_pages_noreclaim(GFP_KERNEL, 0);
+		if (!page)
+			return NULL;
+
+		/* init page descriptor */
+		zpage = (struct zs_page *) page_address(page);
+		zpage->class = class;
+		zpage->nr_free = class->objs_per_page;
+		zpage->free_objs = NULL;
+
+		/* build free objects list */
+		obj = (uint8_t *) zpage + PAGE_SIZE - class->size;
+		for (i = 0; i < class->objs_per_page; i++, obj -= class->size) {
+			*((void **) obj) = zpage->free_objs;
+			zpage->free_objs = obj;
+		}
+
+		list_add(&zpage->list, &class->partial_pages);
+		zram->pool_pages++;
+	}
+
+	/* pop first free object */
+	zpage = list_first_entry(&class->partial_pages, struct zs_page, list);
+	obj = zpage->free_objs;
+	zpage->free_objs = *((void **) obj);
+
+	/* page full : remove it from partial list */
+	if (!--zpage->nr_free)
+		list_del(&zpage->list);
+
+	return obj;
+}
+
+/*
+ * Free an object of the compressed pool.
+ */
+static void zs_free(struct zram *zram, void *obj)
+{
+	struct zs_page *zpage = (struct zs_page *) ((uint32_t) obj & PAGE_MASK);
+	struct zs_class *class = zpage->class;
+
+	/* push object */
+	*((void **) obj) = zpage->free_objs;
+	zpage->free_objs = obj;
+
+	/* page was full : add it to partial list */
+	if (++zpage->nr_free == 1)
+		list_add(&zpage->list, &class->partial_pages);
+
+	/* empty page : release it */
+	if (zpage->nr_free == class->objs_per_page) {
+		list_del(&zpage->list);
+		free_page(zpage);
+		zram->pool_pages--;
+	}
+}
+
+/*
+ * Checksum compressed data.
+ */
+static uint32_t zram_checksum(const uint8_t *data, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 16777619U;
+
+	return hash;
+}
+
+/*
+ * Check if a page is filled with a single word.
+ */
+static int zram_page_same_filled(const uint32_t *data, uint32_t *value)
+{
+	size_t i;
+
+	for (i = 1; i < PAGE_SIZE / sizeof(uint32_t); i++)
+		if (data[i] != data[0])
+			return 0;
+
+	*value = data[0];
+	return 1;
+}
+
+/*
+ * Release a device page.
+ */
+static void zram_free_slot(struct zram *zram, uint32_t index)
+{
+	struct zram_slot *slot = &zram->slots[index];
+	struct zram_entry *entry;
+
+	if (!slot->flags)
+		return;
+
+	if (slot->flags & ZRAM_SAME) {
+		zram->same_pages--;
+		if (!slot->u.value)
+			zram->zero_pages--;
+	} else if (slot->flags & ZRAM_HUGE) {
+		free_page(slot->u.page);
+		zram->huge_pages--;
+		zram->pool_pages--;
+	} else {
+		entry = slot->u.entry;
+		if (--entry->refcount) {
+			zram->dedup_pages--;
+		} else {
+			list_del(&entry->hash);
+			zram->compr_data_size -= entry->len;
+			zs_free(zram, entry);
+		}
+	}
+
+	slot->flags = 0;
+	slot->u.entry = NULL;
+	zram->pages_stored--;
+}
+
+/*
+ * Read a device page.
+ */
+static int zram_read_page(struct zram *zram, uint32_t index, uint8_t *buf)
+{
+	struct zram_slot *slot = &zram->slots[index];
+	struct zram_entry *entry;
+	uint32_t *p;
+	size_t i;
+
+	zram->num_reads++;
+
+	/* never written page */
+	if (!slot->flags) {
+		memset(buf, 0, PAGE_SIZE);
+		return 0;
+	}
+
+	/* same filled page */
+	if (slot->flags & ZRAM_SAME) {
+		for (i = 0, p = (uint32_t *) buf; i < PAGE_SIZE / sizeof(uint32_t); i++)
+			p[i] = slot->u.value;
+		return 0;
+	}
+
+	/* uncompressed page */
+	if (slot->flags & ZRAM_HUGE) {
+		memcpy(buf, slot->u.page, PAGE_SIZE);
+		return 0;
+	}
+
+	/* decompress page */
+	entry = slot->u.entry;
+	if (lz4_decompress((uint8_t *) (entry + 1), entry->len, buf, PAGE_SIZE) != (int) PAGE_SIZE)
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Find an identical compressed page.
+ */
+static struct zram_entry *zram_find_entry(struct zram *zram, uint32_t checksum, const uint8_t *data, size_t len)
+{
+	struct zram_entry *entry;
+	struct list_head *pos;
+
+	list_for_each(pos, &zram->hash[checksum % ZRAM_HASH_SIZE]) {
+		entry = list_entry(pos, struct zram_entry, hash);
+		if (entry->checksum == checksum && entry->len == len && !memcmp(entry + 1, data, len))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Write a device page.
+ */
+static int zram_write_page(struct zram *zram, uint32_t index, const uint8_t *buf)
+{
+	struct zram_entry *entry;
+	uint32_t value, checksum;
+	struct page *page;
+	size_t len;
+
+	zram->num_writes++;
+
+	/* same filled page : nothing to store */
+	if (zram_page_same_filled((const uint32_t *) buf, &value)) {
+		zram_free_slot(zram, index);
+		zram->slots[index].flags = ZRAM_SAME;
+		zram->slots[index].u.value = value;
+		zram->same_pages++;
+		if (!value)
+			zram->zero_pages++;
+		goto out;
+	}
+
+	/* compress page */
+	len = lz4_compress(buf, PAGE_SIZE, zram_cbuf, ZS_MAX_SIZE - sizeof(struct zram_entry), zram_wrkmem);
+
+	/* incompressible page : store it as is */
+	if (!len) {
+		page = __get_free_pages_noreclaim(GFP_KERNEL, 0);
+		if (!page)
+			goto err;
+
+		memcpy(page_address(page), buf, PAGE_SIZE);
+		zram_free_slot(zram, index);
+		zram->slots[index].flags = ZRAM_HUGE;
+		zram->slots[index].u.page = page_address(page);
+		zram->huge_pages++;
+		zram->pool_pages++;
+		goto out;
+	}
+
+	/* identical page already stored : share it */
+	checksum = zram_checksum(zram_cbuf, len);
+	entry = zram_find_entry(zram, checksum, zram_cbuf, len);
+	if (entry) {
+		entry->refcount++;
+		zram->dedup_pages++;
+	} else {
+		/* store compressed page */
+		entry = zs_malloc(zram, sizeof(struct zram_entry) + len);
+		if (!entry)
+			goto err;
+
+		entry->checksum = checksum;
+		entry->refcount = 1;
+		entry->len = len;
+		memcpy(entry + 1, zram_cbuf, len);
+		list_add(&entry->hash, &zram->hash[checksum % ZRAM_HASH_SIZE]);
+		zram->compr_data_size += len;
+	}
+
+	/* release previous content after taking the new reference (it may be the same entry) */
+	zram_free_slot(zram, index);
+	zram->slots[index].flags = ZRAM_COMPRESSED;
+	zram->slots[index].u.entry = entry;
+out:
+	zram->pages_stored++;
+	return 0;
+err:
+	zram->failed_writes++;
+	return -ENOMEM;
+}
+
+/*
+ * Handle a read/write request.
+ */
+static void zram_request()
+{
+	struct request *request;
+	uint32_t index, offset;
+	struct zram *zram;
+	size_t len, size;
+	char *buf;
+	int ret;
+
+repeat:
+	/* get next request */
+	request = elv_next_request(&blk_dev[DEV_ZRAM_MAJOR].queue);
+	if (!request)
+		return;
+
+	/* check device */
+	if (minor(request->rq_dev) >= MAX_ZRAM)
+		goto err;
+
+	/* check command */
+	if (request->cmd != READ && request->cmd != WRITE)
+		goto err;
+
+	/* compute first page and offset */
+	zram = &zram_dev[minor(request->rq_dev)];
+	index = request->sector >> (PAGE_SHIFT - 9);
+	offset = (request->sector << 9) & ~PAGE_MASK;
+	len = request->nr_sectors << 9;
+	buf = request->buf;
+
+	/* read/write page by page */
+	while (len > 0) {
+		if (index >= zram->nr_pages)
+			goto err;
+
+		/* compute size */
+		size = PAGE_SIZE - offset;
+		if (size > len)
+			size = len;
+
+		if (request->cmd == READ) {
+			/* full page : decompress directly in buffer */
+			if (size == PAGE_SIZE) {
+				ret = zram_read_page(zram, index, (uint8_t *) buf);
+			} else {
+				ret = zram_read_page(zram, index, zram_buffer);
+				memcpy(buf, zram_buffer + offset, size);
+			}
+		} else {
+			/* partial page : read, modify, write */
+			if (size == PAGE_SIZE) {
+				ret = zram_write_page(zram, index, (uint8_t *) buf);
+			} else {
+				ret = zram_read_page(zram, index, zram_buffer);
+				if (!ret) {
+					memcpy(zram_buffer + offset, buf, size);
+					ret = zram_write_page(zram, index, zram_buffer);
+				}
+			}
+		}
+
+		if (ret)
+			goto err;
+
+		/* go to next page */
+		buf += size;
+		len -= size;
+		offset = 0;
+		index++;
+	}
+
+	/* end request */
+	end_request(request);
+	goto repeat;
+err:
+	printf("zram: error on request (cmd = 0x%x, sector = %ld)\n", request->cmd, request->sector);
+	end_request(request);
+	goto repeat;
+}
+
+/*
+ * Release a freed swap slot.
+ */
+static void zram_swap_slot_free_notify(dev_t dev, uint32_t index)
+{
+	struct zram *zram;
+
+	/* check device */
+	if (minor(dev) >= MAX_ZRAM)
+		return;
+
+	/* free slot */
+	zram = &zram_dev[minor(dev)];
+	if (index < zram->nr_pages && zram->slots[index].flags) {
+		zram_free_slot(zram, index);
+		zram->notify_free++;
+	}
+}
+
+/*
+ * Open a zram device.
+ */
+static int zram_open(struct inode *inode, struct file *filp)
+{
+	/* unused file */
+	UNUSED(filp);
+
+	/* check inode */
+	if (!inode)
+		return -EINVAL;
+
+	/* check device */
+	if (major(inode->i_rdev) != DEV_ZRAM_MAJOR || minor(inode->i_rdev) >= MAX_ZRAM)
+		return -ENODEV;
+
+	/* device not allocated */
+	if (!zram_dev[minor(inode->i_rdev)].slots)
+		return -ENXIO;
+
+	return 0;
+}
+
+/*
+ * Close a zram device.
+ */
+static int zram_release(struct inode *inode, struct file *filp)
+{
+	/* unused file */
+	UNUSED(filp);
+
+	/* synchronize device */
+	if (inode)
+		sync_dev(inode->i_rdev);
+
+	return 0;
+}
+
+/*
+ * Zram ioctl.
+ */
+static int zram_ioctl(struct inode *inode, struct file *filp, int request, unsigned long arg)
+{
+	struct zram *zram;
+
+	/* unused file */
+	UNUSED(filp);
+
+	/* check device */
+	if (!inode || minor(inode->i_rdev) >= MAX_ZRAM)
+		return -ENODEV;
+
+	/* get device */
+	zram = &zram_dev[minor(inode->i_rdev)];
+
+	switch (request) {
+		case BLKGETSIZE:
+			*((uint32_t *) arg) = zram->nr_pages << (PAGE_SHIFT - 9);
+			break;
+		case BLKGETSIZE64:
+			*((uint64_t *) arg) = (uint64_t) zram->nr_pages << PAGE_SHIFT;
+			break;
+		case BLKELVGET:
+		case BLKELVSET:
+			return blk_elv_ioctl(inode->i_rdev, request, arg);
+		default:
+			printf("Unknown ioctl request (0x%x) on device 0x%x\n", request, (int) inode->i_rdev);
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Read zram statistics.
+ */
+static int zram_read_proc(char *page, char **start, off_t off, size_t count, int *eof)
+{
+	uint32_t orig_kb, mem_kb, ratio;
+	struct zram *zram;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < MAX_ZRAM; i++) {
+		zram = &zram_dev[i];
+		if (!zram->slots)
+			continue;
+
+		/* compression ratio = original size / memory used (x100) */
+		orig_kb = zram->pages_stored << (PAGE_SHIFT - 10);
+		mem_kb = zram->pool_pages << (PAGE_SHIFT - 10);
+		ratio = mem_kb ? orig_kb * 100 / mem_kb : 0;
+
+		len += sprintf(page + len,	"zram%d\n"
+						"disksize %u kB\n"
+						"orig_data_size %u kB\n"
+						"compr_data_size %u\n"
+						"mem_used_total %u kB\n"
+						"compr_ratio %u.%02u\n"
+						"pages_stored %u\n"
+						"same_pages %u\n"
+						"zero_pages %u\n"
+						"huge_pages %u\n"
+						"dedup_pages %u\n"
+						"num_reads %u\n"
+						"num_writes %u\n"
+						"failed_writes %u\n"
+						"notify_free %u\n",
+				i,
+				zram->nr_pages << (PAGE_SHIFT - 10),
+				orig_kb,
+				zram->compr_data_size,
+				mem_kb,
+				ratio / 100, ratio % 100,
+				zram->pages_stored,
+				zram->same_pages,
+				zram->zero_pages,
+				zram->huge_pages,
+				zram->dedup_pages,
+				zram->num_reads,
+				zram->num_writes,
+				zram->failed_writes,
+				zram->notify_free);
+	}
+
+	/* end of file ? */
+	if (off + count >= len)
+		*eof = 1;
+
+	/* set start buffer */
+	*start = page + off;
+
+	/* check offset */
+	if (off >= len)
+		return 0;
+
+	/* compute length */
+	len -= off;
+	if (len > count)
+		len = count;
+
+	return len;
+}
+
+/*
+ * Zram file operations.
+ */
+static struct file_operations zram_fops = {
+	.open		= zram_open,
+	.release	= zram_release,
+	.read		= generic_block_read,
+	.write		= generic_block_write,
+	.ioctl		= zram_ioctl,
+};
+
+/*
+ * Init a zram device (pages are stored lazily, size defaults to a quarter of memory).
+ */
+static int zram_init_device(struct zram *zram)
+{
+	uint32_t order;
+	size_t i;
+
+	/* compute size */
+	memset(zram, 0, sizeof(struct zram));
+	zram->nr_pages = totalram_pages / 4;
+	if (zram->nr_pages > ZRAM_MAX_PAGES)
+		zram->nr_pages = ZRAM_MAX_PAGES;
+
+	/* allocate slots */
+	for (order = 0; (uint32_t) (PAGE_SIZE << order) < zram->nr_pages * sizeof(struct zram_slot); order++);
+	zram->slots = get_free_pages(order);
+	if (!zram->slots)
+		return -ENOMEM;
+	memset(zram->slots, 0, PAGE_SIZE << order);
+
+	/* init hash table */
+	for (i = 0; i < ZRAM_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&zram->hash[i]);
+
+	/* init size classes */
+	for (i = 0; i < ZS_NR_CLASSES; i++) {
+		zram->classes[i].size = (i + 1) * ZS_ALIGN;
+		zram->classes[i].objs_per_page = (PAGE_SIZE - sizeof(struct zs_page)) / zram->classes[i].size;
+		INIT_LIST_HEAD(&zram->classes[i].partial_pages);
+	}
+
+	return 0;
+}
+
+/*
+ * Init zram devices.
+ */
+int init_zram()
+{
+	int ret, i;
+
+	/* register device */
+	ret = register_blkdev(DEV_ZRAM_MAJOR, "zram", &zram_fops);
+	if (ret)
+		return ret;
+
+	/* set request function */
+	blk_dev[DEV_ZRAM_MAJOR].request = zram_request;
+	elv_init_queue(&blk_dev[DEV_ZRAM_MAJOR].queue, "zram", ELEVATOR_NOOP);
+	blk_dev[DEV_ZRAM_MAJOR].swap_slot_free_notify = zram_swap_slot_free_notify;
+
+	/* init devices */
+	memset(&zram_blksizes, 0, sizeof(zram_blksizes));
+	for (i = 0; i < MAX_ZRAM; i++) {
+		ret = zram_init_device(&zram_dev[i]);
+		if (ret)
+			return ret;
+
+		zram_sizes[i] = zram_dev[i].nr_pages << (PAGE_SHIFT - 10);
+	}
+
+	/* set block sizes */
+	blk_size[DEV_ZRAM_MAJOR] = zram_sizes;
+	blksize_size[DEV_ZRAM_MAJOR] = zram_blksizes;
+
+	/* register statistics */
+	create_proc_read_entry("zram", 0, NULL, zram_read_proc);
+
+	return 0;
+}
@@ -135,6 +135,22 @@ void update_times()
 	jiffies++;
 }
 
+/*
+ * Convert Time Stamp Counter cycles to microseconds (0 if Time Stamp Counter is not calibrated).
+ */
+uint32_t cycles_to_usecs(uint64_t cycles)
+{
+	uint32_t low = cycles, high = cycles >> 32, edx;
+
+	/* usecs = cycles * tsc_quotient / 2^32 */
+	__asm__("mull %2"
+		:"=a" (low), "=d" (edx)
+		:"g" (tsc_quotient),
+		 "0" (low));
+
+	return high * tsc_quotient + edx;
+}
+
 /*
  * Init the Programmable Interval Timer.
  */
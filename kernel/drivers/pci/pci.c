@@ -90,19 +90,27 @@ static void pci_scan_bus(uint8_t bus)
 }
 
 /*
- * Get a PCI device.
+ * Find next PCI device matching vendor/device ids, after from (or first one if from is NULL).
  */
-struct pci_device *pci_get_device(uint32_t vendor_id, uint32_t device_id)
+struct pci_device *pci_find_device(uint32_t vendor_id, uint32_t device_id, struct pci_device *from)
 {
 	int i;
 
-	for (i = 0; i < nr_pci_devices; i++)
+	for (i = from ? from - pci_devices + 1 : 0; i < nr_pci_devices; i++)
 		if (pci_devices[i].vendor_id == vendor_id && pci_devices[i].device_id == device_id)
 			return &pci_devices[i];
 
 	return NULL;
 }
 
+/*
+ * Get a PCI device.
+ */
+struct pci_device *pci_get_device(uint32_t vendor_id, uint32_t device_id)
+{
+	return pci_find_device(vendor_id, device_id, NULL);
+}
+
 /*
  * Init PCI devices.
  */
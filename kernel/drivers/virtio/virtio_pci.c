@@ -0,0 +1,203 @@
+#include <drivers/virtio/virtio.h>
+#include <x86/io.h>
+#include <mm/mm.h>
+#include <mm/paging.h>
+#include <stderr.h>
+#include <string.h>
+
+/*
+ * Set device status.
+ */
+static inline void virtio_add_status(struct virtio_device *vdev, uint8_t status)
+{
+	outb(vdev->io_base + VIRTIO_PCI_STATUS, inb(vdev->io_base + VIRTIO_PCI_STATUS) | status);
+}
+
+/*
+ * Reset a device (stops all queues).
+ */
+void virtio_reset(struct virtio_device *vdev)
+{
+	outb(vdev->io_base + VIRTIO_PCI_STATUS, 0);
+	inb(vdev->io_base + VIRTIO_PCI_STATUS);
+}
+
+/*
+ * Init a legacy virtio PCI device : reset it and tell it a driver was found.
+ */
+int virtio_pci_init(struct virtio_device *vdev, struct pci_device *pci_dev)
+{
+	uint32_t pci_cmd;
+
+	/* legacy interface is in I/O space */
+	if (!(pci_dev->bar0 & 0x1))
+		return -ENXIO;
+
+	vdev->pci_dev = pci_dev;
+	vdev->io_base = pci_dev->bar0 & ~0x3;
+	vdev->irq = pci_read_field(pci_dev->address, PCI_INTERRUPT_LINE) & 0xFF;
+	vdev->features = 0;
+
+	/* enable PCI Bus Mastering to allow device to access rings */
+	pci_cmd = pci_read_field(pci_dev->address, PCI_CMD);
+	if (!(pci_cmd & PCI_CMD_REG_BUS_MASTER)) {
+		pci_cmd |= PCI_CMD_REG_BUS_MASTER;
+		pci_write_field(pci_dev->address, PCI_CMD, pci_cmd);
+	}
+
+	/* reset device and acknowledge it */
+	virtio_reset(vdev);
+	virtio_add_status(vdev, VIRTIO_STATUS_ACKNOWLEDGE);
+	virtio_add_status(vdev, VIRTIO_STATUS_DRIVER);
+
+	return 0;
+}
+
+/*
+ * Negotiate features (returns features used).
+ */
+uint32_t virtio_negotiate_features(struct virtio_device *vdev, uint32_t supported)
+{
+	vdev->features = inl(vdev->io_base + VIRTIO_PCI_HOST_FEATURES) & supported;
+	outl(vdev->io_base + VIRTIO_PCI_GUEST_FEATURES, vdev->features);
+
+	return vdev->features;
+}
+
+/*
+ * Tell device the driver is ready.
+ */
+void virtio_driver_ok(struct virtio_device *vdev)
+{
+	virtio_add_status(vdev, VIRTIO_STATUS_DRIVER_OK);
+}
+
+/*
+ * Read and acknowledge interrupt status.
+ */
+uint8_t virtio_read_isr(struct virtio_device *vdev)
+{
+	return inb(vdev->io_base + VIRTIO_PCI_ISR);
+}
+
+/*
+ * Read a byte of device configuration.
+ */
+uint8_t virtio_config_readb(struct virtio_device *vdev, uint32_t offset)
+{
+	return inb(vdev->io_base + VIRTIO_PCI_CONFIG + offset);
+}
+
+/*
+ * Read a 32 bits word of device configuration.
+ */
+uint32_t virtio_config_readl(struct virtio_device *vdev, uint32_t offset)
+{
+	return inl(vdev->io_base + VIRTIO_PCI_CONFIG + offset);
+}
+
+/*
+ * Read a 64 bits word of device configuration.
+ */
+uint64_t virtio_config_readq(struct virtio_device *vdev, uint32_t offset)
+{
+	uint32_t low, high;
+
+	low = virtio_config_readl(vdev, offset);
+	high = virtio_config_readl(vdev, offset + 4);
+
+	return ((uint64_t) high << 32) | low;
+}
+
+/*
+ * Get offset of legacy used ring (after descriptors and available ring, on next aligned page).
+ */
+static uint32_t vring_used_offset(uint16_t num)
+{
+	uint32_t size;
+
+	size = num * sizeof(struct vring_desc) + sizeof(uint16_t) * (3 + num);
+	return (size + VIRTIO_RING_ALIGN - 1) & ~(VIRTIO_RING_ALIGN - 1);
+}
+
+/*
+ * Get size of legacy rings.
+ */
+static uint32_t vring_size(uint16_t num)
+{
+	return vring_used_offset(num) + sizeof(uint16_t) * 3 + num * sizeof(struct vring_used_elem);
+}
+
+/*
+ * Set up a virtqueue.
+ */
+int virtio_find_vq(struct virtio_device *vdev, uint16_t index, struct virtqueue *vq)
+{
+	uint32_t size, order;
+	void *rings;
+	uint16_t i;
+
+	/* select queue and get its size (fixed by device on legacy interface) */
+	outw(vdev->io_base + VIRTIO_PCI_QUEUE_SEL, index);
+	vq->num = inw(vdev->io_base + VIRTIO_PCI_QUEUE_NUM);
+	if (!vq->num || inl(vdev->io_base + VIRTIO_PCI_QUEUE_PFN))
+		return -ENOENT;
+
+	/* allocate rings (physically contiguous) */
+	size = vring_size(vq->num);
+	for (order = 0; ((uint32_t) PAGE_SIZE << order) < size; order++);
+	rings = get_free_pages(order);
+	if (!rings)
+		return -ENOMEM;
+	memset(rings, 0, PAGE_SIZE << order);
+
+	/* allocate tokens */
+	vq->data = (void **) kmalloc(sizeof(void *) * vq->num);
+	if (!vq->data) {
+		free_pages(rings, order);
+		return -ENOMEM;
+	}
+	memset(vq->data, 0, sizeof(void *) * vq->num);
+
+	/* set rings */
+	vq->vdev = vdev;
+	vq->index = index;
+	vq->order = order;
+	vq->desc = (struct vring_desc *) rings;
+	vq->avail = (struct vring_avail *) (rings + vq->num * sizeof(struct vring_desc));
+	vq->used = (struct vring_used *) (rings + vring_used_offset(vq->num));
+
+	/* chain free descriptors */
+	for (i = 0; i < vq->num - 1; i++)
+		vq->desc[i].next = i + 1;
+	vq->free_head = 0;
+	vq->num_free = vq->num;
+	vq->num_added = 0;
+	vq->last_used_idx = 0;
+
+	/* give rings to device */
+	outl(vdev->io_base + VIRTIO_PCI_QUEUE_PFN, __pa(rings) >> VIRTIO_PCI_QUEUE_ADDR_SHIFT);
+
+	return 0;
+}
+
+/*
+ * Release a virtqueue.
+ */
+void virtio_del_vq(struct virtqueue *vq)
+{
+	/* detach rings from device */
+	outw(vq->vdev->io_base + VIRTIO_PCI_QUEUE_SEL, vq->index);
+	outl(vq->vdev->io_base + VIRTIO_PCI_QUEUE_PFN, 0);
+
+	free_pages(vq->desc, vq->order);
+	kfree(vq->data);
+}
+
+/*
+ * Notify device that buffers are available.
+ */
+void virtio_notify(struct virtqueue *vq)
+{
+	outw(vq->vdev->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
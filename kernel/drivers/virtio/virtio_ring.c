@@ -0,0 +1,92 @@
+#include <drivers/virtio/virtio.h>
+#include <x86/system.h>
+#include <stderr.h>
+
+/*
+ * Add a buffer to a virtqueue (out elements are read by device, in elements are written by device).
+ * Device is not notified until next kick : several buffers can be posted at once.
+ */
+int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sg, int out, int in, void *data)
+{
+	uint16_t head, i;
+	int n = out + in, j;
+
+	/* check number of elements */
+	if (!n)
+		return -EINVAL;
+	if (vq->num_free < n)
+		return -ENOSPC;
+
+	/* fill descriptors from free list (free descriptors are already chained) */
+	head = i = vq->free_head;
+	for (j = 0; j < n; j++) {
+		vq->desc[i].addr = sg[j].addr;
+		vq->desc[i].len = sg[j].len;
+		vq->desc[i].flags = (j < n - 1 ? VRING_DESC_F_NEXT : 0) | (j >= out ? VRING_DESC_F_WRITE : 0);
+		i = vq->desc[i].next;
+	}
+
+	/* update free list */
+	vq->free_head = i;
+	vq->num_free -= n;
+	vq->data[head] = data;
+
+	/* publish descriptors chain (entry must be visible before index) */
+	vq->avail->ring[vq->avail->idx % vq->num] = head;
+	barrier();
+	vq->avail->idx++;
+	vq->num_added++;
+
+	return 0;
+}
+
+/*
+ * Notify device of buffers added since last kick (unless device asked not to be notified).
+ */
+void virtqueue_kick(struct virtqueue *vq)
+{
+	if (!vq->num_added)
+		return;
+
+	/* index update must be visible before reading device flags */
+	vq->num_added = 0;
+	mb();
+
+	if (!(vq->used->flags & VRING_USED_F_NO_NOTIFY))
+		virtio_notify(vq);
+}
+
+/*
+ * Get next buffer used by device (returns its token or NULL).
+ */
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *len)
+{
+	struct vring_used_elem *elem;
+	uint16_t head, i;
+	void *data;
+
+	/* no more used buffer */
+	barrier();
+	if (vq->last_used_idx == vq->used->idx)
+		return NULL;
+
+	/* read element after index */
+	barrier();
+	elem = &vq->used->ring[vq->last_used_idx % vq->num];
+	head = elem->id;
+	if (len)
+		*len = elem->len;
+	vq->last_used_idx++;
+
+	/* get token */
+	data = vq->data[head];
+	vq->data[head] = NULL;
+
+	/* give descriptors chain back to free list */
+	for (i = head, vq->num_free++; vq->desc[i].flags & VRING_DESC_F_NEXT; vq->num_free++)
+		i = vq->desc[i].next;
+	vq->desc[i].next = vq->free_head;
+	vq->free_head = head;
+
+	return data;
+}
@@ -1,4 +1,5 @@
 #include <fs/fs.h>
+#include <mm/paging.h>
 #include <proc/sched.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -49,13 +50,85 @@ int sys_faccessat2(int dirfd, const char *pathname, mode_t mode, int flags)
 }
 
 /*
- * Fadvise system call (ignore this system call).
+ * Fadvise system call.
  */
 int sys_fadvise64(int fd, off_t offset, off_t len, int advice)
 {
-	UNUSED(fd);
-	UNUSED(offset);
-	UNUSED(len);
-	UNUSED(advice);
-	return 0;
+	uint32_t start_index, end_index;
+	struct inode *inode;
+	struct file *filp;
+	off_t end;
+	int ret = 0;
+
+	/* get file */
+	filp = fget(fd);
+	if (!filp)
+		return -EBADF;
+
+	/* get inode */
+	ret = -EINVAL;
+	if (!filp->f_dentry || !filp->f_dentry->d_inode)
+		goto out;
+	inode = filp->f_dentry->d_inode;
+
+	/* pipes and sockets have no page cache */
+	ret = -ESPIPE;
+	if (S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode))
+		goto out;
+
+	/* check arguments */
+	ret = -EINVAL;
+	if (offset < 0 || len < 0)
+		goto out;
+
+	/* compute end offset (len = 0 means end of file) */
+	end = len ? offset + len : inode->i_size;
+	if (end > inode->i_size)
+		end = inode->i_size;
+
+	ret = 0;
+	switch (advice) {
+		case POSIX_FADV_NORMAL:
+			filp->f_ra.flags &= ~(RA_FLAG_RANDOM | RA_FLAG_SEQUENTIAL);
+			break;
+		case POSIX_FADV_RANDOM:
+			filp->f_ra.flags &= ~RA_FLAG_SEQUENTIAL;
+			filp->f_ra.flags |= RA_FLAG_RANDOM;
+			break;
+		case POSIX_FADV_SEQUENTIAL:
+			filp->f_ra.flags &= ~RA_FLAG_RANDOM;
+			filp->f_ra.flags |= RA_FLAG_SEQUENTIAL;
+			break;
+		case POSIX_FADV_WILLNEED:
+			/* empty range */
+			if (offset >= end)
+				break;
+
+			/* read ahead pages */
+			start_index = offset >> PAGE_SHIFT;
+			end_index = (end - 1) >> PAGE_SHIFT;
+			force_page_cache_readahead(inode, start_index, end_index - start_index + 1);
+			break;
+		case POSIX_FADV_DONTNEED:
+			/* start writeback so that dirty pages can be dropped next time */
+			filemap_fdatawrite(inode);
+
+			/* drop only full pages */
+			start_index = (offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
+			end_index = end >> PAGE_SHIFT;
+			if (end == inode->i_size)
+				end_index++;
+			if (end_index > start_index)
+				invalidate_mapping_pages(inode, start_index, end_index - 1);
+			break;
+		case POSIX_FADV_NOREUSE:
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+	}
+
+out:
+	fput(filp);
+	return ret;
 }
@@ -1,6 +1,7 @@
 #include <fs/fs.h>
 #include <drivers/block/blk_dev.h>
 #include <drivers/block/ata.h>
+#include <x86/uaccess.h>
 #include <stderr.h>
 #include <fcntl.h>
 #include <dev.h>
@@ -12,7 +13,7 @@
  */
 int generic_block_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 {
-	size_t blocksize, pos, nr_chars, left;
+	size_t blocksize, pos, nr_chars, left, uncopied = 0;
 	struct buffer_head *bh;
 	off_t size;
 	dev_t dev;
@@ -53,17 +54,25 @@ int generic_block_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 		nr_chars = blocksize - pos <= left ? blocksize - pos : left;
 
 		/* copy into buffer */
-		memcpy(buf, bh->b_data + pos, nr_chars);
+		uncopied = copy_to_user(buf, bh->b_data + pos, nr_chars);
 
 		/* release block */
 		brelse(bh);
 
+		/* bad user buffer */
+		if (uncopied)
+			break;
+
 		/* update sizes */
 		*ppos += nr_chars;
 		buf += nr_chars;
 		left -= nr_chars;
 	}
 
+	/* nothing copied */
+	if (uncopied && left == count)
+		return -EFAULT;
+
 	return count - left;
 }
 
@@ -72,7 +81,7 @@ int generic_block_read(struct file *filp, char *buf, size_t count, off_t *ppos)
  */
 int generic_block_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
 {
-	size_t blocksize, pos, nr_chars, left;
+	size_t blocksize, pos, nr_chars, left, uncopied = 0;
 	struct buffer_head *bh;
 	off_t size;
 	dev_t dev;
@@ -113,17 +122,25 @@ int generic_block_write(struct file *filp, const char *buf, size_t count, off_t
 		nr_chars = blocksize - pos <= left ? blocksize - pos : left;
 
 		/* copy into block buffer */
-		memcpy(bh->b_data + pos, buf, nr_chars);
+		uncopied = copy_from_user(bh->b_data + pos, buf, nr_chars);
 
 		/* release block */
 		mark_buffer_dirty(bh);
 		brelse(bh);
 
+		/* bad user buffer */
+		if (uncopied)
+			break;
+
 		/* update sizes */
 		*ppos += nr_chars;
 		buf += nr_chars;
 		left -= nr_chars;
 	}
 
+	/* nothing copied */
+	if (uncopied && left == count)
+		return -EFAULT;
+
 	return count - left;
 }
\ No newline at end of file
@@ -23,7 +23,6 @@
 #define HASH_BITS			12
 #define HASH_SIZE			(1 << HASH_BITS)
 
-#define BDFLUSH_INTERVAL_MS		5000
 
 /* global buffer table */
 static int nr_buffers = 0;
@@ -47,10 +46,11 @@ void wait_on_buffer(struct buffer_head *bh)
 	if (!buffer_locked(bh))
 		return;
 
+	/* start queued requests */
 	execute_block_requests();
 
-	if (buffer_locked(bh))
-		panic("wait_on_buffer: buffer still locked after execute_block_requests()\n");
+	/* sleep until end of i/o (run pending block work ourself : kinit can't wait for completion thread) */
+	wait_event(&bh->b_wait, (blk_run_pending(), !buffer_locked(bh)));
 }
 
 /*
@@ -78,6 +78,7 @@ void lock_buffer(struct buffer_head *bh)
 void unlock_buffer(struct buffer_head *bh)
 {
 	clear_bit(&bh->b_state, BH_Lock);
+	wake_up(&bh->b_wait);
 }
 
 /*
@@ -102,6 +103,7 @@ void mark_buffer_dirty(struct buffer_head *bh)
 
 	if (!buffer_dirty(bh)) {
 		set_bit(&bh->b_state, BH_Dirty);
+		bh->b_flushtime = jiffies + ms_to_jiffies(sysctl_dirty_expire_centisecs * 10);
 		list_del(&bh->b_list);
 
 		/* keep dirty list sorted */
@@ -253,6 +255,7 @@ static void end_buffer_io_async(struct buffer_head *bh, int uptodate)
 
 	/* free buffers */
 	UnlockPage(page);
+	end_page_writeback(page);
 	kunmap(bh->b_page);
 	free_async_buffers(bh);
 }
@@ -330,6 +333,7 @@ static struct buffer_head *create_buffers(struct page *page, dev_t dev, size_t b
 		bh->b_this_page = head;
 		bh->b_page = page;
 		bh->b_end_io = end_buffer_io_sync;
+		init_waitqueue_head(&bh->b_wait);
 
 		/* set tail and head */
 		if (!head)
@@ -529,9 +533,9 @@ int try_to_free_buffers(struct page *page)
 }
 
 /*
- * Write all dirty buffers on disk.
+ * Write dirty buffers on disk (only expired buffers if all is not set).
  */
-static void sync_buffers(dev_t dev)
+static void sync_buffers(dev_t dev, int all)
 {
 	struct buffer_head *bh, *bhs_list[NBUF];
 	struct list_head *pos, *n;
@@ -544,6 +548,10 @@ static void sync_buffers(dev_t dev)
 		if (!buffer_dirty(bh) || (dev && bh->b_dev != dev))
 			continue;
 
+		/* buffer not expired */
+		if (!all && bh->b_flushtime > jiffies)
+			continue;
+
 		/* write buffers */
 		if (bhs_count == NBUF) {
 			ll_rw_block(WRITE, bhs_count, bhs_list);
@@ -567,8 +575,11 @@ static void sync_buffers(dev_t dev)
  */
 void sync_dev(dev_t dev)
 {
-	sync_buffers(dev);
+	writeback_inodes(dev, nr_dirty_pages, 0);
+	execute_block_requests();
+	sync_buffers(dev, 1);
 	sync_inodes(dev);
+	wait_on_inodes_writeback(dev);
 }
 
 /*
@@ -606,28 +617,58 @@ void set_blocksize(dev_t dev, size_t blocksize)
 		return;
 
  	/* sync buffers */
-	sync_buffers(dev);
+	sync_buffers(dev, 1);
 
 	/* set block size */
 	blksize_size[major(dev)][minor(dev)] = blocksize;
 }
 
 /*
- * Fsync system call (don't do anything because all block buffers should be clean).
+ * Synchronize a file on disk.
+ */
+static int do_fsync(int fd)
+{
+	struct inode *inode;
+	struct file *filp;
+	int ret;
+
+	/* get file */
+	filp = fget(fd);
+	if (!filp)
+		return -EBADF;
+
+	/* get inode */
+	ret = -EINVAL;
+	if (!filp->f_dentry || !filp->f_dentry->d_inode)
+		goto out;
+	inode = filp->f_dentry->d_inode;
+
+	/* write data pages and wait for completion */
+	ret = filemap_write_and_wait(inode);
+
+	/* write inode and device buffers (block maps) */
+	if (test_bit(&inode->i_state, I_DIRTY))
+		write_inode(inode);
+	sync_buffers(inode->i_dev, 1);
+out:
+	fput(filp);
+	return ret;
+}
+
+/*
+ * Fsync system call.
  */
 int sys_fsync(int fd)
 {
-	UNUSED(fd);
-	return 0;
+	return do_fsync(fd);
 }
 
 /*
- * Fdatasync system call (don't do anything because all block buffers should be clean).
+ * Fdatasync system call (metadata needed to retrieve data, like file size, is not tracked apart).
  */
 int sys_fdatasync(int fd)
 {
-	UNUSED(fd);
-	return 0;
+	return do_fsync(fd);
 }
 
 /*
@@ -684,6 +725,15 @@ int brw_page(int rw, struct page *page, dev_t dev, uint32_t *blocks, size_t nr_b
 		next->b_block = *(blocks++);
 		next->b_end_io = end_buffer_io_async;
 
+		/* hole : nothing to write, zero fill on read */
+		if (!next->b_block) {
+			if (rw == READ) {
+				memset(next->b_data, 0, size);
+				mark_buffer_uptodate(next, 1);
+			}
+			continue;
+		}
+
 		/* check if buffer is already hashed */
 		tmp = find_buffer(dev, next->b_block, size);
 		if (tmp) {
@@ -722,6 +772,7 @@ int brw_page(int rw, struct page *page, dev_t dev, uint32_t *blocks, size_t nr_b
 		ll_rw_block(rw, bhs_count, bhs_list);
 	} else {
 		UnlockPage(page);
+		end_page_writeback(page);
 		free_async_buffers(bh);
 		kunmap(page);
 		SetPageUptodate(page);
@@ -753,6 +804,32 @@ int generic_readpage(struct inode *inode, struct page *page)
 	return 0;
 }
 
+/*
+ * Write a page.
+ */
+int generic_writepage(struct inode *inode, struct page *page)
+{
+	uint32_t block, blocks[MAX_BUF_PER_PAGE];
+	size_t nr, i;
+
+	nr = PAGE_SIZE >> inode->i_sb->s_blocksize_bits;
+	block = page->offset >> inode->i_sb->s_blocksize_bits;
+
+	/* map page in kernel address space */
+	if (!kmap(page))
+		return -ENOMEM;
+
+	/* lock page */
+	LockPage(page);
+
+	/* compute blocks (holes are skipped) */
+	for (i = 0; i < nr; i++, block++)
+		blocks[i] = inode->i_op->bmap(inode, block);
+
+	/* write page */
+	return brw_page(WRITE, page, inode->i_dev, blocks, nr, inode->i_sb->s_blocksize);
+}
+
 /*
  * Prepare write = make up to date buffers.
  */
@@ -830,17 +907,16 @@ err:
 }
 
 /*
- * Commit write.
+ * Commit write = mark page dirty (page will be written back later).
  */
 int generic_commit_write(struct inode *inode, struct page *page, uint32_t from, uint32_t to)
 {
-	struct buffer_head *head, *bh, *bhs_list[MAX_BUF_PER_PAGE];
+	struct buffer_head *head, *bh;
 	struct super_block *sb = inode->i_sb;
 	uint32_t start_block, end_block;
-	size_t bhs_count = 0;
 	int partial = 0;
 
-	/* for each block */
+	/* check buffers of this page */
 	for (bh = head = page->buffers, start_block = 0; bh != head || !start_block; start_block = end_block, bh = bh->b_this_page) {
 		end_block = start_block + sb->s_blocksize;
 
@@ -849,42 +925,44 @@ int generic_commit_write(struct inode *inode, struct page *page, uint32_t from,
 			if (!buffer_uptodate(bh))
 				partial = 1;
 		}
-
-		/* block need to be written */
-		bhs_list[bhs_count++] = bh;
-		bh->b_end_io = end_buffer_io_async;
 	}
 
-	/* write buffers on disk or destroy buffers */
-	if (bhs_count) {
-		ll_rw_block(WRITE, bhs_count, bhs_list);
-	} else {
-		UnlockPage(page);
-		free_async_buffers(bh);
-		kunmap(page);
-	}
+	/* destroy buffers */
+	UnlockPage(page);
+	free_async_buffers(head);
+	kunmap(page);
 
 	if (!partial)
 		SetPageUptodate(page);
 
+	/* mark page dirty */
+	set_page_dirty(page);
+
 	return 0;
 }
 
 /*
- * Synchronize data on disk.
+ * Flusher thread = write back old dirty pages, inodes and buffers.
  */
 int bdflush(void *arg)
 {
 	UNUSED(arg);
 
+	/* register flusher */
+	bdflush_task = current_task;
+
 	for (;;) {
-		/* synchronize all buffers and inodes */
+		/* write back dirty pages (by age and dirty ratio) */
 		irq_disable();
-		sync_dev(0);
+		wb_writeback();
+
+		/* write back dirty inodes and expired buffers */
+		sync_inodes(0);
+		sync_buffers(0, 0);
 
 		/* go to sleep */
 		current_task->state = TASK_SLEEPING;
-		schedule_timeout(ms_to_jiffies(BDFLUSH_INTERVAL_MS));
+		schedule_timeout(ms_to_jiffies(sysctl_dirty_writeback_centisecs * 10));
 	}
 
 	return 0;
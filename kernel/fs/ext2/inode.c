@@ -29,6 +29,7 @@ struct inode_operations ext2_file_iops = {
 	.get_block	= ext2_get_block,
 	.bmap		= generic_block_bmap,
 	.readpage	= generic_readpage,
+	.writepage	= generic_writepage,
 	.prepare_write	= generic_prepare_write,
 	.commit_write	= generic_commit_write,
 };
@@ -1,6 +1,7 @@
 #include <fs/fs.h>
 #include <proc/sched.h>
 #include <sys/syscall.h>
+#include <ipc/shm.h>
 #include <stdio.h>
 #include <stderr.h>
 #include <fcntl.h>
@@ -112,6 +113,10 @@ int sys_fcntl(int fd, int cmd, unsigned long arg)
 			if (S_ISSOCK(filp->f_dentry->d_inode->i_mode))
 				ret = sock_fcntl(filp, F_SETOWN, arg);
 			break;
+		case F_ADD_SEALS:
+		case F_GET_SEALS:
+			ret = shm_fcntl(filp, cmd, arg);
+			break;
 		default:
 			printf("unknown fcntl command %d\n", cmd);
 			break;
@@ -78,6 +78,7 @@ struct file *get_empty_filp()
 		return NULL;
 
 	filp_table[i].f_count = 1;
+	memset(&filp_table[i].f_ra, 0, sizeof(struct file_ra_state));
 	return &filp_table[i];
 }
 
@@ -91,6 +91,10 @@ static void remove_from_inode_cache(struct inode *inode)
  */
 void clear_inode(struct inode *inode)
 {
+	/* write back dirty pages of linked inodes */
+	if (inode->i_nrdirty && inode->i_nlinks)
+		filemap_write_and_wait(inode);
+
 	/* truncate inode pages */
 	truncate_inode_pages(inode, 0);
 
@@ -118,7 +122,7 @@ static int __free_inodes()
 		inode = list_entry(pos, struct inode, i_list);
 
 		/* inode still used */
-		if (inode->i_count || inode->i_state)
+		if (inode->i_count || inode->i_state || inode->i_nrdirty)
 			continue;
 
 		/* clear inode */
@@ -207,7 +211,10 @@ found:
 	inode->i_dev = sb->s_dev;
 	inode->i_count = 1;
 	inode->i_mmap = NULL;
-	INIT_LIST_HEAD(&inode->i_pages);
+	INIT_RADIX_TREE(&inode->i_pages);
+	inode->i_nrpages = 0;
+	inode->i_nrdirty = 0;
+	INIT_LIST_HEAD(&inode->i_dirty_list);
 	INIT_LIST_HEAD(&inode->i_dentry);
 
 	/* put inode at the end of LRU list */
@@ -274,7 +281,7 @@ struct inode *iget(struct super_block *sb, ino_t ino)
 /*
  * Write inode on disk.
  */
-static void write_inode(struct inode *inode)
+void write_inode(struct inode *inode)
 {
 	/* write inode */
 	if (inode->i_sb && inode->i_sb->s_op && inode->i_sb->s_op->write_inode)
@@ -304,6 +311,60 @@ void sync_inodes(dev_t dev)
 	}
 }
 
+/*
+ * Wait for writeback of inodes pages.
+ */
+void wait_on_inodes_writeback(dev_t dev)
+{
+	struct list_head *pos;
+	struct inode *inode;
+
+restart:
+	list_for_each(pos, &inode_in_use) {
+		inode = list_entry(pos, struct inode, i_list);
+
+		/* no page under writeback */
+		if ((dev && inode->i_dev != dev) || !radix_tree_tagged(&inode->i_pages, PAGECACHE_TAG_WRITEBACK))
+			continue;
+
+		/* pin inode while sleeping and rescan (inodes list may change meanwhile) */
+		inode->i_count++;
+		filemap_fdatawait(inode);
+		inode->i_count--;
+		goto restart;
+	}
+}
+
+/*
+ * Write back dirty pages of a super block inodes (only inodes dirtied before older_than if set).
+ */
+uint32_t writeback_sb_inodes(struct super_block *sb, uint32_t nr_pages, time_t older_than)
+{
+	uint32_t nr_written = 0, nr_inodes = 0, nr;
+	struct list_head *pos;
+	struct inode *inode;
+
+	/* count dirty inodes (inodes may be requeued on error) */
+	list_for_each(pos, &sb->s_dirty)
+		nr_inodes++;
+
+	while (nr_inodes-- && nr_written < nr_pages && !list_empty(&sb->s_dirty)) {
+		inode = list_first_entry(&sb->s_dirty, struct inode, i_dirty_list);
+
+		/* inodes are sorted by dirtied time */
+		if (older_than && inode->i_dirtied_when > older_than)
+			break;
+
+		/* write inode pages (count only pages actually cleaned : failed pages are dirtied again) */
+		nr = inode->i_nrdirty;
+		filemap_fdatawrite(inode);
+		if (inode->i_nrdirty < nr)
+			nr_written += nr - inode->i_nrdirty;
+	}
+
+	return nr_written;
+}
+
 /*
  * Release an inode.
  */
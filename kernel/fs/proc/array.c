@@ -1,7 +1,9 @@
 #include <fs/proc_fs.h>
 #include <proc/sched.h>
+#include <mm/oom.h>
 #include <drivers/char/tty.h>
 #include <stdio.h>
+#include <string.h>
 #include <dev.h>
 
 /*
@@ -43,7 +45,7 @@ int proc_stat_read(struct task *task, char *page)
 				"%d %d "						/* pgrp, session */
 				"%d "							/* tty */
 				"0 0 "							/* tpgid, flags */
-				"0 0 0 0 "						/* minflt, cminflt, majflt, cmajflt */
+				"%u %u %u %u "						/* minflt, cminflt, majflt, cmajflt */
 				"%ld %ld %ld %ld "					/* utime, stime, cutime, cstime */
 				"0 0 "							/* priority, nice */
 				"0 0 "							/* num_threads, itrealvalue */
@@ -53,6 +55,7 @@ int proc_stat_read(struct task *task, char *page)
 				proc_states[task->state - 1], task->parent ? task->parent->pid : task->pid,
 				task->pgrp, task->session,
 				task->tty ? dev_t_to_nr(task->tty->device) : 0,
+				task->min_flt, task->cmin_flt, task->maj_flt, task->cmaj_flt,
 				task->utime, task->stime, task->cutime, task->cstime,
 				task->start_time,
 				vsize, task->mm ? task->mm->rss : 0
@@ -156,14 +159,47 @@ int proc_status_read(struct task *task, char *page)
 	return page - ori;
 }
 
+/*
+ * Memory statistics of a memory region.
+ */
+struct mem_size_stats {
+	size_t		total;				/* mapped and swapped out pages */
+	size_t		resident;			/* present pages */
+	size_t		shared;				/* present pages with several references */
+	size_t		shared_clean;			/* clean pages mapped several times */
+	size_t		shared_dirty;			/* dirty pages mapped several times */
+	size_t		private_clean;			/* clean pages mapped once */
+	size_t		private_dirty;			/* dirty pages mapped once */
+	size_t		referenced;			/* recently accessed pages */
+	size_t		anonymous;			/* pages not backed by a file */
+	size_t		swap;				/* swapped out pages */
+};
+
+/*
+ * Get number of mappings of a page (page cache, swap cache and samepage merging hold a reference).
+ */
+static int page_mapcount(struct page *page)
+{
+	int count = page->count;
+
+	if (page->inode)
+		count--;
+	if (PageSwapCache(page))
+		count--;
+	if (PageKsm(page))
+		count--;
+
+	return count;
+}
+
 /*
  * Statistics on pages.
  */
-static void statm_pte_range(pmd_t *pmd, uint32_t address, size_t size, size_t *pages, size_t *shared, size_t *total)
+static void statm_pte_range(pmd_t *pmd, uint32_t address, size_t size, struct mem_size_stats *mss)
 {
 	struct page *page;
 	pte_t *ptep, pte;
-	uint32_t end;
+	uint32_t end, n;
 
 	if (pmd_none(*pmd))
 		return;
@@ -177,6 +213,18 @@ static void statm_pte_range(pmd_t *pmd, uint32_t address, size_t size, size_t *p
 	if (end > PMD_SIZE)
 		end = PMD_SIZE;
 
+	/* large page : all pages are present, private, dirty and anonymous */
+	if (pmd_huge(*pmd)) {
+		n = (end - address) >> PAGE_SHIFT;
+		mss->total += n;
+		mss->resident += n;
+		mss->private_dirty += n;
+		mss->anonymous += n;
+		if (*pmd & PAGE_ACCESSED)
+			mss->referenced += n;
+		return;
+	}
+
 	/* for each page table entry */
 	do {
 		pte = *ptep;
@@ -189,10 +237,13 @@ static void statm_pte_range(pmd_t *pmd, uint32_t address, size_t size, size_t *p
 			continue;
 
 		/* update total */
-		*total +=1;
+		mss->total += 1;
 
-		if (!pte_present(pte))
+		/* swapped out page */
+		if (!pte_present(pte)) {
+			mss->swap += 1;
 			continue;
+		}
 
 		/* virtual page */
 		page = pte_page(pte);
@@ -200,24 +251,43 @@ static void statm_pte_range(pmd_t *pmd, uint32_t address, size_t size, size_t *p
 			continue;
 
 		/* update number of present pages */
-		*pages += 1;
+		mss->resident += 1;
 
 		/* update number of shared pages */
 		if (page->count > 1)
-			*shared += 1;
+			mss->shared += 1;
+
+		/* update referenced and anonymous pages */
+		if (pte & PAGE_ACCESSED)
+			mss->referenced += 1;
+		if (!page->inode)
+			mss->anonymous += 1;
+
+		/* update shared/private clean/dirty pages */
+		if (page_mapcount(page) > 1) {
+			if (pte_dirty(pte) || PageDirty(page))
+				mss->shared_dirty += 1;
+			else
+				mss->shared_clean += 1;
+		} else {
+			if (pte_dirty(pte) || PageDirty(page))
+				mss->private_dirty += 1;
+			else
+				mss->private_clean += 1;
+		}
 	} while (address < end);
 }
 
 /*
  * Statistics on pages.
  */
-static void statm_pmd_range(pgd_t *pgd, uint32_t address, size_t size, size_t *pages, size_t *shared, size_t *total)
+static void statm_pmd_range(pgd_t *pgd, uint32_t address, size_t size, struct mem_size_stats *mss)
 {
 	uint32_t end;
 	pmd_t *pmd;
 
 	/* get page table */
-	pmd = pmd_offset(pgd);
+	pmd = pmd_offset(pgd, address);
 
 	/* compute end address */
 	address &= ~PGDIR_MASK;
@@ -227,7 +297,7 @@ static void statm_pmd_range(pgd_t *pgd, uint32_t address, size_t size, size_t *p
 
 	/* for each page table */
 	do {
-		statm_pte_range(pmd, address, end - address, pages, shared, total);
+		statm_pte_range(pmd, address, end - address, mss);
 		address = (address + PMD_SIZE) & PMD_MASK;
 		pmd++;
 	} while (address < end);
@@ -236,11 +306,11 @@ static void statm_pmd_range(pgd_t *pgd, uint32_t address, size_t size, size_t *p
 /*
  * Statistics on pages.
  */
-static void statm_pgd_range(pgd_t *pgd, uint32_t address, uint32_t end, size_t *pages, size_t *shared, size_t *total)
+static void statm_pgd_range(pgd_t *pgd, uint32_t address, uint32_t end, struct mem_size_stats *mss)
 {
 	/* for each page directory */
 	while (address < end) {
-		statm_pmd_range(pgd, address, end - address, pages, shared, total);
+		statm_pmd_range(pgd, address, end - address, mss);
 		address = (address + PGDIR_SIZE) & PGDIR_MASK;
 		pgd++;
 	}
@@ -252,6 +322,7 @@ static void statm_pgd_range(pgd_t *pgd, uint32_t address, uint32_t end, size_t *
 int proc_statm_read(struct task *task, char *page)
 {
 	size_t size = 0, resident = 0, share = 0, text = 0;
+	struct mem_size_stats mss;
 	struct vm_area *vma;
 	pgd_t *pgd;
 
@@ -259,24 +330,57 @@ int proc_statm_read(struct task *task, char *page)
 	if (task->mm) {
 		for (vma = task->mm->mmap; vma != NULL; vma = vma->vm_next) {
 			/* stat pages */
-			size_t pages = 0, shared = 0, total = 0;
-			pgd = pgd_offset(current_task->mm->pgd, vma->vm_start);
-			statm_pgd_range(pgd, vma->vm_start, vma->vm_end, &pages, &shared, &total);
+			memset(&mss, 0, sizeof(struct mem_size_stats));
+			pgd = pgd_offset(task->mm->pgd, vma->vm_start);
+			statm_pgd_range(pgd, vma->vm_start, vma->vm_end, &mss);
 
 			/* update total, resident, shared and dirty pages */
-			size += total;
-			resident += pages;
-			share += shared;
+			size += mss.total;
+			resident += mss.resident;
+			share += mss.shared;
 
 			/* update text, data, stack and library pages */
 			if (vma->vm_flags & VM_EXECUTABLE)
-				text += pages;
+				text += mss.resident;
 		}
 	}
 
 	return snprintf(page, PAGE_SIZE, "%d %d %d %d 0 %d 0\n", size, resident, share, text, size - share);
 }
 
+/*
+ * Print memory statistics of a memory region (used by smaps).
+ */
+int proc_smaps_vma(struct vm_area *vma, char *buf)
+{
+	struct mem_size_stats mss;
+
+	/* stat pages */
+	memset(&mss, 0, sizeof(struct mem_size_stats));
+	statm_pgd_range(pgd_offset(vma->vm_mm->pgd, vma->vm_start), vma->vm_start, vma->vm_end, &mss);
+
+	return sprintf(buf,	"Size:\t%u kB\n"
+				"Rss:\t%u kB\n"
+				"Shared_Clean:\t%u kB\n"
+				"Shared_Dirty:\t%u kB\n"
+				"Private_Clean:\t%u kB\n"
+				"Private_Dirty:\t%u kB\n"
+				"Referenced:\t%u kB\n"
+				"Anonymous:\t%u kB\n"
+				"Swap:\t%u kB\n"
+				"Locked:\t%u kB\n",
+				(vma->vm_end - vma->vm_start) >> 10,
+				mss.resident << (PAGE_SHIFT - 10),
+				mss.shared_clean << (PAGE_SHIFT - 10),
+				mss.shared_dirty << (PAGE_SHIFT - 10),
+				mss.private_clean << (PAGE_SHIFT - 10),
+				mss.private_dirty << (PAGE_SHIFT - 10),
+				mss.referenced << (PAGE_SHIFT - 10),
+				mss.anonymous << (PAGE_SHIFT - 10),
+				mss.swap << (PAGE_SHIFT - 10),
+				(vma->vm_flags & VM_LOCKED) ? mss.resident << (PAGE_SHIFT - 10) : 0);
+}
+
 /*
  * Read process command line.
  */
@@ -382,4 +486,22 @@ int proc_io_read(struct task *task, char *page)
 int proc_comm_read(struct task *task, char *page)
 {
 	return snprintf(page, PAGE_SIZE, "%s\n", task->name);
-}
\ No newline at end of file
+}
+
+/*
+ * Read process out of memory badness.
+ */
+int proc_oom_score_read(struct task *task, char *page)
+{
+	uint32_t totalpages = oom_totalpages();
+
+	return snprintf(page, PAGE_SIZE, "%u\n", oom_badness(task, totalpages) * 1000 / totalpages);
+}
+
+/*
+ * Read process out of memory badness adjustment.
+ */
+int proc_oom_score_adj_read(struct task *task, char *page)
+{
+	return snprintf(page, PAGE_SIZE, "%d\n", task->oom_score_adj);
+}
@@ -1,5 +1,6 @@
 #include <fs/proc_fs.h>
 #include <proc/sched.h>
+#include <mm/oom.h>
 #include <string.h>
 #include <stderr.h>
 #include <fcntl.h>
@@ -10,6 +11,7 @@
 
 #define MAPS_LINE_SHIFT			12
 #define MAPS_LINE_LENGTH		(1 << MAPS_LINE_SHIFT)
+#define SMAPS_STATS_LENGTH		512
 
 #define ARRAY_SIZE(arr)			(sizeof(arr) / sizeof((arr)[0]))
 
@@ -47,6 +49,8 @@ static struct inode_operations proc_self_iops;
 static struct inode_operations proc_base_file_iops;
 static struct inode_operations proc_base_link_iops;
 static struct inode_operations proc_base_maps_iops;
+static struct inode_operations proc_base_smaps_iops;
+static struct inode_operations proc_oom_score_adj_iops;
 static struct inode_operations proc_fd_iops;
 static struct inode_operations proc_task_iops;
 static int proc_root_link(struct task *task, struct dentry **dentry);
@@ -71,7 +75,10 @@ static struct pid_entry pid_base_entries[] = {
 	INF("environ",	S_IRUGO,		proc_environ_read	),
 	INF("io",	S_IRUGO,		proc_io_read		),
 	INF("comm",	S_IRUGO,		proc_comm_read		),
+	INF("oom_score",	S_IRUGO,	proc_oom_score_read	),
+	NOD("oom_score_adj", S_IFREG | S_IRUGO | S_IWUSR, &proc_oom_score_adj_iops, { .proc_read = proc_oom_score_adj_read }),
 	REG("maps",	S_IRUGO,		proc_base_maps_iops	),
+	REG("smaps",	S_IRUGO,		proc_base_smaps_iops	),
 	LNK("root",				proc_root_link		),
 	LNK("cwd",				proc_cwd_link		),
 	LNK("exe",				proc_exe_link		),
@@ -90,7 +97,10 @@ static struct pid_entry tid_base_entries[] = {
 	INF("environ",	S_IRUGO,		proc_environ_read	),
 	INF("io",	S_IRUGO,		proc_io_read		),
 	INF("comm",	S_IRUGO,		proc_comm_read		),
+	INF("oom_score",	S_IRUGO,	proc_oom_score_read	),
+	NOD("oom_score_adj", S_IFREG | S_IRUGO | S_IWUSR, &proc_oom_score_adj_iops, { .proc_read = proc_oom_score_adj_read }),
 	REG("maps",	S_IRUGO,		proc_base_maps_iops	),
+	REG("smaps",	S_IRUGO,		proc_base_smaps_iops	),
 	LNK("root",				proc_root_link		),
 	LNK("cwd",				proc_cwd_link		),
 	LNK("exe",				proc_exe_link		),
@@ -396,12 +406,12 @@ static struct inode_operations proc_self_iops = {
 };
 
 /*
- * Read /<pid>/maps
+ * Read /<pid>/maps or /<pid>/smaps (memory areas followed by their statistics).
  */
-static ssize_t proc_base_maps_read(struct file *filp, char *buf, size_t count, off_t *ppos)
+static ssize_t proc_base_maps_show(struct file *filp, char *buf, size_t count, off_t *ppos, int smaps)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
-	char *page, *line, perms[5], *destptr = buf;
+	char *page, *smaps_page = NULL, *line, perms[5], *destptr = buf;
 	ssize_t column, i = 0, len;
 	size_t j, maxlen = 60;
 	struct vm_area *vma;
@@ -424,6 +434,15 @@ static ssize_t proc_base_maps_read(struct file *filp, char *buf, size_t count, o
 	if (!page)
 		return -ENOMEM;
 
+	/* get a second page for statistics */
+	if (smaps) {
+		smaps_page = get_free_page();
+		if (!smaps_page) {
+			free_page(page);
+			return -ENOMEM;
+		}
+	}
+
 	/* decode file position */
 	lineno = *ppos >> MAPS_LINE_SHIFT;
 	column = *ppos & (MAPS_LINE_LENGTH - 1);
@@ -474,6 +493,18 @@ static ssize_t proc_base_maps_read(struct file *filp, char *buf, size_t count, o
 			line[len++] = '\n';
 		}
 
+		/* append memory statistics (truncate path if needed) */
+		if (smaps) {
+			if (len > MAPS_LINE_LENGTH - SMAPS_STATS_LENGTH) {
+				len = MAPS_LINE_LENGTH - SMAPS_STATS_LENGTH;
+				line[len - 1] = '\n';
+			}
+
+			memcpy(smaps_page, line, len);
+			len += proc_smaps_vma(vma, smaps_page + len);
+			line = smaps_page;
+		}
+
 		/* skip memory area */
 		if (column >= len) {
 			column = 0;
@@ -508,12 +539,30 @@ static ssize_t proc_base_maps_read(struct file *filp, char *buf, size_t count, o
 	/* encode file position */
 	*ppos = (lineno << MAPS_LINE_SHIFT) + column;
 
-	/* free page */
+	/* free pages */
 	free_page(page);
+	if (smaps_page)
+		free_page(smaps_page);
 
 	return destptr - buf;
 }
 
+/*
+ * Read /<pid>/maps
+ */
+static ssize_t proc_base_maps_read(struct file *filp, char *buf, size_t count, off_t *ppos)
+{
+	return proc_base_maps_show(filp, buf, count, ppos, 0);
+}
+
+/*
+ * Read /<pid>/smaps
+ */
+static ssize_t proc_base_smaps_read(struct file *filp, char *buf, size_t count, off_t *ppos)
+{
+	return proc_base_maps_show(filp, buf, count, ppos, 1);
+}
+
 /*
  * Base maps file operations.
  */
@@ -528,6 +577,20 @@ static struct inode_operations proc_base_maps_iops = {
 	.fops			= &proc_base_maps_fops,
 };
 
+/*
+ * Base smaps file operations.
+ */
+static struct file_operations proc_base_smaps_fops = {
+	.read			= proc_base_smaps_read,
+};
+
+/*
+ * Base smaps inode operations.
+ */
+static struct inode_operations proc_base_smaps_iops = {
+	.fops			= &proc_base_smaps_fops,
+};
+
 /*
  * Read base.
  */
@@ -583,6 +646,61 @@ static struct inode_operations proc_base_file_iops = {
 	.fops			= &proc_base_file_fops,
 };
 
+/*
+ * Write out of memory badness adjustment.
+ */
+static int proc_oom_score_adj_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
+{
+	struct task *task;
+	char tmp[16], *end;
+	int val;
+
+	/* get task */
+	task = get_proc_task(filp->f_dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+
+	/* check count */
+	if (!count || count >= sizeof(tmp))
+		return -EINVAL;
+
+	/* parse value */
+	memcpy(tmp, buf, count);
+	tmp[count] = 0;
+	val = simple_strtol(tmp, &end, 0);
+	if (end == tmp || (*end && *end != '\n'))
+		return -EINVAL;
+
+	/* check range */
+	if (val < OOM_SCORE_ADJ_MIN || val > OOM_SCORE_ADJ_MAX)
+		return -EINVAL;
+
+	/* only owner can change it and only root can lower it */
+	if (!suser() && (current_task->euid != task->uid || val < task->oom_score_adj))
+		return -EACCES;
+
+	/* set value */
+	task->oom_score_adj = val;
+	*ppos += count;
+
+	return count;
+}
+
+/*
+ * Out of memory badness adjustment file operations.
+ */
+static struct file_operations proc_oom_score_adj_fops = {
+	.read			= proc_base_read,
+	.write			= proc_oom_score_adj_write,
+};
+
+/*
+ * Out of memory badness adjustment inode operations.
+ */
+static struct inode_operations proc_oom_score_adj_iops = {
+	.fops			= &proc_oom_score_adj_fops,
+};
+
 /*
  * Revalidate a fd inode.
  */
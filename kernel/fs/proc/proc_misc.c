@@ -6,6 +6,8 @@
 #include <x86/cpu.h>
 #include <kernel_stat.h>
 #include <mm/swap.h>
+#include <mm/ksm.h>
+#include <drivers/block/elevator.h>
 #include <string.h>
 #include <stderr.h>
 #include <stdio.h>
@@ -83,25 +85,27 @@ static int meminfo_read_proc(char *page, char **start, off_t off, size_t count,
 	struct sysinfo info;
 	size_t len;
 
-	/* get informations */
-	sys_sysinfo(&info);
+	/* get informations (in pages) */
+	memset(&info, 0, sizeof(struct sysinfo));
+	si_meminfo(&info);
+	si_swapinfo(&info);
 
 	/* print meminfo */
 	len = sprintf(page,
-		"MemTotal:  %d kB\n"
-		"MemFree:   %d kB\n"
-		"MemShared: %d kB\n"
-		"Buffers:   %d kB\n"
-		"Cached:    %d kB\n"
-		"SwapTotal: %d kB\n"
-		"SwapFree:  %d kB\n",
-		info.totalram >> 10,
-		info.freeram >> 10,
-		info.sharedram >> 10,
-		info.bufferram >> 10,
+		"MemTotal:  %u kB\n"
+		"MemFree:   %u kB\n"
+		"MemShared: %u kB\n"
+		"Buffers:   %u kB\n"
+		"Cached:    %u kB\n"
+		"SwapTotal: %u kB\n"
+		"SwapFree:  %u kB\n",
+		info.totalram << (PAGE_SHIFT - 10),
+		info.freeram << (PAGE_SHIFT - 10),
+		info.sharedram << (PAGE_SHIFT - 10),
+		info.bufferram << (PAGE_SHIFT - 10),
 		page_cache_size << (PAGE_SHIFT - 10),
-		info.totalswap >> 10,
-		info.freeswap >> 10);
+		info.totalswap << (PAGE_SHIFT - 10),
+		info.freeswap << (PAGE_SHIFT - 10));
 
 	return proc_calc_metrics(page, start, off, count, eof, len);
 }
@@ -151,6 +155,110 @@ static int kstat_read_proc(char *page, char **start, off_t off, size_t count, in
 	return proc_calc_metrics(page, start, off, count, eof, len);
 }
 
+/*
+ * Read virtual memory statistics.
+ */
+static int vmstat_read_proc(char *page, char **start, off_t off, size_t count, int *eof)
+{
+	uint32_t ksm_pages_shared, ksm_pages_sharing;
+	size_t len;
+
+	/* get samepage merging stats */
+	ksm_get_stats(&ksm_pages_shared, &ksm_pages_sharing);
+
+	/* print stats */
+	len = sprintf(page,	"nr_free_pages %u\n"
+				"nr_file_pages %u\n"
+				"nr_dirty %u\n"
+				"nr_zeroed_pages %u\n"
+				"pswpin %u\n"
+				"pswpout %u\n"
+				"readahead_hit %u\n"
+				"readahead_miss %u\n"
+				"readahead_async %u\n"
+				"readahead_pages %u\n"
+				"pgdirtied %u\n"
+				"pgwriteback %u\n"
+				"dirty_throttle %u\n"
+				"pgfault %u\n"
+				"fault_around %u\n"
+				"fault_around_pages %u\n"
+				"zero_page_hits %u\n"
+				"zeroed_pool_hits %u\n"
+				"zeroed_pool_misses %u\n"
+				"tlb_flush_all %u\n"
+				"tlb_flush_page %u\n"
+				"tlb_switch %u\n"
+				"tlb_switch_skipped %u\n"
+				"tlb_switch_lazy %u\n"
+				"thp_fault_alloc %u\n"
+				"thp_fault_fallback %u\n"
+				"thp_split %u\n"
+				"swap_cluster_alloc %u\n"
+				"swap_ra %u\n"
+				"swap_ra_hit %u\n"
+				"swap_write_batch %u\n"
+				"pginvalidate %u\n"
+				"pgdropbehind %u\n"
+				"alloc_fail %u\n"
+				"oom_kill %u\n"
+				"oom_reaped %u\n"
+				"compact_stall %u\n"
+				"compact_success %u\n"
+				"compact_fail %u\n"
+				"compact_migrated %u\n"
+				"ksm_pages_shared %u\n"
+				"ksm_pages_sharing %u\n"
+				"ksm_merged %u\n"
+				"ksm_full_scans %u\n",
+			nr_free_pages(),
+			page_cache_size,
+			nr_dirty_pages,
+			nr_zeroed_pages,
+			kstat.pswpin,
+			kstat.pswpout,
+			kstat.ra_hits,
+			kstat.ra_misses,
+			kstat.ra_async,
+			kstat.ra_pages,
+			kstat.pgdirtied,
+			kstat.pgwriteback,
+			kstat.dirty_throttle,
+			kstat.pgfault,
+			kstat.fault_around,
+			kstat.fault_around_pages,
+			kstat.zero_page_hits,
+			kstat.zeroed_pool_hits,
+			kstat.zeroed_pool_misses,
+			kstat.tlb_flush_all,
+			kstat.tlb_flush_page,
+			kstat.tlb_switch,
+			kstat.tlb_switch_skipped,
+			kstat.tlb_switch_lazy,
+			kstat.thp_fault_alloc,
+			kstat.thp_fault_fallback,
+			kstat.thp_split,
+			kstat.swap_cluster_alloc,
+			kstat.swap_ra,
+			kstat.swap_ra_hit,
+			kstat.swap_write_batch,
+			kstat.pginvalidate,
+			kstat.pgdropbehind,
+			kstat.alloc_fail,
+			kstat.oom_kill,
+			kstat.oom_reaped,
+			kstat.compact_stall,
+			kstat.compact_success,
+			kstat.compact_fail,
+			kstat.compact_migrated,
+			ksm_pages_shared,
+			ksm_pages_sharing,
+			kstat.ksm_merged,
+			kstat.ksm_full_scans);
+
+	return proc_calc_metrics(page, start, off, count, eof, len);
+}
+
 /*
  * Read uptime.
  */
@@ -234,6 +342,19 @@ static int swaps_read_proc(char *page, char **start, off_t off, size_t count, in
 	return proc_calc_metrics(page, start, off, count, eof, len);
 }
 
+/*
+ * Read i/o schedulers.
+ */
+static int iosched_read_proc(char *page, char **start, off_t off, size_t count, int *eof)
+{
+	size_t len;
+
+	/* get request queues informations */
+	len = elv_get_info(page);
+
+	return proc_calc_metrics(page, start, off, count, eof, len);
+}
+
 /*
  * Init misc proc entries.
  */
@@ -244,10 +365,12 @@ void proc_misc_init()
 	create_proc_read_entry("mounts", 0, NULL, mounts_read_proc);
 	create_proc_read_entry("stat", 0, NULL, kstat_read_proc);
 	create_proc_read_entry("meminfo", 0, NULL, meminfo_read_proc);
+	create_proc_read_entry("vmstat", 0, NULL, vmstat_read_proc);
 	create_proc_read_entry("loadavg", 0, NULL, loadavg_read_proc);
 	create_proc_read_entry("cmdline", 0, NULL, kcmdline_read_proc);
 	create_proc_read_entry("devices", 0, NULL, devices_read_proc);
 	create_proc_read_entry("interrupts", 0, NULL, interrupts_read_proc);
 	create_proc_read_entry("cpuinfo", 0, NULL, cpuinfo_read_proc);
 	create_proc_read_entry("swaps", 0, NULL, swaps_read_proc);
+	create_proc_read_entry("iosched", 0, NULL, iosched_read_proc);
 }
\ No newline at end of file
@@ -10,7 +10,7 @@
  */
 struct proc_dir_entry proc_root = {
 	PROC_ROOT_INO, 5, "/proc", S_IFDIR | S_IRUGO | S_IXUGO, 2, 0, 0, 0,
-	&proc_root_iops, NULL, &proc_root, NULL, NULL
+	&proc_root_iops, NULL, &proc_root, NULL, NULL, NULL
 };
 struct proc_dir_entry *proc_net;
 
@@ -21,6 +21,7 @@ void proc_root_init()
 {
 	proc_misc_init();
 	proc_net = proc_mkdir("net", 0);
+	proc_sys_init();
 }
 
 /*
@@ -0,0 +1,133 @@
+#include <fs/proc_fs.h>
+#include <mm/mm.h>
+#include <stderr.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+/*
+ * Virtual memory tunables.
+ */
+static struct ctl_table vm_table[] = {
+	{ "max_readahead",		&sysctl_max_readahead,			1,	MAX_READ_AHEAD_PAGES },
+	{ "dirty_background_ratio",	&sysctl_dirty_background_ratio,		1,	100 },
+	{ "dirty_ratio",		&sysctl_dirty_ratio,			1,	100 },
+	{ "dirty_expire_centisecs",	&sysctl_dirty_expire_centisecs,		1,	360000 },
+	{ "dirty_writeback_centisecs",	&sysctl_dirty_writeback_centisecs,	1,	360000 },
+	{ "fault_around_pages",		&sysctl_fault_around_pages,		1,	PTRS_PER_PTE },
+	{ "transparent_hugepage",	&sysctl_transparent_hugepage,		0,	1 },
+	{ "page_cluster",		&sysctl_page_cluster,			0,	5 },
+	{ "ksm_run",			&sysctl_ksm_run,			0,	2 },
+	{ "ksm_pages_to_scan",		&sysctl_ksm_pages_to_scan,		1,	10000 },
+	{ "ksm_sleep_millisecs",	&sysctl_ksm_sleep_millisecs,		1,	60000 },
+	{ NULL,				NULL,					0,	0 },
+};
+
+/*
+ * Read a tunable.
+ */
+static int proc_sys_read(struct file *filp, char *buf, size_t count, off_t *ppos)
+{
+	struct proc_dir_entry *de = (struct proc_dir_entry *) filp->f_dentry->d_inode->u.generic_i;
+	struct ctl_table *table = (struct ctl_table *) de->data;
+	char tmp[16];
+	size_t len;
+
+	/* print value */
+	len = sprintf(tmp, "%d\n", *table->data);
+
+	/* end of file */
+	if (*ppos >= len)
+		return 0;
+
+	/* copy to user buffer */
+	len -= *ppos;
+	if (len > count)
+		len = count;
+	memcpy(buf, tmp + *ppos, len);
+	*ppos += len;
+
+	return len;
+}
+
+/*
+ * Write a tunable.
+ */
+static int proc_sys_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
+{
+	struct proc_dir_entry *de = (struct proc_dir_entry *) filp->f_dentry->d_inode->u.generic_i;
+	struct ctl_table *table = (struct ctl_table *) de->data;
+	char tmp[16], *end;
+	int val;
+
+	/* check count */
+	if (!count || count >= sizeof(tmp))
+		return -EINVAL;
+
+	/* parse value */
+	memcpy(tmp, buf, count);
+	tmp[count] = 0;
+	val = simple_strtol(tmp, &end, 0);
+	if (end == tmp || (*end && *end != '\n'))
+		return -EINVAL;
+
+	/* check range */
+	if (val < table->minval || val > table->maxval)
+		return -EINVAL;
+
+	/* set value */
+	*table->data = val;
+	*ppos += count;
+
+	return count;
+}
+
+/*
+ * Tunable file operations.
+ */
+static struct file_operations proc_sys_fops = {
+	.read			= proc_sys_read,
+	.write			= proc_sys_write,
+};
+
+/*
+ * Tunable inode operations.
+ */
+static struct inode_operations proc_sys_iops = {
+	.fops			= &proc_sys_fops,
+};
+
+/*
+ * Register a tunables table.
+ */
+static void proc_sys_register(struct proc_dir_entry *dir, struct ctl_table *table)
+{
+	struct proc_dir_entry *de;
+
+	for (; table->procname; table++) {
+		de = create_proc_entry(table->procname, S_IFREG | S_IRUGO | S_IWUSR, dir);
+		if (!de)
+			continue;
+
+		de->ops = &proc_sys_iops;
+		de->data = table;
+	}
+}
+
+/*
+ * Init /proc/sys entries.
+ */
+void proc_sys_init()
+{
+	struct proc_dir_entry *sys, *vm;
+
+	/* create directories */
+	sys = proc_mkdir("sys", NULL);
+	if (!sys)
+		return;
+	vm = proc_mkdir("vm", sys);
+	if (!vm)
+		return;
+
+	/* register tunables */
+	proc_sys_register(vm, vm_table);
+}
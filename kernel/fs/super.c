@@ -381,6 +381,31 @@ struct super_block *get_super(dev_t dev)
 	return NULL;
 }
 
+/*
+ * Write back dirty pages of all super blocks (or of device dev).
+ */
+uint32_t writeback_inodes(dev_t dev, uint32_t nr_pages, time_t older_than)
+{
+	uint32_t nr_written = 0;
+	struct super_block *sb;
+	struct list_head *pos;
+
+	list_for_each(pos, &super_blocks) {
+		sb = list_entry(pos, struct super_block, s_list);
+
+		/* unused super block or other device */
+		if (!sb->s_dev || (dev && sb->s_dev != dev))
+			continue;
+
+		/* write back super block inodes */
+		nr_written += writeback_sb_inodes(sb, nr_pages - nr_written, older_than);
+		if (nr_written >= nr_pages)
+			break;
+	}
+
+	return nr_written;
+}
+
 /*
  * Read a super block.
  */
@@ -412,6 +437,7 @@ static struct super_block *read_super(dev_t dev, const char *dev_name, const cha
 	sb->s_dev = dev;
 	sb->s_flags = flags;
 	sb->s_type = fs;
+	INIT_LIST_HEAD(&sb->s_dirty);
 
 	/* read super block */
 	if (!fs->read_super(sb, dev_name, data, silent)) {
@@ -1,5 +1,6 @@
 #include <fs/tmp_fs.h>
 #include <mm/highmem.h>
+#include <x86/uaccess.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stderr.h>
@@ -9,7 +10,7 @@
  */
 int tmpfs_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 {
-	size_t page_offset, offset, nr_chars, left;
+	size_t page_offset, offset, nr_chars, left, uncopied = 0;
 	struct list_head *pos;
 	struct page *page;
 	void *kaddr;
@@ -41,10 +42,20 @@ int tmpfs_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 		if (nr_chars > left)
 			nr_chars = left;
 
-		/* copy data */
-		kaddr = kmap(page);
-		memcpy(buf, kaddr + offset, nr_chars);
-		kunmap(page);
+		/* copy data (user page taken away meanwhile : copy again with a sleeping mapping) */
+		fault_in_pages(buf, nr_chars, 1);
+		kaddr = kmap_atomic(page, KM_USER_COPY);
+		uncopied = copy_to_user_inatomic(buf, kaddr + offset, nr_chars);
+		kunmap_atomic(kaddr, KM_USER_COPY);
+		if (uncopied) {
+			kaddr = kmap(page);
+			uncopied = copy_to_user(buf, kaddr + offset, nr_chars);
+			kunmap(page);
+		}
+
+		/* bad user buffer */
+		if (uncopied)
+			break;
 
 		/* update sizes */
 		*ppos += nr_chars;
@@ -57,6 +68,10 @@ int tmpfs_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 			break;
 	}
 
+	/* nothing copied */
+	if (uncopied && left == count)
+		return -EFAULT;
+
 	return count - left;
 }
 
@@ -65,7 +80,7 @@ int tmpfs_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
  */
 int tmpfs_file_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
 {
-	size_t page_offset, left, offset, nr_chars;
+	size_t page_offset, left, offset, nr_chars, uncopied = 0;
 	struct list_head *pos;
 	struct page *page;
 	void *kaddr;
@@ -97,10 +112,20 @@ int tmpfs_file_write(struct file *filp, const char *buf, size_t count, off_t *pp
 		if (nr_chars > left)
 			nr_chars = left;
 
-		/* copy data */
-		kaddr = kmap(page);
-		memcpy(kaddr + offset, buf, nr_chars);
-		kunmap(page);
+		/* copy data (user page taken away meanwhile : copy again with a sleeping mapping) */
+		fault_in_pages(buf, nr_chars, 0);
+		kaddr = kmap_atomic(page, KM_USER_COPY);
+		uncopied = copy_from_user_inatomic(kaddr + offset, buf, nr_chars);
+		kunmap_atomic(kaddr, KM_USER_COPY);
+		if (uncopied) {
+			kaddr = kmap(page);
+			uncopied = copy_from_user(kaddr + offset, buf, nr_chars);
+			kunmap(page);
+		}
+
+		/* bad user buffer */
+		if (uncopied)
+			break;
 
 		/* update sizes */
 		*ppos += nr_chars;
@@ -113,6 +138,10 @@ int tmpfs_file_write(struct file *filp, const char *buf, size_t count, off_t *pp
 			break;
 	}
 
+	/* nothing copied */
+	if (uncopied && left == count)
+		return -EFAULT;
+
 	return count - left;
 }
 
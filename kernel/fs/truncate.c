@@ -1,5 +1,6 @@
 #include <fs/fs.h>
 #include <proc/sched.h>
+#include <ipc/shm.h>
 #include <stderr.h>
 #include <fcntl.h>
 
@@ -15,6 +16,11 @@ int do_truncate(struct inode *inode, off_t length)
 	if (ret)
 		return ret;
 
+	/* check memfd seals */
+	ret = shm_check_size(inode, length);
+	if (ret)
+		return ret;
+
 	/* set new size */
 	inode->i_size = length;
 
@@ -7,9 +7,12 @@
 #define DEV_TTY_MAJOR		4		/* tty major number */
 #define DEV_TTYAUX_MAJOR	5		/* auxiliary tty major number */
 #define DEV_LOOP_MAJOR		7		/* loop major number */
+#define DEV_AHCI_MAJOR		8		/* ahci (sata disks) major number */
 #define DEV_MOUSE_MAJOR		13		/* mouse major number */
 #define DEV_FB_MAJOR		29		/* frame buffer major number */
 #define DEV_PTS_MAJOR		136		/* pty major number */
+#define DEV_ZRAM_MAJOR		252		/* compressed ram disk major number */
+#define DEV_VIRTIO_BLK_MAJOR	254		/* virtio disk major number */
 
 #define MAX_CHRDEV		255
 #define MAX_BLKDEV		255
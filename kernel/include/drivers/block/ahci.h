@@ -0,0 +1,170 @@
+#ifndef _AHCI_H_
+#define _AHCI_H_
+
+#include <drivers/block/ata.h>
+#include <drivers/block/genhd.h>
+#include <drivers/block/blk_dev.h>
+#include <fs/fs.h>
+#include <stddef.h>
+
+#define NR_AHCI_DEVICES			8
+#define NR_AHCI_PORTS			32
+#define NR_AHCI_SLOTS			32
+
+#define AHCI_VENDOR_ID			0x8086
+#define AHCI_DEVICE_ID			0x2922		/* ICH9 (QEMU q35) */
+#define AHCI_ABAR_SIZE			0x1100		/* generic host control + 32 ports */
+
+/* HBA registers */
+#define AHCI_REG_CAP			0x00
+#define AHCI_REG_GHC			0x04
+#define AHCI_REG_IS			0x08
+#define AHCI_REG_PI			0x0C
+#define AHCI_REG_VS			0x10
+
+/* HBA capabilities */
+#define AHCI_CAP_NCS(cap)		((((cap) >> 8) & 0x1F) + 1)	/* number of command slots */
+#define AHCI_CAP_SNCQ			(1 << 30)			/* native command queuing */
+#define AHCI_CAP_S64A			(1 << 31)			/* 64 bits addressing */
+
+/* HBA global control */
+#define AHCI_GHC_IE			(1 << 1)
+#define AHCI_GHC_AE			(1 << 31)
+
+/* port registers */
+#define AHCI_PORT_BASE(port)		(0x100 + (port) * 0x80)
+#define AHCI_PREG_CLB			0x00
+#define AHCI_PREG_CLBU			0x04
+#define AHCI_PREG_FB			0x08
+#define AHCI_PREG_FBU			0x0C
+#define AHCI_PREG_IS			0x10
+#define AHCI_PREG_IE			0x14
+#define AHCI_PREG_CMD			0x18
+#define AHCI_PREG_TFD			0x20
+#define AHCI_PREG_SIG			0x24
+#define AHCI_PREG_SSTS			0x28
+#define AHCI_PREG_SERR			0x30
+#define AHCI_PREG_SACT			0x34
+#define AHCI_PREG_CI			0x38
+
+/* port command */
+#define AHCI_PCMD_ST			(1 << 0)
+#define AHCI_PCMD_SUD			(1 << 1)
+#define AHCI_PCMD_POD			(1 << 2)
+#define AHCI_PCMD_FRE			(1 << 4)
+#define AHCI_PCMD_FR			(1 << 14)
+#define AHCI_PCMD_CR			(1 << 15)
+
+/* port interrupts */
+#define AHCI_PIS_DHRS			(1 << 0)	/* device to host register FIS */
+#define AHCI_PIS_PSS			(1 << 1)	/* PIO setup FIS */
+#define AHCI_PIS_DSS			(1 << 2)	/* DMA setup FIS */
+#define AHCI_PIS_SDBS			(1 << 3)	/* set device bits FIS (queued commands completion) */
+#define AHCI_PIS_IFS			(1 << 27)	/* interface fatal error */
+#define AHCI_PIS_HBDS			(1 << 28)	/* host bus data error */
+#define AHCI_PIS_HBFS			(1 << 29)	/* host bus fatal error */
+#define AHCI_PIS_TFES			(1 << 30)	/* task file error */
+#define AHCI_PIS_ERRORS			(AHCI_PIS_IFS | AHCI_PIS_HBDS | AHCI_PIS_HBFS | AHCI_PIS_TFES)
+
+/* port status */
+#define AHCI_SSTS_DET_MASK		0x0F
+#define AHCI_SSTS_DET_PRESENT		0x03		/* device present and communication established */
+#define AHCI_SIG_ATA			0x00000101
+
+/* FIS */
+#define AHCI_FIS_TYPE_REG_H2D		0x27
+#define AHCI_FIS_H2D_CMD		0x80
+#define AHCI_FIS_DEV_LBA		0x40
+
+/* command header */
+#define AHCI_CMD_FIS_LEN		(sizeof(struct ahci_fis_h2d) / sizeof(uint32_t))
+#define AHCI_CMD_WRITE			(1 << 6)
+#define AHCI_CMD_PRDTL_SHIFT		16
+
+/* command table = FIS and PRDT (one page per command slot) */
+#define AHCI_PRD_MAX_BYTES		0x400000	/* a PRD entry transfers at most 4 MB */
+#define AHCI_CMD_TABLE_PRDT		0x80
+#define NR_AHCI_PRD_ENTRIES		((PAGE_SIZE - AHCI_CMD_TABLE_PRDT) / sizeof(struct ahci_prd))
+
+/* per port memory = command list (1 KB aligned) and received FIS (256 bytes aligned) */
+#define AHCI_CMD_LIST_SIZE		(NR_AHCI_SLOTS * sizeof(struct ahci_cmd_header))
+#define AHCI_RX_FIS_SIZE		256
+
+/*
+ * AHCI Host to Device register FIS.
+ */
+struct ahci_fis_h2d {
+	uint8_t			type;
+	uint8_t			flags;
+	uint8_t			command;
+	uint8_t			features;
+	uint8_t			lba0;
+	uint8_t			lba1;
+	uint8_t			lba2;
+	uint8_t			device;
+	uint8_t			lba3;
+	uint8_t			lba4;
+	uint8_t			lba5;
+	uint8_t			features_exp;
+	uint8_t			count;
+	uint8_t			count_exp;
+	uint8_t			icc;
+	uint8_t			control;
+	uint32_t		reserved;
+} __attribute__((packed));
+
+/*
+ * AHCI command header (command list entry).
+ */
+struct ahci_cmd_header {
+	uint32_t		flags;			/* FIS length, direction and PRDT length */
+	uint32_t		prdbc;			/* transferred bytes */
+	uint32_t		ctba;			/* command table address */
+	uint32_t		ctbau;
+	uint32_t		reserved[4];
+} __attribute__((packed));
+
+/*
+ * AHCI Physical Region Descriptor entry.
+ */
+struct ahci_prd {
+	uint32_t		dba;			/* buffer address */
+	uint32_t		dbau;
+	uint32_t		reserved;
+	uint32_t		dbc;			/* bytes count - 1 */
+} __attribute__((packed));
+
+/*
+ * AHCI command slot.
+ */
+struct ahci_slot {
+	void *			cmd_table;		/* FIS and PRDT */
+	struct request *	request;		/* request in progress */
+	uint32_t		rq_sector;		/* next sector to transfer */
+	struct buffer_head *	rq_bh;			/* next buffer to transfer */
+	uint32_t		nr_sectors;		/* sectors of running command */
+	void *			bounce;			/* bounce page (32 bits controller) */
+	struct buffer_head *	bounce_bh;		/* buffer bounced by running command */
+};
+
+/*
+ * AHCI device (one disk per port).
+ */
+struct ahci_device {
+	int			id;
+	int			port;
+	uint32_t		port_base;		/* port registers */
+	struct ata_identify	identify;
+	char			ncq;			/* native command queuing used */
+	int			nr_slots;		/* queue depth */
+	uint32_t		slots_active;		/* commands in flight */
+	struct ahci_cmd_header *	cmd_list;
+	void *			rx_fis;
+	struct ahci_slot	slots[NR_AHCI_SLOTS];
+	struct gendisk		hd;
+	struct request_queue	queue;
+};
+
+int init_ahci();
+
+#endif
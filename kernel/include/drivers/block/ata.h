@@ -2,6 +2,7 @@
 #define _ATA_H_
 
 #include <drivers/block/genhd.h>
+#include <drivers/block/blk_dev.h>
 #include <fs/fs.h>
 #include <stddef.h>
 
@@ -40,6 +41,8 @@
 #define ATA_CMD_WRITE_PIO_EXT		0x34
 #define ATA_CMD_WRITE_DMA		0xCA
 #define ATA_CMD_WRITE_DMA_EXT		0x35
+#define ATA_CMD_READ_FPDMA_QUEUED	0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED	0x61
 #define ATA_CMD_CACHE_FLUSH		0xE7
 #define ATA_CMD_CACHE_FLUSH_EXT		0xEA
 #define ATA_CMD_PACKET			0xA0
@@ -66,6 +69,27 @@
 #define ATA_ER_TK0NF			0x02
 #define ATA_ER_AMNF			0x01
 
+/* ATA Bus Master registers */
+#define ATA_BM_REG_COMMAND		0x00
+#define ATA_BM_REG_STATUS		0x02
+#define ATA_BM_REG_PRDT			0x04
+#define ATA_BM_SECONDARY		0x08
+
+/* ATA Bus Master Command/Status Register */
+#define ATA_BM_CMD_START		0x01
+#define ATA_BM_CMD_READ			0x08
+#define ATA_BM_SR_ERR			0x02
+#define ATA_BM_SR_IRQ			0x04
+
+/* ATA identification command sets */
+#define ATA_CMDSET_LBA48		(1 << 10)	/* in command_sets[1] */
+#define ATA_SATA_CAP_NCQ		(1 << 8)	/* in sata_capabilities */
+#define ATA_QUEUE_DEPTH_MASK		0x1F		/* in queue_depth (maximum depth - 1) */
+
+/* ATA commands limits */
+#define ATA_LBA28_MAX_SECTORS		256
+#define ATA_LBA48_MAX_SECTORS		65536
+
 #define ATA_VENDOR_ID			0x8086
 #define ATA_DEVICE_ID			0x7010
 
@@ -87,13 +111,18 @@ struct ata_identify {
 	uint16_t			unused5[5];
 	uint16_t			size_of_rw_mult;
 	uint32_t			sectors_28;
-	uint16_t			unused6[38];
+	uint16_t			unused6[13];
+	uint16_t			queue_depth;
+	uint16_t			sata_capabilities;
+	uint16_t			unused9[5];
+	uint16_t			command_sets[2];
+	uint16_t			unused8[16];
 	uint64_t			sectors_48;
 	uint16_t			unused7[152];
 } __attribute__((packed));
 
 /*
- * ATA Physical Region Descriptor Table.
+ * ATA Physical Region Descriptor Table entry.
  */
 struct ata_prdt {
 	uint32_t		buffer_phys;
@@ -111,13 +140,22 @@ struct ata_device {
 	uint16_t		io_base;
 	struct ata_identify	identify;
 	char			is_atapi;
+	char			lba48;			/* 48 bits addressing supported */
 	size_t			sector_size;
 	struct gendisk		hd;
 	struct ata_prdt *	prdt;
 	uint8_t *		buf;
 	uint32_t		bar4;
+	struct request *	request;		/* request in progress (DMA) */
+	uint32_t		rq_sector;		/* next sector to transfer */
+	uint32_t		rq_nr_sectors;		/* remaining sectors to transfer */
+	struct buffer_head *	rq_bh;			/* next buffer to transfer */
+	struct buffer_head *	bounce_bh;		/* buffer transfered through device buffer */
+	uint32_t		dma_sectors;		/* sectors of running DMA transfer */
 	int			(*read)(struct ata_device *, uint32_t, size_t, char *);
 	int			(*write)(struct ata_device *, uint32_t, size_t, char *);
+	int			(*start_dma)(struct ata_device *);
+	int			(*end_dma)(struct ata_device *);
 };
 
 /* init functions */
@@ -1,6 +1,7 @@
 #ifndef _BLK_DEV_H_
 #define _BLK_DEV_H_
 
+#include <drivers/block/elevator.h>
 #include <fs/fs.h>
 #include <ioctl.h>
 #include <dev.h>
@@ -15,6 +16,8 @@
 #define BLKBSZGET		_IOR(0x12, 112, sizeof(int))
 #define BLKBSZSET		_IOW(0x12, 113, sizeof(int))
 #define BLKGETSIZE64		_IOR(0x12, 114, sizeof(uint64_t))
+#define BLKELVGET		_IOR(0x12, 106, sizeof(int))
+#define BLKELVSET		_IOW(0x12, 107, sizeof(int))
 
 /*
  * Block device request.
@@ -26,16 +29,21 @@ struct request {
 	uint32_t		sector;
 	uint32_t		nr_sectors;
 	char *			buf;
+	time_t			deadline;		/* dispatch deadline (deadline scheduler) */
 	struct list_head	bhs_list;
-	struct request *	next;
+	struct list_head	queuelist;		/* next request in queue (or in free list) */
+	struct list_head	fifo;			/* next request by arrival */
 };
 
 /*
  * Block device.
  */
 struct blk_dev {
-	struct request *	current_request;
+	struct request_queue	queue;			/* default queue */
+	struct request_queue *	(*get_queue)(dev_t);	/* per device queues */
 	void 			(*request)();
+	int			scatter_gather;		/* request buffers don't need to be contiguous */
+	void			(*swap_slot_free_notify)(dev_t, uint32_t);
 };
 
 /* Block devices */
@@ -45,9 +53,15 @@ extern size_t *blksize_size[MAX_BLKDEV];
 
 int is_read_only(dev_t dev);
 void set_device_ro(dev_t dev, int flag);
+struct request_queue *blk_get_queue(dev_t dev);
+int blk_elv_ioctl(dev_t dev, int request, unsigned long arg);
 void ll_rw_block(int rw, size_t nr_bhs, struct buffer_head *bhs[]);
 void execute_block_requests();
 void end_request(struct request *req);
+void blk_run_completions();
+void blk_run_pending();
+void kblockd_schedule();
+int kblockd(void *arg);
 void init_blk_dev();
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef _ELEVATOR_H_
+#define _ELEVATOR_H_
+
+#include <lib/list.h>
+#include <stddef.h>
+
+#define ELEVATOR_NOOP			0		/* fifo order */
+#define ELEVATOR_DEADLINE		1		/* sector order, with read/write batches and deadlines */
+#define NR_ELEVATORS			2
+
+#define ELV_MAX_SECTORS			1024		/* default maximum request size (merges) */
+
+#define DEADLINE_READ_EXPIRE		(HZ / 2)	/* read requests deadline */
+#define DEADLINE_WRITE_EXPIRE		(5 * HZ)	/* write requests deadline */
+#define DEADLINE_FIFO_BATCH		16		/* requests dispatched in sector order before checking deadlines */
+#define DEADLINE_WRITES_STARVED		2		/* read batches before a write batch */
+
+struct request;
+struct buffer_head;
+
+/*
+ * Request queue.
+ */
+struct request_queue {
+	const char *		name;				/* queue name */
+	int			elevator;			/* scheduler */
+	uint32_t		max_sectors;			/* maximum request size (merges) */
+	struct list_head	queue_head;			/* queued requests (deadline : sorted by sector) */
+	struct list_head	fifo[2];			/* queued requests by arrival (reads, writes) */
+	dev_t			head_dev;			/* device of last dispatched request */
+	uint32_t		head_sector;			/* sector following last dispatched request */
+	int			batch_dir;			/* direction of current batch */
+	int			batch_count;			/* requests dispatched in current batch */
+	int			starved;			/* read batches while writes are pending */
+	uint32_t		nr_queued;			/* number of queued requests */
+	uint32_t		nr_dispatched;			/* number of dispatched requests */
+	uint32_t		nr_back_merges;			/* buffers merged at end of a request */
+	uint32_t		nr_front_merges;		/* buffers merged at start of a request */
+	uint32_t		nr_expired;			/* requests dispatched because of their deadline */
+	struct list_head	list;				/* next queue */
+};
+
+void elv_init_queue(struct request_queue *q, const char *name, int elevator);
+int elv_set_elevator(struct request_queue *q, int elevator);
+int elv_merge(struct request_queue *q, int rw, struct buffer_head *bh, int scatter_gather);
+void elv_add_request(struct request_queue *q, struct request *req);
+struct request *elv_next_request(struct request_queue *q);
+size_t elv_get_info(char *page);
+
+/*
+ * Check if a queue is empty.
+ */
+static inline int elv_queue_empty(struct request_queue *q)
+{
+	return list_empty(&q->queue_head);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _VIRTIO_BLK_H_
+#define _VIRTIO_BLK_H_
+
+#include <drivers/virtio/virtio.h>
+#include <drivers/block/genhd.h>
+#include <drivers/block/blk_dev.h>
+#include <fs/fs.h>
+#include <stddef.h>
+
+#define NR_VIRTIO_BLK_DEVICES		4
+#define NR_VIRTIO_BLK_SLOTS		16		/* requests in flight per disk */
+#define VIRTIO_BLK_MAX_SEGS		64		/* data segments per command */
+#define VIRTIO_BLK_MAX_SECTORS		65536		/* request size (a request spans several commands if needed) */
+
+#define VIRTIO_BLK_DEVICE_ID		0x1001		/* legacy (transitional) block device */
+#define VIRTIO_BLK_SECTOR_SIZE		512
+
+/* features */
+#define VIRTIO_BLK_F_SIZE_MAX		1		/* maximum segment size */
+#define VIRTIO_BLK_F_SEG_MAX		2		/* maximum number of segments */
+#define VIRTIO_BLK_F_RO			5		/* read only disk */
+
+/* device configuration */
+#define VIRTIO_BLK_CONFIG_CAPACITY	0x00
+#define VIRTIO_BLK_CONFIG_SIZE_MAX	0x08
+#define VIRTIO_BLK_CONFIG_SEG_MAX	0x0C
+
+/* request types and status */
+#define VIRTIO_BLK_T_IN			0
+#define VIRTIO_BLK_T_OUT		1
+#define VIRTIO_BLK_S_OK			0
+
+/*
+ * Virtio block request header.
+ */
+struct virtio_blk_outhdr {
+	uint32_t		type;
+	uint32_t		ioprio;
+	uint64_t		sector;
+} __attribute__((packed));
+
+/*
+ * Virtio block command slot (header and status are read/written by device).
+ */
+struct virtio_blk_slot {
+	struct virtio_blk_outhdr hdr;
+	uint8_t			status;
+	struct request *	request;		/* request in progress */
+	uint32_t		rq_sector;		/* next sector to transfer */
+	struct buffer_head *	rq_bh;			/* next buffer to transfer */
+	uint32_t		nr_sectors;		/* sectors of running command */
+};
+
+/*
+ * Virtio block device.
+ */
+struct virtio_blk_device {
+	int			id;
+	struct virtio_device	vdev;
+	struct virtqueue	vq;
+	uint32_t		capacity;		/* number of sectors */
+	uint32_t		max_segs;		/* data segments per command */
+	uint32_t		size_max;		/* maximum segment size */
+	int			nr_slots;
+	uint32_t		slots_active;		/* commands in flight */
+	struct virtio_blk_slot *slots;
+	struct gendisk		hd;
+	struct request_queue	queue;
+};
+
+int init_virtio_blk();
+
+#endif
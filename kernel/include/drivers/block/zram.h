@@ -0,0 +1,84 @@
+#ifndef _ZRAM_H_
+#define _ZRAM_H_
+
+#include <fs/fs.h>
+#include <lib/list.h>
+
+#define MAX_ZRAM		1
+#define ZRAM_MAX_PAGES		32768			/* maximum device size (in pages) */
+#define ZRAM_HASH_SIZE		1024			/* compressed pages hash table size */
+
+#define ZS_ALIGN		32			/* size classes granularity */
+#define ZS_MAX_SIZE		(PAGE_SIZE * 3 / 4)	/* bigger pages are stored uncompressed */
+#define ZS_NR_CLASSES		(ZS_MAX_SIZE / ZS_ALIGN)
+
+/* slot flags */
+#define ZRAM_SAME		0x01			/* page filled with a single word */
+#define ZRAM_HUGE		0x02			/* incompressible page stored as is */
+#define ZRAM_COMPRESSED		0x04			/* compressed page */
+
+/*
+ * Compressed page (stored in pool, shared by identical pages).
+ */
+struct zram_entry {
+	struct list_head	hash;
+	uint32_t		checksum;
+	uint32_t		refcount;
+	uint16_t		len;
+};
+
+/*
+ * Device page slot.
+ */
+struct zram_slot {
+	uint32_t		flags;
+	union {
+		struct zram_entry *	entry;
+		void *			page;
+		uint32_t		value;
+	} u;
+};
+
+/*
+ * Pool size class.
+ */
+struct zs_class {
+	size_t			size;
+	size_t			objs_per_page;
+	struct list_head	partial_pages;
+};
+
+/*
+ * Pool page descriptor (stored at the beginning of each pool page).
+ */
+struct zs_page {
+	struct zs_class *	class;
+	size_t			nr_free;
+	void *			free_objs;
+	struct list_head	list;
+};
+
+/*
+ * Compressed ram device.
+ */
+struct zram {
+	uint32_t		nr_pages;
+	struct zram_slot *	slots;
+	struct list_head	hash[ZRAM_HASH_SIZE];
+	struct zs_class		classes[ZS_NR_CLASSES];
+	uint32_t		pool_pages;
+	uint32_t		huge_pages;
+	uint32_t		same_pages;
+	uint32_t		zero_pages;
+	uint32_t		dedup_pages;
+	uint32_t		pages_stored;
+	uint32_t		compr_data_size;
+	uint32_t		num_reads;
+	uint32_t		num_writes;
+	uint32_t		failed_writes;
+	uint32_t		notify_free;
+};
+
+int init_zram();
+
+#endif
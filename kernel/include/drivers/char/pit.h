@@ -5,5 +5,6 @@
 
 void init_pit();
 void update_times();
+uint32_t cycles_to_usecs(uint64_t cycles);
 
 #endif
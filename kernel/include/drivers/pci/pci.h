@@ -11,7 +11,9 @@
 #define PCI_STATUS			0x06
 #define PCI_BAR0			0x10
 #define PCI_BAR4			0x20
+#define PCI_BAR5			0x24
 
+#define PCI_CMD_REG_MEMORY_SPACE	(1 << 1)
 #define PCI_CMD_REG_BUS_MASTER		(1 << 2)
 #define PCI_INTERRUPT_LINE		0x3C
 
@@ -29,6 +31,7 @@ struct pci_device {
 
 void init_pci();
 struct pci_device *pci_get_device(uint32_t vendor_id, uint32_t device_id);
+struct pci_device *pci_find_device(uint32_t vendor_id, uint32_t device_id, struct pci_device *from);
 uint32_t pci_read_field(uint32_t address, uint8_t offset);
 void pci_write_field(uint32_t address, uint8_t offset, uint32_t value);
 
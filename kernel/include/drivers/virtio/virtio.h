@@ -0,0 +1,140 @@
+#ifndef _VIRTIO_H_
+#define _VIRTIO_H_
+
+#include <drivers/pci/pci.h>
+#include <stddef.h>
+
+#define VIRTIO_VENDOR_ID		0x1AF4
+
+/* legacy PCI registers (I/O space, BAR0) */
+#define VIRTIO_PCI_HOST_FEATURES	0x00
+#define VIRTIO_PCI_GUEST_FEATURES	0x04
+#define VIRTIO_PCI_QUEUE_PFN		0x08
+#define VIRTIO_PCI_QUEUE_NUM		0x0C
+#define VIRTIO_PCI_QUEUE_SEL		0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY		0x10
+#define VIRTIO_PCI_STATUS		0x12
+#define VIRTIO_PCI_ISR			0x13
+#define VIRTIO_PCI_CONFIG		0x14		/* device configuration (no MSI-X) */
+
+/* device status */
+#define VIRTIO_STATUS_ACKNOWLEDGE	0x01
+#define VIRTIO_STATUS_DRIVER		0x02
+#define VIRTIO_STATUS_DRIVER_OK		0x04
+#define VIRTIO_STATUS_FAILED		0x80
+
+/* interrupt status */
+#define VIRTIO_ISR_QUEUE		0x01
+#define VIRTIO_ISR_CONFIG		0x02
+
+/* legacy virtqueue layout */
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT	12
+#define VIRTIO_RING_ALIGN		4096
+
+/* descriptor flags */
+#define VRING_DESC_F_NEXT		1
+#define VRING_DESC_F_WRITE		2		/* buffer written by device */
+
+/* ring flags */
+#define VRING_USED_F_NO_NOTIFY		1
+#define VRING_AVAIL_F_NO_INTERRUPT	1
+
+/*
+ * Virtqueue descriptor.
+ */
+struct vring_desc {
+	uint64_t		addr;
+	uint32_t		len;
+	uint16_t		flags;
+	uint16_t		next;
+} __attribute__((packed));
+
+/*
+ * Virtqueue available ring (driver to device).
+ */
+struct vring_avail {
+	uint16_t		flags;
+	uint16_t		idx;
+	uint16_t		ring[];
+} __attribute__((packed));
+
+/*
+ * Virtqueue used ring element.
+ */
+struct vring_used_elem {
+	uint32_t		id;			/* head descriptor */
+	uint32_t		len;			/* bytes written by device */
+} __attribute__((packed));
+
+/*
+ * Virtqueue used ring (device to driver).
+ */
+struct vring_used {
+	uint16_t		flags;
+	uint16_t		idx;
+	struct vring_used_elem	ring[];
+} __attribute__((packed));
+
+/*
+ * Scatter gather element.
+ */
+struct virtio_sg {
+	uint64_t		addr;			/* physical address */
+	uint32_t		len;
+};
+
+/*
+ * Split virtqueue.
+ */
+struct virtqueue {
+	struct virtio_device *	vdev;
+	uint16_t		index;			/* queue number */
+	uint16_t		num;			/* number of descriptors */
+	uint32_t		order;			/* rings pages order */
+	struct vring_desc *	desc;
+	struct vring_avail *	avail;
+	struct vring_used *	used;
+	uint16_t		free_head;		/* first free descriptor */
+	uint16_t		num_free;		/* number of free descriptors */
+	uint16_t		num_added;		/* buffers added since last notification */
+	uint16_t		last_used_idx;		/* next used element to handle */
+	void **			data;			/* buffers tokens (by head descriptor) */
+};
+
+/*
+ * Virtio device (legacy PCI transport).
+ */
+struct virtio_device {
+	struct pci_device *	pci_dev;
+	uint16_t		io_base;
+	uint8_t			irq;
+	uint32_t		features;		/* negotiated features */
+};
+
+/* transport */
+int virtio_pci_init(struct virtio_device *vdev, struct pci_device *pci_dev);
+uint32_t virtio_negotiate_features(struct virtio_device *vdev, uint32_t supported);
+void virtio_driver_ok(struct virtio_device *vdev);
+void virtio_reset(struct virtio_device *vdev);
+uint8_t virtio_read_isr(struct virtio_device *vdev);
+uint8_t virtio_config_readb(struct virtio_device *vdev, uint32_t offset);
+uint32_t virtio_config_readl(struct virtio_device *vdev, uint32_t offset);
+uint64_t virtio_config_readq(struct virtio_device *vdev, uint32_t offset);
+
+/* virtqueues */
+int virtio_find_vq(struct virtio_device *vdev, uint16_t index, struct virtqueue *vq);
+void virtio_del_vq(struct virtqueue *vq);
+void virtio_notify(struct virtqueue *vq);
+int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sg, int out, int in, void *data);
+void virtqueue_kick(struct virtqueue *vq);
+void *virtqueue_get_buf(struct virtqueue *vq, uint32_t *len);
+
+/*
+ * Check if a feature has been negotiated.
+ */
+static inline int virtio_has_feature(struct virtio_device *vdev, int bit)
+{
+	return (vdev->features & (1U << bit)) != 0;
+}
+
+#endif
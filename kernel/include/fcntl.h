@@ -73,6 +73,13 @@
 #define F_SETSIG		10
 #define F_GETSIG		11
 #define F_DUPFD_CLOEXEC		1030
+#define F_ADD_SEALS		1033			/* fcntl : add seals to a memfd */
+#define F_GET_SEALS		1034			/* fcntl : get seals of a memfd */
+
+#define F_SEAL_SEAL		0x0001			/* prevent further seals from being set */
+#define F_SEAL_SHRINK		0x0002			/* prevent file from shrinking */
+#define F_SEAL_GROW		0x0004			/* prevent file from growing */
+#define F_SEAL_WRITE		0x0008			/* prevent writes */
 
 #define AT_FDCWD		-100			/* openat should use the current working dir */
 #define AT_EMPTY_PATH		0x1000			/* allow empty relative pathname */
@@ -85,4 +92,11 @@
 #define FMODE_READ		1
 #define FMODE_WRITE		2
 
+#define POSIX_FADV_NORMAL	0			/* no special treatment */
+#define POSIX_FADV_RANDOM	1			/* expect random page references */
+#define POSIX_FADV_SEQUENTIAL	2			/* expect sequential page references */
+#define POSIX_FADV_WILLNEED	3			/* will need these pages */
+#define POSIX_FADV_DONTNEED	4			/* don't need these pages */
+#define POSIX_FADV_NOREUSE	5			/* data will be accessed once */
+
 #endif
@@ -2,6 +2,7 @@
 #define _FS_H_
 
 #include <lib/list.h>
+#include <lib/radix_tree.h>
 #include <fs/stat.h>
 #include <fs/poll.h>
 #include <fs/statfs.h>
@@ -76,12 +77,14 @@ struct buffer_head {
 	uint32_t			b_state;		/* buffer state */
 	dev_t				b_dev;			/* device number */
 	uint32_t			b_rsector;		/* real location on disk */
+	time_t				b_flushtime;		/* time to write back dirty buffer */
 	struct page *			b_page;			/* page */
 	struct buffer_head *		b_this_page;		/* next buffer in page */
 	struct list_head		b_list;			/* next buffer in list */
 	struct list_head		b_list_req;		/* next buffer in request */
 	struct buffer_head *		b_next_hash;		/* next buffer in hash list */
 	struct buffer_head *		b_prev_hash;		/* previous buffer in hash list */
+	struct wait_queue_head		b_wait;			/* tasks waiting for end of i/o */
 	void				(*b_end_io)(struct buffer_head *, int);
 };
 
@@ -116,6 +119,7 @@ struct super_block {
 	struct file_system_type *	s_type;
 	struct dentry *			s_root;
 	struct super_operations *	s_op;
+	struct list_head		s_dirty;
 	struct list_head		s_list;
 };
 
@@ -142,7 +146,11 @@ struct inode {
 	char				i_pipe;
 	char				i_shm;
 	char				i_sock;
-	struct list_head		i_pages;
+	struct radix_tree_root		i_pages;
+	uint32_t			i_nrpages;
+	uint32_t			i_nrdirty;
+	time_t				i_dirtied_when;
+	struct list_head		i_dirty_list;
 	struct list_head		i_dentry;
 	struct list_head		i_list;
 	struct vm_area *		i_mmap;
@@ -200,6 +208,20 @@ struct fown {
 	int				signum;
 };
 
+/*
+ * File read ahead state (in pages).
+ */
+struct file_ra_state {
+	uint32_t			start;
+	uint32_t			size;
+	uint32_t			async_size;
+	uint32_t			prev_index;
+	uint32_t			flags;
+};
+
+#define RA_FLAG_RANDOM			0x01			/* random access : no read ahead */
+#define RA_FLAG_SEQUENTIAL		0x02			/* sequential access : double read ahead window */
+
 /*
  * Opened file.
  */
@@ -210,6 +232,7 @@ struct file {
 	int				f_count;
 	struct dentry *			f_dentry;
 	struct fown			f_owner;
+	struct file_ra_state		f_ra;
 	void *				f_private;
 	struct file_operations *	f_op;
 };
@@ -267,6 +290,7 @@ struct inode_operations {
 	int (*bmap)(struct inode *, uint32_t);
 	int (*get_block)(struct inode *, uint32_t, struct buffer_head *, int create);
 	int (*readpage)(struct inode *, struct page *);
+	int (*writepage)(struct inode *, struct page *);
 	int (*prepare_write)(struct inode *, struct page *, uint32_t, uint32_t);
 	int (*commit_write)(struct inode *, struct page *, uint32_t, uint32_t);
 };
@@ -299,6 +323,7 @@ extern uint32_t buffermem_pages;
 int register_filesystem(struct file_system_type *fs);
 int get_filesystem_list(char *buf, int count);
 int get_vfs_mount_list(char *buf, int count);
+uint32_t writeback_inodes(dev_t dev, uint32_t nr_pages, time_t older_than);
 
 /* buffer operations */
 #define buffer_uptodate(bh)			test_bit(&(bh)->b_state, BH_Uptodate)
@@ -328,6 +353,7 @@ int generic_block_bmap(struct inode *inode, uint32_t block);
 int generic_block_read(struct file *filp, char *buf, size_t count, off_t *ppos);
 int generic_block_write(struct file *filp, const char *buf, size_t count, off_t *ppos);
 int generic_readpage(struct inode *inode, struct page *page);
+int generic_writepage(struct inode *inode, struct page *page);
 int generic_file_read(struct file *filp, char *buf, size_t count, off_t *ppos);
 int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *ppos);
 int generic_prepare_write(struct inode *inode, struct page *page, uint32_t from, uint32_t to);
@@ -341,7 +367,10 @@ struct inode *get_empty_inode(struct super_block *sb);
 void clear_inode(struct inode *inode);
 void add_to_inode_cache(struct inode *inode);
 struct inode *find_inode(struct super_block *sb, ino_t ino);
+void write_inode(struct inode *inode);
 void sync_inodes(dev_t dev);
+void wait_on_inodes_writeback(dev_t dev);
+uint32_t writeback_sb_inodes(struct super_block *sb, uint32_t nr_pages, time_t older_than);
 void update_atime(struct inode *inode);
 void init_inode();
 
@@ -31,6 +31,17 @@ struct proc_dir_entry {
 	struct proc_dir_entry *		next;
 	struct proc_dir_entry *		parent;
 	struct proc_dir_entry *		subdir;
+	void *				data;
+};
+
+/*
+ * Integer tunable (exposed in /proc/sys).
+ */
+struct ctl_table {
+	const char *			procname;
+	int *				data;
+	int				minval;
+	int				maxval;
 };
 
 /* procfs init operations */
@@ -38,6 +49,7 @@ int init_proc_fs();
 void proc_root_init();
 void proc_misc_init();
 void proc_net_init();
+void proc_sys_init();
 
 /* procfs generic operations */
 int proc_register(struct proc_dir_entry *dir, struct proc_dir_entry *de);
@@ -56,10 +68,13 @@ struct dentry *proc_pid_lookup(struct inode *dir, struct dentry *dentry);
 int proc_stat_read(struct task *task, char *page);
 int proc_status_read(struct task *task, char *page);
 int proc_statm_read(struct task *task, char *page);
+int proc_smaps_vma(struct vm_area *vma, char *buf);
 int proc_cmdline_read(struct task *task, char *page);
 int proc_environ_read(struct task *task, char *page);
 int proc_io_read(struct task *task, char *page);
 int proc_comm_read(struct task *task, char *page);
+int proc_oom_score_read(struct task *task, char *page);
+int proc_oom_score_adj_read(struct task *task, char *page);
 
 /* procfs link operations */
 int do_proc_readlink(struct dentry *dentry, char *buf, size_t bufsize);
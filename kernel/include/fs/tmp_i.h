@@ -10,6 +10,7 @@
 struct tmpfs_inode_info {
 	struct list_head	i_pages;
 	int			i_shmid;
+	int			i_seals;
 };
 
 #endif
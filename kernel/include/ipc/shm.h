@@ -16,6 +16,10 @@
 
 #define	SHM_DEST	01000					/* segment will be destroyed on last detach */
 
+#define MFD_CLOEXEC		0x0001				/* memfd : set close on exec */
+#define MFD_ALLOW_SEALING	0x0002				/* memfd : allow sealing */
+#define MFD_NAME_MAX		249				/* memfd : max name length */
+
 /* ipcs ctl commands */
 #define SHM_STAT 	13
 #define SHM_INFO 	14
@@ -59,10 +63,17 @@ struct shm_info {
 	unsigned long		swap_successes;
 };
 
+struct file;
+struct inode;
+
 void init_shm();
 int sys_shmget(key_t key, size_t size, int shmflg);
 int sys_shmat(int shmid, char *shmaddr, int shmflg, uint32_t *addr_ret);
 int sys_shmdt(char *shmaddr);
 int sys_shmctl(int shmid, int cmd, struct shmid_ds *buf);
+int sys_memfd_create(const char *name, unsigned int flags);
+int shm_fcntl(struct file *filp, int cmd, unsigned long arg);
+int shm_check_size(struct inode *inode, off_t length);
+int shm_write_sealed(struct inode *inode);
 
 #endif
\ No newline at end of file
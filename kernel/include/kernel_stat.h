@@ -12,6 +12,42 @@ struct kernel_stat {
 	uint32_t	context_switch;
 	uint32_t	pswpin;
 	uint32_t	pswpout;
+	uint32_t	ra_hits;
+	uint32_t	ra_misses;
+	uint32_t	ra_async;
+	uint32_t	ra_pages;
+	uint32_t	pgdirtied;
+	uint32_t	pgwriteback;
+	uint32_t	dirty_throttle;
+	uint32_t	pgfault;
+	uint32_t	fault_around;
+	uint32_t	fault_around_pages;
+	uint32_t	zero_page_hits;
+	uint32_t	zeroed_pool_hits;
+	uint32_t	zeroed_pool_misses;
+	uint32_t	tlb_flush_all;
+	uint32_t	tlb_flush_page;
+	uint32_t	tlb_switch;
+	uint32_t	tlb_switch_skipped;
+	uint32_t	tlb_switch_lazy;
+	uint32_t	thp_fault_alloc;
+	uint32_t	thp_fault_fallback;
+	uint32_t	thp_split;
+	uint32_t	swap_cluster_alloc;
+	uint32_t	swap_ra;
+	uint32_t	swap_ra_hit;
+	uint32_t	swap_write_batch;
+	uint32_t	pginvalidate;
+	uint32_t	pgdropbehind;
+	uint32_t	alloc_fail;
+	uint32_t	oom_kill;
+	uint32_t	oom_reaped;
+	uint32_t	compact_stall;
+	uint32_t	compact_success;
+	uint32_t	compact_fail;
+	uint32_t	compact_migrated;
+	uint32_t	ksm_merged;
+	uint32_t	ksm_full_scans;
 	time_t		cpu_user;
 	time_t		cpu_system;
 	time_t		cpu_nice;
@@ -0,0 +1,14 @@
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include <stddef.h>
+
+#define LZ4_HASH_LOG		12
+#define LZ4_HASH_SIZE		(1 << LZ4_HASH_LOG)
+#define LZ4_MEM_COMPRESS	(LZ4_HASH_SIZE * sizeof(uint16_t))
+#define LZ4_MAX_INPUT_SIZE	0xFFFF
+
+size_t lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, void *wrkmem);
+int lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+#endif
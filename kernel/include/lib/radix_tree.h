@@ -0,0 +1,43 @@
+#ifndef _RADIX_TREE_H_
+#define _RADIX_TREE_H_
+
+#include <stddef.h>
+
+#define RADIX_TREE_MAP_SHIFT		6
+#define RADIX_TREE_MAP_SIZE		(1 << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK		(RADIX_TREE_MAP_SIZE - 1)
+#define RADIX_TREE_MAX_HEIGHT		((32 + RADIX_TREE_MAP_SHIFT - 1) / RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_TAG_LONGS		(RADIX_TREE_MAP_SIZE / 32)
+#define RADIX_TREE_MAX_TAGS		2
+
+/*
+ * Radix tree node.
+ */
+struct radix_tree_node {
+	uint32_t			count;
+	void *				slots[RADIX_TREE_MAP_SIZE];
+	uint32_t			tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_LONGS];
+};
+
+/*
+ * Radix tree root.
+ */
+struct radix_tree_root {
+	uint32_t			height;
+	struct radix_tree_node *	rnode;
+};
+
+#define INIT_RADIX_TREE(root)		do { (root)->height = 0; (root)->rnode = NULL; } while (0)
+
+int radix_tree_insert(struct radix_tree_root *root, uint32_t index, void *item);
+void *radix_tree_lookup(struct radix_tree_root *root, uint32_t index);
+void *radix_tree_delete(struct radix_tree_root *root, uint32_t index);
+void *radix_tree_replace(struct radix_tree_root *root, uint32_t index, void *item);
+void *radix_tree_tag_set(struct radix_tree_root *root, uint32_t index, int tag);
+void *radix_tree_tag_clear(struct radix_tree_root *root, uint32_t index, int tag);
+int radix_tree_tag_get(struct radix_tree_root *root, uint32_t index, int tag);
+int radix_tree_tagged(struct radix_tree_root *root, int tag);
+uint32_t radix_tree_gang_lookup(struct radix_tree_root *root, void **results, uint32_t first_index, uint32_t max_items);
+uint32_t radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results, uint32_t first_index, uint32_t max_items, int tag);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _COMPACTION_H_
+#define _COMPACTION_H_
+
+#include <stddef.h>
+
+#define COMPACT_MAX_WINDOWS		8			/* number of candidate blocks tried per compaction */
+
+int compact_zone_order(int zone, uint32_t order);
+
+#endif
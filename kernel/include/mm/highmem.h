@@ -11,11 +11,29 @@
 #define PKMAP_NR(vaddr)		(((vaddr) - PKMAP_BASE) >> PAGE_SHIFT)
 #define PKMAP_ADDR(nr)		(PKMAP_BASE + ((nr) << PAGE_SHIFT))
 
+#define FIXADDR_START		(PKMAP_BASE + LAST_PKMAP * PAGE_SIZE)
+#define FIX_KMAP_ADDR(type)	(FIXADDR_START + ((type) << PAGE_SHIFT))
+
+/*
+ * Atomic mapping slots (a slot must not be held across a schedule : page faults handler uses KM_USER0/KM_USER1,
+ * copies to/from user space use KM_USER_COPY with page faults disabled).
+ */
+enum km_type {
+	KM_USER0,
+	KM_USER1,
+	KM_USER_COPY,
+	KM_TYPE_NR,
+};
+
 extern pte_t *pkmap_page_table;
+extern pte_t *fixmap_page_table;
 extern struct page *highmem_start_page;
 
 void *kmap(struct page *page);
 void kunmap(struct page *page);
+void *kmap_atomic(struct page *page, enum km_type type);
+void kunmap_atomic(void *kvaddr, enum km_type type);
+void fault_in_pages(const char *buf, size_t size, int write);
 void clear_user_highpage(struct page *page);
 void clear_user_highpage_partial(struct page *page, off_t offset);
 void copy_user_highpage(struct page *dst, struct page *src);
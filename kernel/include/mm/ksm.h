@@ -0,0 +1,13 @@
+#ifndef _KSM_H_
+#define _KSM_H_
+
+#include <stddef.h>
+
+#define KSM_RUN_STOP			0			/* scanner stopped */
+#define KSM_RUN_MERGEABLE		1			/* scan MADV_MERGEABLE memory regions */
+#define KSM_RUN_ALL			2			/* scan all private memory regions */
+
+void ksm_get_stats(uint32_t *pages_shared, uint32_t *pages_sharing);
+int ksmd(void *arg);
+
+#endif
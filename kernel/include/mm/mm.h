@@ -15,6 +15,9 @@
 #define USTACK_START			0xF8000000				/* user stack */
 #define USTACK_LIMIT			(8 * 1024 * 1024)			/* user stack limit = 8 MB */
 
+#define DEFAULT_READ_AHEAD_PAGES	32					/* default read ahead window = 128 KB */
+#define MAX_READ_AHEAD_PAGES		256					/* maximum read ahead window = 1 MB */
+
 /*
  * Virtual memory area structure.
  */
@@ -44,16 +47,32 @@ struct vm_operations {
 	void (*unmap)(struct vm_area *, uint32_t, size_t);
 	struct page *(*nopage)(struct vm_area *, uint32_t);
 	int (*swapout)(struct vm_area *, struct page *);
+	void (*map_pages)(struct vm_area *, uint32_t, uint32_t);
+	int (*sync)(struct vm_area *, uint32_t, size_t, uint32_t);
 };
 
 void init_bios_map(struct multiboot_tag_mmap *mbi_mmap);
-int bios_map_address_available(uint32_t addr);
-int bios_map_add_entry(uint32_t start, uint32_t end, int type);
+int bios_map_address_available(uint64_t addr);
+int bios_map_add_entry(uint64_t start, uint64_t end, int type);
+uint32_t bios_map_end_pfn();
 void init_mem(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_upper);
 void *kmalloc(uint32_t size);
 void kfree(void *p);
 void kheap_init();
 void si_meminfo(struct sysinfo *info);
 
+/* tunables */
+extern int sysctl_max_readahead;
+extern int sysctl_dirty_background_ratio;
+extern int sysctl_dirty_ratio;
+extern int sysctl_dirty_expire_centisecs;
+extern int sysctl_dirty_writeback_centisecs;
+extern int sysctl_fault_around_pages;
+extern int sysctl_transparent_hugepage;
+extern int sysctl_page_cluster;
+extern int sysctl_ksm_run;
+extern int sysctl_ksm_pages_to_scan;
+extern int sysctl_ksm_sleep_millisecs;
+
 
 #endif
@@ -21,12 +21,15 @@ struct mmap_arg_struct {
 #define VM_WRITE		0x02
 #define VM_EXEC			0x04
 #define VM_SHARED		0x08
+#define VM_MERGEABLE		0x10		/* pages may be merged by ksm */
 #define VM_GROWSDOWN		0x0100
 #define VM_GROWSUP		0x0200
 #define VM_SHM			0x0400
 #define VM_DENYWRITE		0x0800
 #define VM_EXECUTABLE		0x1000
 #define VM_LOCKED		0x2000
+#define VM_SEQ_READ		0x4000		/* sequential access hint */
+#define VM_RAND_READ		0x8000		/* random access hint */
 
 #define MAP_SHARED       	1
 #define MAP_PRIVATE      	2
@@ -34,6 +37,8 @@ struct mmap_arg_struct {
 #define MAP_FIXED        	0x10
 #define MAP_ANONYMOUS    	0x20
 #define MAP_DENYWRITE		0x0800
+#define MAP_LOCKED		0x2000
+#define MAP_POPULATE		0x8000
 
 #define MREMAP_MAYMOVE		1
 #define MREMAP_FIXED		2
@@ -47,6 +52,17 @@ struct mmap_arg_struct {
 #define MS_INVALIDATE		2
 #define MS_SYNC			4
 
+#define MCL_CURRENT		1		/* lock all current mappings */
+#define MCL_FUTURE		2		/* lock all future mappings */
+
+#define MADV_NORMAL		0		/* no special treatment */
+#define MADV_RANDOM		1		/* expect random page references */
+#define MADV_SEQUENTIAL		2		/* expect sequential page references */
+#define MADV_WILLNEED		3		/* will need these pages */
+#define MADV_DONTNEED		4		/* don't need these pages */
+#define MADV_MERGEABLE		12		/* identical pages may be merged */
+#define MADV_UNMERGEABLE	13		/* don't merge pages anymore */
+
 void build_mmap_avl(struct mm_struct *mm);
 void avl_insert_neighbours(struct vm_area *new_node, struct vm_area **ptree, struct vm_area **to_the_left, struct vm_area **to_the_right);
 void avl_remove(struct vm_area *node_to_delete, struct vm_area **ptree);
@@ -64,6 +80,11 @@ int sys_mremap(uint32_t old_address, size_t old_size, size_t new_size, int flags
 int sys_madvise(uint32_t addr, size_t length, int advice);
 int sys_mprotect(uint32_t addr, size_t len, int prot);
 int sys_mincore(uint32_t addr, size_t len, unsigned char *vec);
+int sys_msync(uint32_t addr, size_t len, int flags);
+int sys_mlock(uint32_t addr, size_t len);
+int sys_munlock(uint32_t addr, size_t len);
+int sys_mlockall(int flags);
+int sys_munlockall();
 uint32_t sys_brk(uint32_t brk);
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef _OOM_H_
+#define _OOM_H_
+
+#include <stddef.h>
+#include <time.h>
+
+#define OOM_SCORE_ADJ_MIN		(-1000)			/* task is never killed */
+#define OOM_SCORE_ADJ_MAX		1000			/* task is always killed first */
+#define OOM_VICTIM_TIMEOUT		HZ			/* time given to a victim to exit before killing another task */
+
+struct task;
+
+uint32_t oom_badness(struct task *task, uint32_t totalpages);
+uint32_t oom_totalpages();
+int out_of_memory(uint32_t order);
+
+#endif
@@ -6,10 +6,17 @@
 #include <lib/list.h>
 #include <stddef.h>
 
+#ifdef CONFIG_X86_PAE
+/* page directory pointer table, page directory and page table entry (64 bits entries, 36 bits physical addresses) */
+typedef uint64_t pgd_t;
+typedef uint64_t pmd_t;
+typedef uint64_t pte_t;
+#else
 /* page directory, page middle directory (= page table) and page table entry */
 typedef uint32_t pgd_t;
 typedef uint32_t pmd_t;
 typedef uint32_t pte_t;
+#endif
 
 #define PAGE_SHIFT			12
 #define PAGE_SIZE			(1 << PAGE_SHIFT)
@@ -18,14 +25,28 @@ typedef uint32_t pte_t;
 #define PAGE_ALIGN_DOWN(addr)		((addr) & PAGE_MASK)
 #define PAGE_ALIGN_UP(addr)		(((addr) + PAGE_SIZE - 1) & PAGE_MASK)
 #define ALIGN_UP(addr, size)		(((addr) + size - 1) & (~(size - 1)))
+#ifdef CONFIG_X86_PAE
+#define PTRS_PER_PTE			512
+#define PTRS_PER_PMD			512
+#define PTRS_PER_PGD			4
+#define PGDIR_SHIFT			30
+#define PMD_SHIFT			21
+#define HPAGE_ORDER			9
+#define MAX_PHYS_PAGES			(1 << 24)				/* 64 GB */
+#else
 #define PTRS_PER_PTE			1024
 #define PTRS_PER_PMD			1
+#define PTRS_PER_PGD			1024
 #define PGDIR_SHIFT			22
+#define PMD_SHIFT			22
+#define HPAGE_ORDER			10
+#define MAX_PHYS_PAGES			(1 << 20)				/* 4 GB */
+#endif
 #define PGDIR_SIZE			(1UL << PGDIR_SHIFT)
 #define PGDIR_MASK			(~(PGDIR_SIZE - 1))
-#define PMD_SHIFT			22
 #define PMD_SIZE			(1UL << PMD_SHIFT)
 #define PMD_MASK			(~(PMD_SIZE - 1))
+#define HPAGE_NR_PAGES			(1 << HPAGE_ORDER)
 #define PAGE_OFFSET			0xC0000000
 #define PTE_TABLE_MASK			((PTRS_PER_PTE - 1) * sizeof(pte_t))
 #define PMD_TABLE_MASK			((PTRS_PER_PMD - 1) * sizeof(pmd_t))
@@ -37,6 +58,8 @@ typedef uint32_t pte_t;
 #define PAGE_ACCESSED			0x020
 #define PAGE_DIRTY			0x040
 #define PAGE_PROTNONE			0x080
+#define PAGE_PSE			0x080
+#define PAGE_GLOBAL			0x100
 
 #define PAGE_NONE			(PAGE_PRESENT | PAGE_ACCESSED)
 #define PAGE_SHARED			(PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_ACCESSED)
@@ -65,22 +88,44 @@ typedef uint32_t pte_t;
 #define GFP_KERNEL			0
 #define GFP_HIGHUSER			1
 #define NR_ZONES			2
+#define GFP_ZONE_MASK			0x0F
+#define __GFP_NORETRY			0x10			/* fail after one reclaim pass (no oom kill) */
 
 #define PG_uptodate			0
 #define PG_lock				1
 #define PG_reserved			2
+#define PG_readahead			3
+#define PG_dirty			4
+#define PG_writeback			5
 #define PG_swap_cache			10
+#define PG_ksm				11
+
+#define PAGECACHE_TAG_DIRTY		0
+#define PAGECACHE_TAG_WRITEBACK		1
 
 #define PageReserved(page)		test_bit(&(page)->flags, PG_reserved)
+#define SetPageReserved(page)		set_bit(&(page)->flags, PG_reserved)
 #define PageUptodate(page)		test_bit(&(page)->flags, PG_uptodate)
 #define ClearPageUptodate(page)		clear_bit(&(page)->flags, PG_uptodate)
 #define SetPageUptodate(page)		set_bit(&(page)->flags, PG_uptodate)
 #define PageLocked(page)		test_bit(&(page)->flags, PG_lock)
-#define UnlockPage(page)		clear_bit(&(page)->flags, PG_lock)
+#define UnlockPage(page)		unlock_page(page)
 #define LockPage(page)			set_bit(&(page)->flags, PG_lock)
+#define PageReadahead(page)		test_bit(&(page)->flags, PG_readahead)
+#define SetPageReadahead(page)		set_bit(&(page)->flags, PG_readahead)
+#define ClearPageReadahead(page)	clear_bit(&(page)->flags, PG_readahead)
+#define PageDirty(page)			test_bit(&(page)->flags, PG_dirty)
+#define SetPageDirty(page)		set_bit(&(page)->flags, PG_dirty)
+#define ClearPageDirty(page)		clear_bit(&(page)->flags, PG_dirty)
+#define PageWriteback(page)		test_bit(&(page)->flags, PG_writeback)
+#define SetPageWriteback(page)		set_bit(&(page)->flags, PG_writeback)
+#define ClearPageWriteback(page)	clear_bit(&(page)->flags, PG_writeback)
 #define PageSwapCache(page)		test_bit(&(page)->flags, PG_swap_cache)
 #define SetPageSwapCache(page)		set_bit(&(page)->flags, PG_swap_cache)
 #define ClearPageSwapCache(page)	clear_bit(&(page)->flags, PG_swap_cache)
+#define PageKsm(page)			test_bit(&(page)->flags, PG_ksm)
+#define SetPageKsm(page)		set_bit(&(page)->flags, PG_ksm)
+#define ClearPageKsm(page)		clear_bit(&(page)->flags, PG_ksm)
 
 #define __pa(addr)			((uint32_t)(addr) - PAGE_OFFSET)
 #define __va(addr)			((void *)((uint32_t)(addr) + PAGE_OFFSET))
@@ -88,17 +133,19 @@ typedef uint32_t pte_t;
 #define MAP_NR(addr)			(__pa(addr) >> PAGE_SHIFT)
 #define VALID_PAGE(page)		((uint32_t) (page - page_array) < nr_pages)
 
-#define __mk_pte(page_nr, prot)		(((page_nr) << PAGE_SHIFT) | (prot))
+#define __mk_pte(page_nr, prot)		((((pte_t) (page_nr)) << PAGE_SHIFT) | (prot))
 #define mk_pte(page, prot)		__mk_pte((page) - page_array, (prot))
 #define mk_pte_phys(phys, prot)		__mk_pte((phys) >> PAGE_SHIFT, prot)
 #define pmd_none(pmd)			(!(pmd))
+#define pmd_huge(pmd)			((pmd) & PAGE_PSE)
+#define pmd_huge_page(pmd)		(page_array + ((uint32_t)(((pmd) >> PAGE_SHIFT))))
 #define pte_page(pte)			(page_array + ((uint32_t)(((pte) >> PAGE_SHIFT))))
 #define pte_prot(pte)			((pte) & (PAGE_SIZE - 1))
 #define pte_clear(pte)			(*(pte) = 0)
 #define pte_none(pte)			(!(pte))
 #define pte_dirty(pte)			((pte) & PAGE_DIRTY)
 #define pte_present(pte)		((pte) & (PAGE_PRESENT | PAGE_PROTNONE))
-#define pte_offset(pmd, addr) 		((pte_t *) (pmd_page(*pmd) + ((addr >> 10) & ((PTRS_PER_PTE - 1) << 2))))
+#define pte_offset(pmd, addr) 		((pte_t *) pmd_page(*(pmd)) + (((addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)))
 
 static inline pte_t pte_mkwrite(pte_t pte)
 {
@@ -127,6 +174,7 @@ static inline pte_t pte_mkold(pte_t pte)
 
 /* page allocation */
 #define __get_free_page(priority)	__get_free_pages(priority, 0)
+#define PAGE_INDEX(offset)		((uint32_t) ((offset) >> PAGE_SHIFT))
 #define __free_page(page)		__free_pages(page, 0)
 #define get_free_page()			get_free_pages(0)
 #define free_page(addr)			free_pages(addr, 0)
@@ -138,6 +186,8 @@ extern struct page *page_array;
 extern pgd_t *pgd_kernel;
 extern uint32_t totalram_pages;
 extern uint32_t page_cache_size;
+extern struct page *zero_page;
+extern uint32_t nr_zeroed_pages;
 
 /*
  * Page structure.
@@ -152,8 +202,6 @@ struct page {
 	void *			virtual;				/* virtual address (used to map high pages in kernel space) */
 	void *			private;				/* used for page allocation */
 	struct list_head	list;					/* next page */
-	struct page *		next_hash;				/* next page in hash table */
-	struct page *		prev_hash;				/* previous page in hash table */
 };
 
 /* paging */
@@ -167,28 +215,60 @@ pgd_t *create_page_directory();
 void free_pgd(pgd_t *pgd);
 void flush_tlb_page(pgd_t *pgd, uint32_t address);
 void flush_tlb(pgd_t *pgd);
+void flush_tlb_kernel_page(uint32_t address);
+int split_huge_pmd(pmd_t *pmd);
+int make_pages_present(uint32_t start, uint32_t end);
 void wait_on_page(struct page *page);
+void wait_on_page_writeback(struct page *page);
+void wake_up_page(struct page *page);
+void unlock_page(struct page *page);
 pmd_t *pmd_alloc(pgd_t *pgd, uint32_t address);
 pte_t *pte_alloc(pmd_t *pmd, uint32_t address);
 
 /* page allocation */
 int init_page_alloc(uint32_t kernel_start, uint32_t kernel_end);
 uint32_t nr_free_pages();
+uint32_t nr_free_zone_pages(int zone);
 struct page *__get_free_pages(int priority, uint32_t order);
+struct page *__get_free_pages_noreclaim(int priority, uint32_t order);
 void __free_pages(struct page *page, uint32_t order);
 void *get_free_pages(uint32_t order);
 void free_pages(void *address, uint32_t order);
+struct page *get_zeroed_user_page();
+struct page *get_free_huge_page();
+void refill_zeroed_pages();
+uint32_t deferred_init_pages();
+uint32_t free_block_size(struct page *page);
+uint32_t isolate_free_range(uint32_t start, uint32_t end, uint8_t *isolated);
+void release_free_range(uint32_t start, uint32_t nr);
 
 /* page cache */
-void init_page_cache();
 struct page *find_page(struct inode *inode, off_t offset);
-void add_to_page_cache(struct page *page, struct inode *inode, off_t offset);
+int add_to_page_cache(struct page *page, struct inode *inode, off_t offset);
 void remove_from_page_cache(struct page *page);
+uint32_t find_get_pages(struct inode *inode, off_t start, uint32_t nr_pages, struct page **pages);
+uint32_t find_get_pages_tag(struct inode *inode, off_t start, int tag, uint32_t nr_pages, struct page **pages);
+void page_cache_tag_set(struct page *page, int tag);
+void page_cache_tag_clear(struct page *page, int tag);
 void invalidate_inode_pages(struct inode *inode);
+uint32_t invalidate_mapping_pages(struct inode *inode, uint32_t start_index, uint32_t end_index);
+uint32_t force_page_cache_readahead(struct inode *inode, uint32_t index, uint32_t nr_pages);
 void truncate_inode_pages(struct inode *inode, off_t start);
 int shrink_mmap(int priority);
 struct page *read_cache_page(struct inode *inode, off_t offset);
 
+/* page writeback */
+extern uint32_t nr_dirty_pages;
+extern struct task *bdflush_task;
+void set_page_dirty(struct page *page);
+int clear_page_dirty(struct page *page);
+void end_page_writeback(struct page *page);
+int filemap_fdatawrite(struct inode *inode);
+void filemap_fdatawait(struct inode *inode);
+int filemap_write_and_wait(struct inode *inode);
+void balance_dirty_pages();
+void wb_writeback();
+
 /*
  * Get page directory offset for an address.
  */
@@ -200,9 +280,14 @@ static inline pgd_t *pgd_offset(pgd_t *pgd, uint32_t address)
 /*
  * Get page table offset for an address.
  */
-static inline pmd_t *pmd_offset(pgd_t *pgd)
+static inline pmd_t *pmd_offset(pgd_t *pgd, uint32_t address)
 {
+#ifdef CONFIG_X86_PAE
+	return (pmd_t *) __va((uint32_t) (*pgd & PAGE_MASK)) + ((address >> PMD_SHIFT) & (PTRS_PER_PMD - 1));
+#else
+	UNUSED(address);
 	return (pmd_t *) pgd;
+#endif
 }
 
 /*
@@ -210,7 +295,7 @@ static inline pmd_t *pmd_offset(pgd_t *pgd)
  */
 static inline uint32_t pmd_page(pmd_t pmd)
 {
-	return (uint32_t) __va(pmd & PAGE_MASK);
+	return (uint32_t) __va((uint32_t) (pmd & PAGE_MASK));
 }
 
 #endif
@@ -3,6 +3,7 @@
 
 #define MAX_SWAPFILES			8
 #define SWAP_CLUSTER_MAX		32
+#define SWAPFILE_CLUSTER		32
 
 #define SWP_USED			1
 #define SWP_WRITEOK			3
@@ -11,6 +12,19 @@
 #define SWP_OFFSET(entry)		((entry) >> 8)
 #define SWP_ENTRY(type, offset)		(((type) << 1) | ((offset) << 8))
 
+/* swap entries are stored in non present page table entries (in the high half with PAE) */
+#ifdef CONFIG_X86_PAE
+#define pte_to_swp_entry(pte)		((uint32_t) ((pte) >> 32))
+#define swp_entry_to_pte(entry)		(((pte_t) (entry)) << 32)
+#else
+#define pte_to_swp_entry(pte)		((uint32_t) (pte))
+#define swp_entry_to_pte(entry)		((pte_t) (entry))
+#endif
+
+/* swap cache pages are indexed by swap entry */
+#define SWP_CACHE_OFFSET(entry)		((off_t) (entry) << PAGE_SHIFT)
+#define SWP_CACHE_ENTRY(page)		((uint32_t) ((page)->offset >> PAGE_SHIFT))
+
 #define SWAP_FLAG_PREFER		0x8000
 #define SWAP_FLAG_PRIO_MASK		0x7FFF
 #define SWAP_FLAG_PRIO_SHIFT		0
@@ -29,6 +43,8 @@ struct swap_info {
 	uint16_t *			swap_map;
 	uint32_t			lowest_bit;
 	uint32_t			highest_bit;
+	uint32_t			cluster_next;
+	uint32_t			cluster_nr;
 	int				priority;
 	uint32_t			max;
 	size_t				pages;
@@ -55,8 +71,10 @@ union swap_header {
 
 void si_swapinfo(struct sysinfo *info);
 void swap_free(uint32_t entry);
+void delete_from_swap_cache(struct page *page);
 void free_page_and_swap_cache(struct page *page);
 int swap_out(int priority);
+void swap_write_flush();
 int swap_in(struct vm_area *vma, pte_t *pte, uint32_t entry, int write_access);
 int get_swaparea_info(char *buf);
 int sys_swapon(const char *path, int swap_flags);
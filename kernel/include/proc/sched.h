@@ -3,6 +3,7 @@
 
 #include <proc/task.h>
 #include <proc/wait.h>
+#include <x86/interrupt.h>
 
 #define TASK_RETURN_ADDRESS		0xFFFFFFFF
 #define DEF_PRIORITY			(20 * HZ / 100)	/* 200 ms time slices */
@@ -92,6 +93,25 @@ void wake_up_process(struct task *task);
 void sleep_on(struct wait_queue_head *wq);
 void wake_up(struct wait_queue_head *wq);
 
+/*
+ * Sleep on a wait queue until a condition is true (condition is checked with interrupts disabled,
+ * kinit can't sleep : it halts until next interrupt).
+ */
+#define wait_event(wq, condition)						\
+	do {									\
+		uint32_t __flags;						\
+										\
+		irq_save(__flags);						\
+		while (!(condition)) {						\
+			if (current_task->pid)					\
+				sleep_on(wq);					\
+			else							\
+				safe_halt();					\
+			irq_disable();						\
+		}								\
+		irq_restore(__flags);						\
+	} while (0)
+
 pid_t sys_getpid();
 pid_t sys_getppid();
 pid_t sys_getpgid(pid_t pid);
@@ -44,6 +44,8 @@ struct mm_struct {
 	uint32_t			env_start;			/* start environ */
 	uint32_t			env_end;			/* end environ */
 	uint32_t			rss;				/* resident memory */
+	uint16_t			def_flags;			/* default flags of new memory regions (mlockall) */
+	int				oom_killed;			/* killed by out of memory killer (released at exit) */
 	struct desc_struct *		ldt;				/* Local Descriptor Table */
 	size_t				ldt_size;			/* Local Descriptor Table size */
 	uint32_t			swap_address;			/* swap address */
@@ -135,6 +137,10 @@ struct task {
 	time_t				stime;				/* amount of time (in jiffies) that this process has been scheduled in kernel mode */
 	time_t				cutime;				/* amount of time (in jiffies) that this process's waited-for children have been scheduled in user mode */
 	time_t				cstime;				/* amount of time (int jiffies) that this process's waited-for children have been scheduled in user mode */
+	uint32_t			min_flt;			/* minor page faults (no i/o needed) */
+	uint32_t			maj_flt;			/* major page faults (page read from disk or swap) */
+	uint32_t			cmin_flt;			/* minor page faults of waited-for children */
+	uint32_t			cmaj_flt;			/* major page faults of waited-for children */
 	time_t				start_time;			/* time process started after system boot */
 	int			 	exit_code;			/* exit code */
 	struct task *		 	parent;				/* parent process */
@@ -143,6 +149,7 @@ struct task {
 	sigset_t			saved_sigmask;			/* saved signals mask */
 	struct task_io_accounting	ioac;				/* i/o accounting */
 	struct rlimit			rlim[RLIM_NLIMITS];		/* resource limits */
+	int				oom_score_adj;			/* out of memory killer badness adjustment */
 	struct registers		signal_regs;			/* saved registers at signal entry */
 	struct timer_event		real_timer;			/* timer */
 	struct wait_queue_head 		wait_child_exit;		/* wait queue for child exit */
@@ -84,10 +84,15 @@
 #define __NR_fchdir			133
 #define __NR_llseek			140
 #define __NR_select			142
+#define __NR_msync			144
 #define __NR_readv			145
 #define __NR_writev			146
 #define __NR_getsid			147
 #define __NR_fdatasync			148
+#define __NR_mlock			150
+#define __NR_munlock			151
+#define __NR_mlockall			152
+#define __NR_munlockall			153
 #define __NR_nanosleep			162
 #define __NR_mremap			163
 #define __NR_poll			168
@@ -153,6 +158,7 @@
 #define __NR_prlimit64			340
 #define __NR_renameat2			353
 #define __NR_getrandom			355
+#define __NR_memfd_create		356
 #define __NR_socket			359
 #define __NR_socketpair			360
 #define __NR_bind			361
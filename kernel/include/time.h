@@ -75,6 +75,17 @@ struct itimerval {
 
 time_t mktime(uint32_t year, uint32_t month, int32_t day, uint32_t hour, uint32_t min, uint32_t sec);
 
+/*
+ * Read Time Stamp Counter.
+ */
+static inline uint64_t get_cycles()
+{
+	uint32_t low, high;
+
+	rdtsc(low, high);
+	return ((uint64_t) high << 32) | low;
+}
+
 /*
  * Convert ms to jiffies.
  */
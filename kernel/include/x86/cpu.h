@@ -3,9 +3,13 @@
 
 #include <stddef.h>
 
+#define X86_FEATURE_PSE		0x00000008	/* Page Size Extensions */
 #define X86_FEATURE_TSC		0x00000010	/* Time Stamp Counter */
+#define X86_FEATURE_PAE		0x00000040	/* Physical Address Extensions */
+#define X86_FEATURE_PGE		0x00002000	/* Page Global Enable */
 
 void init_cpu();
 size_t get_cpuinfo(char *page);
+int cpu_has(uint32_t feature);
 
 #endif
\ No newline at end of file
@@ -29,6 +29,22 @@ struct registers {
 	uint32_t orig_eax;
 } __attribute__((packed));
 
+/*
+ * Compiler barrier.
+ */
+static inline void barrier()
+{
+	__asm__ __volatile__("": : :"memory");
+}
+
+/*
+ * Full memory barrier (orders stores before following loads).
+ */
+static inline void mb()
+{
+	__asm__ __volatile__("lock; addl $0, 0(%%esp)": : :"memory");
+}
+
 /*
  * Halt the processor.
  */
@@ -37,4 +53,12 @@ static inline void halt()
 	__asm__ __volatile__("hlt");
 }
 
+/*
+ * Enable interrupts and halt the processor (no interrupt can be lost between both instructions).
+ */
+static inline void safe_halt()
+{
+	__asm__ __volatile__("sti; hlt": : :"memory");
+}
+
 #endif
@@ -0,0 +1,83 @@
+#ifndef _UACCESS_H_
+#define _UACCESS_H_
+
+#include <x86/system.h>
+#include <stddef.h>
+
+/*
+ * Exception table entry (instruction which may fault on a user address and where to resume).
+ */
+struct exception_table_entry {
+	uint32_t		insn;
+	uint32_t		fixup;
+};
+
+/* page faults disabled (set while an atomic mapping is held) */
+extern int pagefault_disabled;
+
+size_t __copy_user(void *to, const void *from, size_t n);
+int fixup_exception(struct registers *regs);
+
+/*
+ * Disable page faults handling (faults on user addresses go directly to fixup).
+ */
+static inline void pagefault_disable()
+{
+	pagefault_disabled++;
+	barrier();
+}
+
+/*
+ * Enable page faults handling.
+ */
+static inline void pagefault_enable()
+{
+	barrier();
+	pagefault_disabled--;
+}
+
+/*
+ * Copy to user space (returns number of bytes not copied).
+ */
+static inline size_t copy_to_user(void *to, const void *from, size_t n)
+{
+	return __copy_user(to, from, n);
+}
+
+/*
+ * Copy from user space (returns number of bytes not copied).
+ */
+static inline size_t copy_from_user(void *to, const void *from, size_t n)
+{
+	return __copy_user(to, from, n);
+}
+
+/*
+ * Copy to user space without sleeping in page fault handler (returns number of bytes not copied).
+ */
+static inline size_t copy_to_user_inatomic(void *to, const void *from, size_t n)
+{
+	size_t ret;
+
+	pagefault_disable();
+	ret = __copy_user(to, from, n);
+	pagefault_enable();
+
+	return ret;
+}
+
+/*
+ * Copy from user space without sleeping in page fault handler (returns number of bytes not copied).
+ */
+static inline size_t copy_from_user_inatomic(void *to, const void *from, size_t n)
+{
+	size_t ret;
+
+	pagefault_disable();
+	ret = __copy_user(to, from, n);
+	pagefault_enable();
+
+	return ret;
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <x86/io.h>
 #include <x86/cpu.h>
 #include <mm/mm.h>
+#include <mm/ksm.h>
 #include <grub/multiboot2.h>
 #include <drivers/char/mem.h>
 #include <drivers/char/serial.h>
@@ -15,7 +16,10 @@
 #include <drivers/pci/pci.h>
 #include <drivers/block/blk_dev.h>
 #include <drivers/block/ata.h>
+#include <drivers/block/ahci.h>
+#include <drivers/block/virtio_blk.h>
 #include <drivers/block/loop.h>
+#include <drivers/block/zram.h>
 #include <drivers/video/fb.h>
 #include <drivers/net/rtl8139.h>
 #include <drivers/net/loopback.h>
@@ -34,12 +38,14 @@
 #include <fs/v9fs_fs.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <stderr.h>
 #include <fcntl.h>
 #include <dev.h>
 
 #define COMMAND_LINE_SIZE	512
 #define ROOT_DEV_NAME_SIZE	32
+#define NR_BOOT_TIMINGS		16
 
 /* root device */
 static dev_t root_dev;
@@ -57,6 +63,47 @@ char saved_command_line[COMMAND_LINE_SIZE] = { 0 };
 /* grub framebuffer */
 static struct multiboot_tag_framebuffer tag_fb;
 
+/*
+ * Boot timing log entry.
+ */
+struct boot_timing {
+	const char *	name;
+	uint64_t	cycles;
+};
+
+/* boot timing log */
+static struct boot_timing boot_timings[NR_BOOT_TIMINGS];
+static int nr_boot_timings = 0;
+static uint64_t boot_start_cycles;
+
+/*
+ * Log end of a boot step.
+ */
+static void boot_timing(const char *name)
+{
+	if (nr_boot_timings >= NR_BOOT_TIMINGS)
+		return;
+
+	boot_timings[nr_boot_timings].name = name;
+	boot_timings[nr_boot_timings].cycles = get_cycles();
+	nr_boot_timings++;
+}
+
+/*
+ * Print boot timing log (Time Stamp Counter must be calibrated).
+ */
+static void print_boot_timings()
+{
+	uint64_t prev = boot_start_cycles;
+	int i;
+
+	for (i = 0; i < nr_boot_timings; i++) {
+		printf("[Kernel] Boot timing: %s %u us (total %u us)\n", boot_timings[i].name,
+		       cycles_to_usecs(boot_timings[i].cycles - prev), cycles_to_usecs(boot_timings[i].cycles - boot_start_cycles));
+		prev = boot_timings[i].cycles;
+	}
+}
+
 /*
  * Devices names.
  */
@@ -227,6 +274,8 @@ static void kinit()
 	if (init_rtl8139())
 		printf("[Kernel] Realtek 8139 card Init error\n");
 
+	boot_timing("devices");
+
 	/* init block devices */
 	printf("[Kernel] Bock devices Init\n");
 	init_blk_dev();
@@ -236,11 +285,26 @@ static void kinit()
 	if (init_ata())
 		printf("[Kernel] ATA devices Init error\n");
 
+	/* init ahci devices */
+	printf("[Kernel] AHCI devices Init\n");
+	if (init_ahci())
+		printf("[Kernel] AHCI devices Init error\n");
+
+	/* init virtio block devices */
+	printf("[Kernel] Virtio block devices Init\n");
+	if (init_virtio_blk())
+		printf("[Kernel] Virtio block devices Init error\n");
+
 	/* init loop devices */
 	printf("[Kernel] Loop devices Init\n");
 	if (init_loop())
 		printf("[Kernel] Loop devices Init error\n");
 
+	/* init compressed ram devices */
+	printf("[Kernel] Zram devices Init\n");
+	if (init_zram())
+		printf("[Kernel] Zram devices Init error\n");
+
 	/* init frame buffer */
 	printf("[Kernel] Frame buffer Init\n");
 	if (init_framebuffer_device(&tag_fb))
@@ -251,6 +315,8 @@ static void kinit()
 	if (init_tty(&tag_fb))
 		panic("Cannot init ttys\n");
 
+	boot_timing("block devices and ttys");
+
 	/* init binary formats */
 	printf("[Kernel] Binary formats Init\n");
 	init_binfmt();
@@ -283,18 +349,25 @@ static void kinit()
 	if (init_net_dev())
 		panic("Cannot init network devices\n");
 
+	boot_timing("file systems and network");
+
 	/* mount root file system */
 	printf("[Kernel] Root file system init\n");
 	if (do_mount_root(root_dev, root_dev_name, root_mountflags))
 		panic("Cannot mount root file system\n");
+	boot_timing("root file system");
 
 	/* spawn init process */
 	if (spawn_init())
 		panic("Cannot spawn init process\n");
+	boot_timing("init process");
+	print_boot_timings();
 
 	/* create kernel threads */
+	kernel_thread(&kblockd, NULL, CLONE_FS | CLONE_FILES | CLONE_SIGHAND, "kblockd");
 	kernel_thread(&bdflush, NULL, CLONE_FS | CLONE_FILES | CLONE_SIGHAND, "bdflush");
 	kernel_thread(&net_handle, NULL, CLONE_FS | CLONE_FILES | CLONE_SIGHAND, "net_handle");
+	kernel_thread(&ksmd, NULL, CLONE_FS | CLONE_FILES | CLONE_SIGHAND, "ksmd");
 
 	/* sleep forever */
 	for (;;) {
@@ -302,6 +375,11 @@ static void kinit()
 		if (need_resched)
 			schedule();
 
+		/* use idle time to init deferred pages and to pre zero pages */
+		if (!need_resched)
+			deferred_init_pages();
+		refill_zeroed_pages();
+
 		halt();
 	}
 }
@@ -316,6 +394,7 @@ int kmain(uint32_t mbi_magic, uint32_t mbi_addr)
 
 	/* disable interrupts */
 	irq_disable();
+	boot_start_cycles = get_cycles();
 
 	/* init serial console */
 	init_serial();
@@ -343,6 +422,7 @@ int kmain(uint32_t mbi_magic, uint32_t mbi_addr)
 	/* init memory */
 	printf("[Kernel] Memory Init\n");
 	init_mem((uint32_t) &kernel_start, (uint32_t) &kernel_end, mem_upper);
+	boot_timing("memory");
 
 	/* init inodes */
 	printf("[Kernel] Inodes init\n");
@@ -360,6 +440,8 @@ int kmain(uint32_t mbi_magic, uint32_t mbi_addr)
 	printf("[Kernel] IPC resources init\n");
 	init_ipc();
 
+	boot_timing("caches and ipc");
+
 	/* init PIT */
 	printf("[Kernel] PIT Init\n");
 	init_pit();
@@ -372,6 +454,8 @@ int kmain(uint32_t mbi_magic, uint32_t mbi_addr)
 	printf("[Kernel] System calls Init\n");
 	init_syscall();
 
+	boot_timing("timers and system calls");
+
 	/* init processes */
 	printf("[Kernel] Processes Init\n");
 	if (init_scheduler(kinit))
@@ -1,6 +1,7 @@
 #include <ipc/shm.h>
 #include <proc/sched.h>
 #include <fs/tmp_fs.h>
+#include <mm/highmem.h>
 #include <stdio.h>
 #include <stderr.h>
 #include <fcntl.h>
@@ -54,6 +55,10 @@ static void shm_inc(int id)
 {
 	struct shmid_kernel *shp;
 
+	/* memfd : no segment */
+	if (id < 0)
+		return;
+
 	/* get segment */
 	shp = (struct shmid_kernel *) ipc_get(&shm_ids, id);
 	if (!shp)
@@ -81,6 +86,10 @@ void shm_close(struct vm_area *vma)
 	struct file *filp = vma->vm_file;
 	struct shmid_kernel *shp;
 
+	/* memfd : no segment */
+	if (filp->f_dentry->d_inode->u.tmp_i.i_shmid < 0)
+		return;
+
 	/* get segment */
 	shp = (struct shmid_kernel *) ipc_get(&shm_ids, filp->f_dentry->d_inode->u.tmp_i.i_shmid);
 	if (!shp)
@@ -128,8 +137,12 @@ static struct page *shm_nopage(struct vm_area *vma, uint32_t address)
 
 	/* get page and add it to cache */
 	page = &page_array[MAP_NR(new_page)];
-	add_to_page_cache(page, inode, offset);
+	if (add_to_page_cache(page, inode, offset)) {
+		free_page((void *) new_page);
+		return NULL;
+	}
 
+	SetPageUptodate(page);
 	return page;
 }
 
@@ -149,6 +162,10 @@ static int shm_mmap(struct file *filp, struct vm_area *vma)
 {
 	struct inode *inode = filp->f_dentry->d_inode;
 
+	/* write sealed : no shared writable mapping */
+	if ((vma->vm_flags & (VM_SHARED | VM_WRITE)) == (VM_SHARED | VM_WRITE) && (inode->u.tmp_i.i_seals & F_SEAL_WRITE))
+		return -EPERM;
+
 	/* update inode */
 	update_atime(inode);
 	vma->vm_ops = &shm_vm_ops;
@@ -159,13 +176,90 @@ static int shm_mmap(struct file *filp, struct vm_area *vma)
 	return 0;
 }
 
+/*
+ * Shared memory write (memfd).
+ */
+static int shm_file_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
+{
+	struct inode *inode = filp->f_dentry->d_inode;
+	off_t pos;
+	int ret;
+
+	/* write sealed */
+	if (inode->u.tmp_i.i_seals & F_SEAL_WRITE)
+		return -EPERM;
+
+	/* grow sealed */
+	pos = (filp->f_flags & O_APPEND) ? (off_t) inode->i_size : *ppos;
+	ret = shm_check_size(inode, pos + count);
+	if (ret)
+		return ret;
+
+	return generic_file_write(filp, buf, count, ppos);
+}
+
 /*
  * Shared memory file operations.
  */
 static struct file_operations shm_fops = {
+	.read		= generic_file_read,
+	.write		= shm_file_write,
 	.mmap		= shm_mmap,
 };
 
+/*
+ * Read a shared memory page (pages never written are zero filled).
+ */
+static int shm_readpage(struct inode *inode, struct page *page)
+{
+	UNUSED(inode);
+
+	clear_user_highpage(page);
+	kunmap(page);
+	SetPageUptodate(page);
+
+	return 0;
+}
+
+/*
+ * Prepare a shared memory page write.
+ */
+static int shm_prepare_write(struct inode *inode, struct page *page, uint32_t from, uint32_t to)
+{
+	UNUSED(inode);
+	UNUSED(page);
+	UNUSED(from);
+	UNUSED(to);
+
+	return 0;
+}
+
+/*
+ * Commit a shared memory page write (no backing store : page stays clean).
+ */
+static int shm_commit_write(struct inode *inode, struct page *page, uint32_t from, uint32_t to)
+{
+	UNUSED(inode);
+	UNUSED(from);
+	UNUSED(to);
+
+	UnlockPage(page);
+	kunmap(page);
+	SetPageUptodate(page);
+
+	return 0;
+}
+
+/*
+ * Shared memory inode operations.
+ */
+static struct inode_operations shm_iops = {
+	.fops		= &shm_fops,
+	.readpage	= shm_readpage,
+	.prepare_write	= shm_prepare_write,
+	.commit_write	= shm_commit_write,
+};
+
 /*
  * Get a new shared memory inode.
  */
@@ -181,6 +275,8 @@ static struct inode *shm_get_inode(struct super_block *sb, mode_t mode, dev_t de
 	/* set inode */
 	inode->i_shm = 1;
 	inode->i_size = size;
+	inode->i_op = &shm_iops;
+	inode->u.tmp_i.i_seals = F_SEAL_SEAL;
 
 	return inode;
 }
@@ -552,6 +648,128 @@ int sys_shmctl(int shmid, int cmd, struct shmid_ds *buf)
 	}
 }
 
+/*
+ * Check a new size against memfd seals.
+ */
+int shm_check_size(struct inode *inode, off_t length)
+{
+	/* not a shared memory file */
+	if (!inode->i_shm)
+		return 0;
+
+	if (length < (off_t) inode->i_size && (inode->u.tmp_i.i_seals & F_SEAL_SHRINK))
+		return -EPERM;
+	if (length > (off_t) inode->i_size && (inode->u.tmp_i.i_seals & F_SEAL_GROW))
+		return -EPERM;
+
+	return 0;
+}
+
+/*
+ * Check if a shared memory file is write sealed.
+ */
+int shm_write_sealed(struct inode *inode)
+{
+	return inode->i_shm && (inode->u.tmp_i.i_seals & F_SEAL_WRITE);
+}
+
+/*
+ * Add seals to a memfd.
+ */
+static int shm_add_seals(struct inode *inode, int seals)
+{
+	struct vm_area *vma;
+
+	/* check seals */
+	if (seals & ~(F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE))
+		return -EINVAL;
+
+	/* sealing is sealed */
+	if (inode->u.tmp_i.i_seals & F_SEAL_SEAL)
+		return -EPERM;
+
+	/* write seal : no shared writable mapping must exist */
+	if ((seals & F_SEAL_WRITE) && !(inode->u.tmp_i.i_seals & F_SEAL_WRITE))
+		for (vma = inode->i_mmap; vma != NULL; vma = vma->vm_next_share)
+			if ((vma->vm_flags & (VM_SHARED | VM_WRITE)) == (VM_SHARED | VM_WRITE))
+				return -EBUSY;
+
+	inode->u.tmp_i.i_seals |= seals;
+	return 0;
+}
+
+/*
+ * Memfd fcntl (get/add seals).
+ */
+int shm_fcntl(struct file *filp, int cmd, unsigned long arg)
+{
+	struct inode *inode;
+
+	/* only memfds can be sealed */
+	if (!filp->f_dentry || !filp->f_dentry->d_inode || !filp->f_dentry->d_inode->i_shm)
+		return -EINVAL;
+
+	/* get inode */
+	inode = filp->f_dentry->d_inode;
+
+	switch (cmd) {
+		case F_GET_SEALS:
+			return inode->u.tmp_i.i_seals;
+		case F_ADD_SEALS:
+			if (!(filp->f_mode & FMODE_WRITE))
+				return -EPERM;
+			return shm_add_seals(inode, arg);
+		default:
+			return -EINVAL;
+	}
+}
+
+/*
+ * Create an anonymous shared memory file.
+ */
+int sys_memfd_create(const char *uname, unsigned int flags)
+{
+	char name[MFD_NAME_MAX + 7];
+	struct inode *inode;
+	struct file *filp;
+	int fd;
+
+	/* check flags */
+	if (flags & ~(MFD_CLOEXEC | MFD_ALLOW_SEALING))
+		return -EINVAL;
+
+	/* check name */
+	if (!uname || strnlen(uname, MFD_NAME_MAX + 1) > MFD_NAME_MAX)
+		return -EINVAL;
+
+	/* get a file slot */
+	fd = get_unused_fd();
+	if (fd < 0)
+		return fd;
+
+	/* set up file */
+	sprintf(name, "memfd:%s", uname);
+	filp = shm_file_setup(name, 0);
+	if (IS_ERR(filp))
+		return PTR_ERR(filp);
+
+	/* unlinked inode : released on last close */
+	inode = filp->f_dentry->d_inode;
+	inode->i_nlinks = 0;
+	if (flags & MFD_ALLOW_SEALING)
+		inode->u.tmp_i.i_seals = 0;
+
+	/* install file */
+	filp->f_flags = O_RDWR;
+	current_task->files->filp[fd] = filp;
+	if (flags & MFD_CLOEXEC)
+		FD_SET(fd, &current_task->files->close_on_exec);
+	else
+		FD_CLR(fd, &current_task->files->close_on_exec);
+
+	return fd;
+}
+
 /*
  * Init IPC shared memory segments.
  */
@@ -241,9 +241,9 @@ static int kill_something_info(pid_t pid, int sig, siginfo_t *info)
 }
 
 /*
- * Signal return trampoline (this code is executed in user mode).
+ * Signal return trampoline (this code is executed in user mode, so it lives in the only user readable kernel section).
  */
-static int sigreturn()
+static int __attribute__((section(".usertext"))) sigreturn()
 {
 	int ret;
 
@@ -0,0 +1,221 @@
+#include <lib/lz4.h>
+#include <string.h>
+
+#define MINMATCH	4						/* minimum match length */
+#define MFLIMIT		12						/* last match must start before end - MFLIMIT */
+#define LASTLITERALS	5						/* last bytes are always literals */
+#define ML_BITS		4						/* match length bits in token */
+#define ML_MASK		((1 << ML_BITS) - 1)
+#define RUN_MASK	((1 << (8 - ML_BITS)) - 1)
+#define MAX_DISTANCE	0xFFFF						/* maximum match offset */
+
+/*
+ * Read 32 bits (little endian, unaligned).
+ */
+static inline uint32_t lz4_read32(const uint8_t *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*
+ * Hash a 4 bytes sequence.
+ */
+static inline uint32_t lz4_hash(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/*
+ * Write a length continuation (255 bytes run + remainder).
+ */
+static inline uint8_t *lz4_write_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+/*
+ * Compress a block in LZ4 block format (returns compressed size or 0 if output buffer is too small).
+ */
+size_t lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, void *wrkmem)
+{
+	const uint8_t *ip = src, *anchor = src, *iend = src + src_len, *ref, *match_start;
+	const uint8_t *mflimit = iend - MFLIMIT, *matchlimit = iend - LASTLITERALS;
+	uint8_t *op = dst, *oend = dst + dst_len, *token;
+	uint16_t *hash_table = wrkmem;
+	size_t lit_len, match_len;
+	uint32_t h;
+
+	/* hash table stores 16 bits positions */
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return 0;
+
+	/* too small input : only literals */
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	/* reset hash table and insert first position */
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	while (ip < mflimit) {
+		/* find a match candidate */
+		h = lz4_hash(lz4_read32(ip));
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+		if (ip - ref > MAX_DISTANCE || lz4_read32(ref) != lz4_read32(ip)) {
+			ip++;
+			continue;
+		}
+
+		/* extend match backwards */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* check output space (token + literals + offset + last literals) */
+		lit_len = ip - anchor;
+		if (op + 1 + lit_len / 255 + 1 + lit_len + 2 + 1 + LASTLITERALS > oend)
+			return 0;
+
+		/* encode literals length */
+		token = op++;
+		if (lit_len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_write_length(op, lit_len - RUN_MASK);
+		} else {
+			*token = lit_len << ML_BITS;
+		}
+
+		/* copy literals */
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+
+		/* encode offset */
+		*op++ = (ip - ref) & 0xFF;
+		*op++ = (ip - ref) >> 8;
+
+		/* find match length */
+		match_start = ip;
+		ip += MINMATCH;
+		ref += MINMATCH;
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		/* encode match length */
+		match_len = ip - match_start - MINMATCH;
+		if (op + match_len / 255 + 1 + 1 + LASTLITERALS > oend)
+			return 0;
+		if (match_len >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_write_length(op, match_len - ML_MASK);
+		} else {
+			*token |= match_len;
+		}
+
+		/* next sequence starts here */
+		anchor = ip;
+
+		/* insert last match position */
+		if (ip - 2 > src)
+			hash_table[lz4_hash(lz4_read32(ip - 2))] = ip - 2 - src;
+	}
+
+last_literals:
+	/* check output space */
+	lit_len = iend - anchor;
+	if (op + 1 + lit_len / 255 + 1 + lit_len > oend)
+		return 0;
+
+	/* encode last literals */
+	if (lit_len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, lit_len - RUN_MASK);
+	} else {
+		*op++ = lit_len << ML_BITS;
+	}
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	return op - dst;
+}
+
+/*
+ * Read a length continuation.
+ */
+static inline int lz4_read_length(const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do {
+		if (*ip >= iend)
+			return -1;
+
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/*
+ * Decompress a LZ4 block (returns decompressed size or -1 on malformed input).
+ */
+int lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+	const uint8_t *ip = src, *iend = src + src_len, *ref;
+	uint8_t *op = dst, *oend = dst + dst_len, token;
+	size_t len, offset;
+
+	for (;;) {
+		/* get token */
+		if (ip >= iend)
+			return -1;
+		token = *ip++;
+
+		/* get literals length */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && lz4_read_length(&ip, iend, &len))
+			return -1;
+
+		/* copy literals */
+		if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* get offset */
+		if (iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (size_t) (op - dst))
+			return -1;
+		ref = op - offset;
+
+		/* get match length */
+		len = token & ML_MASK;
+		if (len == ML_MASK && lz4_read_length(&ip, iend, &len))
+			return -1;
+		len += MINMATCH;
+		if (len > (size_t) (oend - op))
+			return -1;
+
+		/* copy match (byte per byte : match may overlap output) */
+		while (len--)
+			*op++ = *ref++;
+	}
+
+	return op - dst;
+}
@@ -0,0 +1,469 @@
+#include <lib/radix_tree.h>
+#include <mm/mm.h>
+#include <string.h>
+#include <stderr.h>
+
+/* maximum index for each tree height */
+static uint32_t height_to_maxindex[RADIX_TREE_MAX_HEIGHT + 1] = {
+	0x00000000,
+	0x0000003F,
+	0x00000FFF,
+	0x0003FFFF,
+	0x00FFFFFF,
+	0x3FFFFFFF,
+	0xFFFFFFFF,
+};
+
+/*
+ * Set a tag in a node.
+ */
+static inline void node_tag_set(struct radix_tree_node *node, int tag, int offset)
+{
+	node->tags[tag][offset / 32] |= (1 << (offset % 32));
+}
+
+/*
+ * Clear a tag in a node.
+ */
+static inline void node_tag_clear(struct radix_tree_node *node, int tag, int offset)
+{
+	node->tags[tag][offset / 32] &= ~(1 << (offset % 32));
+}
+
+/*
+ * Test a tag in a node.
+ */
+static inline int node_tag_get(struct radix_tree_node *node, int tag, int offset)
+{
+	return (node->tags[tag][offset / 32] >> (offset % 32)) & 1;
+}
+
+/*
+ * Check if any tag is set in a node.
+ */
+static inline int node_any_tag_set(struct radix_tree_node *node, int tag)
+{
+	int i;
+
+	for (i = 0; i < RADIX_TREE_TAG_LONGS; i++)
+		if (node->tags[tag][i])
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Allocate a radix tree node.
+ */
+static struct radix_tree_node *radix_tree_node_alloc()
+{
+	struct radix_tree_node *node;
+
+	node = (struct radix_tree_node *) kmalloc(sizeof(struct radix_tree_node));
+	if (node)
+		memset(node, 0, sizeof(struct radix_tree_node));
+
+	return node;
+}
+
+/*
+ * Extend a radix tree so it can store index.
+ */
+static int radix_tree_extend(struct radix_tree_root *root, uint32_t index)
+{
+	struct radix_tree_node *node;
+	uint32_t height;
+	int tag;
+
+	/* compute needed height */
+	for (height = root->height + 1; index > height_to_maxindex[height]; height++);
+
+	/* empty tree : just update height */
+	if (!root->rnode) {
+		root->height = height;
+		return 0;
+	}
+
+	/* add new levels on top */
+	while (root->height < height) {
+		node = radix_tree_node_alloc();
+		if (!node)
+			return -ENOMEM;
+
+		/* propagate tags */
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+			if (node_any_tag_set(root->rnode, tag))
+				node_tag_set(node, tag, 0);
+
+		node->slots[0] = root->rnode;
+		node->count = 1;
+		root->rnode = node;
+		root->height++;
+	}
+
+	return 0;
+}
+
+/*
+ * Insert an item in a radix tree.
+ */
+int radix_tree_insert(struct radix_tree_root *root, uint32_t index, void *item)
+{
+	struct radix_tree_node *node = NULL, **slot;
+	uint32_t height, shift, offset;
+	int ret;
+
+	/* extend tree if needed */
+	if (!root->height || index > height_to_maxindex[root->height]) {
+		ret = radix_tree_extend(root, index);
+		if (ret)
+			return ret;
+	}
+
+	/* walk down the tree */
+	slot = &root->rnode;
+	height = root->height;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	while (height > 0) {
+		/* create missing node */
+		if (!*slot) {
+			*slot = radix_tree_node_alloc();
+			if (!*slot)
+				return -ENOMEM;
+
+			if (node)
+				node->count++;
+		}
+
+		/* go to next level */
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		node = *slot;
+		slot = (struct radix_tree_node **) &node->slots[offset];
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	/* item already present */
+	if (*slot)
+		return -EEXIST;
+
+	/* set item */
+	*slot = item;
+	node->count++;
+
+	return 0;
+}
+
+/*
+ * Lookup an item in a radix tree.
+ */
+void *radix_tree_lookup(struct radix_tree_root *root, uint32_t index)
+{
+	struct radix_tree_node *node = root->rnode;
+	uint32_t height = root->height, shift;
+
+	/* index out of range */
+	if (!node || index > height_to_maxindex[height])
+		return NULL;
+
+	/* walk down the tree */
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	while (height > 1) {
+		node = node->slots[(index >> shift) & RADIX_TREE_MAP_MASK];
+		if (!node)
+			return NULL;
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return node->slots[index & RADIX_TREE_MAP_MASK];
+}
+
+/*
+ * Shrink a radix tree height.
+ */
+static void radix_tree_shrink(struct radix_tree_root *root)
+{
+	struct radix_tree_node *node;
+
+	while (root->height > 1) {
+		node = root->rnode;
+
+		/* root node covers more than first slot */
+		if (node->count != 1 || !node->slots[0])
+			break;
+
+		/* first child becomes root */
+		root->rnode = node->slots[0];
+		root->height--;
+		kfree(node);
+	}
+}
+
+/*
+ * Walk a radix tree and remember the path to index.
+ */
+static void *radix_tree_path(struct radix_tree_root *root, uint32_t index, struct radix_tree_node **nodes, int *offsets)
+{
+	struct radix_tree_node *node = root->rnode;
+	uint32_t height = root->height, shift;
+	int i = 0;
+
+	/* index out of range */
+	if (!node || index > height_to_maxindex[height])
+		return NULL;
+
+	/* walk down the tree */
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	for (;;) {
+		nodes[i] = node;
+		offsets[i] = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (--height == 0)
+			break;
+
+		node = node->slots[offsets[i]];
+		if (!node)
+			return NULL;
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		i++;
+	}
+
+	return nodes[i]->slots[offsets[i]];
+}
+
+/*
+ * Clear a tag along a path (parents are cleared only if child has no more tags).
+ */
+static void radix_tree_path_clear_tag(struct radix_tree_node **nodes, int *offsets, int depth, int tag)
+{
+	int i;
+
+	for (i = depth; i >= 0; i--) {
+		node_tag_clear(nodes[i], tag, offsets[i]);
+		if (i > 0 && node_any_tag_set(nodes[i], tag))
+			break;
+	}
+}
+
+/*
+ * Delete an item from a radix tree.
+ */
+void *radix_tree_delete(struct radix_tree_root *root, uint32_t index)
+{
+	struct radix_tree_node *nodes[RADIX_TREE_MAX_HEIGHT];
+	int offsets[RADIX_TREE_MAX_HEIGHT];
+	int depth, tag, i;
+	void *item;
+
+	/* find item */
+	item = radix_tree_path(root, index, nodes, offsets);
+	if (!item)
+		return NULL;
+
+	/* clear tags */
+	depth = root->height - 1;
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+		if (node_tag_get(nodes[depth], tag, offsets[depth]))
+			radix_tree_path_clear_tag(nodes, offsets, depth, tag);
+
+	/* clear slot and free empty nodes */
+	nodes[depth]->slots[offsets[depth]] = NULL;
+	for (i = depth; i >= 0; i--) {
+		if (--nodes[i]->count)
+			break;
+
+		kfree(nodes[i]);
+		if (i > 0)
+			nodes[i - 1]->slots[offsets[i - 1]] = NULL;
+	}
+
+	/* tree is empty */
+	if (i < 0) {
+		root->rnode = NULL;
+		root->height = 0;
+		return item;
+	}
+
+	/* shrink tree */
+	radix_tree_shrink(root);
+
+	return item;
+}
+
+/*
+ * Replace an item (tags are kept, returns old item or NULL if index is not present).
+ */
+void *radix_tree_replace(struct radix_tree_root *root, uint32_t index, void *item)
+{
+	struct radix_tree_node *nodes[RADIX_TREE_MAX_HEIGHT];
+	int offsets[RADIX_TREE_MAX_HEIGHT];
+	void *old;
+
+	/* find item */
+	old = radix_tree_path(root, index, nodes, offsets);
+	if (!old)
+		return NULL;
+
+	/* replace it */
+	nodes[root->height - 1]->slots[offsets[root->height - 1]] = item;
+
+	return old;
+}
+
+/*
+ * Tag an item.
+ */
+void *radix_tree_tag_set(struct radix_tree_root *root, uint32_t index, int tag)
+{
+	struct radix_tree_node *nodes[RADIX_TREE_MAX_HEIGHT];
+	int offsets[RADIX_TREE_MAX_HEIGHT];
+	void *item;
+	int i;
+
+	/* find item */
+	item = radix_tree_path(root, index, nodes, offsets);
+	if (!item)
+		return NULL;
+
+	/* set tag on the whole path */
+	for (i = 0; i < (int) root->height; i++)
+		node_tag_set(nodes[i], tag, offsets[i]);
+
+	return item;
+}
+
+/*
+ * Untag an item.
+ */
+void *radix_tree_tag_clear(struct radix_tree_root *root, uint32_t index, int tag)
+{
+	struct radix_tree_node *nodes[RADIX_TREE_MAX_HEIGHT];
+	int offsets[RADIX_TREE_MAX_HEIGHT];
+	void *item;
+
+	/* find item */
+	item = radix_tree_path(root, index, nodes, offsets);
+	if (!item)
+		return NULL;
+
+	/* clear tag */
+	radix_tree_path_clear_tag(nodes, offsets, root->height - 1, tag);
+
+	return item;
+}
+
+/*
+ * Test if an item is tagged.
+ */
+int radix_tree_tag_get(struct radix_tree_root *root, uint32_t index, int tag)
+{
+	struct radix_tree_node *node = root->rnode;
+	uint32_t height = root->height, shift;
+	int offset;
+
+	/* index out of range */
+	if (!node || index > height_to_maxindex[height])
+		return 0;
+
+	/* walk down the tree */
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	for (;;) {
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (!node_tag_get(node, tag, offset))
+			return 0;
+		if (--height == 0)
+			return 1;
+
+		node = node->slots[offset];
+		shift -= RADIX_TREE_MAP_SHIFT;
+	}
+}
+
+/*
+ * Check if any item of a radix tree is tagged.
+ */
+int radix_tree_tagged(struct radix_tree_root *root, int tag)
+{
+	return root->rnode && node_any_tag_set(root->rnode, tag);
+}
+
+/*
+ * Find first item (optionally tagged) with index >= index, in a sub tree starting at base.
+ */
+static void *radix_tree_next(struct radix_tree_node *node, uint32_t shift, uint32_t base, uint32_t index, int tag, uint32_t *found)
+{
+	uint32_t first, child_base;
+	void *item;
+	int i;
+
+	first = (index - base) >> shift;
+	for (i = first; i < RADIX_TREE_MAP_SIZE; i++) {
+		/* empty or untagged slot */
+		if (!node->slots[i])
+			continue;
+		if (tag >= 0 && !node_tag_get(node, tag, i))
+			continue;
+
+		/* leaf */
+		child_base = base + (i << shift);
+		if (!shift) {
+			*found = child_base;
+			return node->slots[i];
+		}
+
+		/* look in child */
+		item = radix_tree_next(node->slots[i], shift - RADIX_TREE_MAP_SHIFT, child_base, (uint32_t) i == first ? index : child_base, tag, found);
+		if (item)
+			return item;
+	}
+
+	return NULL;
+}
+
+/*
+ * Lookup (optionally tagged) items, starting at first_index.
+ */
+static uint32_t __radix_tree_gang_lookup(struct radix_tree_root *root, void **results, uint32_t first_index, uint32_t max_items, int tag)
+{
+	uint32_t index = first_index, found, nr = 0;
+	void *item;
+
+	/* empty tree */
+	if (!root->rnode)
+		return 0;
+
+	while (nr < max_items && index <= height_to_maxindex[root->height]) {
+		/* find next item */
+		item = radix_tree_next(root->rnode, (root->height - 1) * RADIX_TREE_MAP_SHIFT, 0, index, tag, &found);
+		if (!item)
+			break;
+
+		results[nr++] = item;
+
+		/* end of index space */
+		if (found == 0xFFFFFFFF)
+			break;
+
+		index = found + 1;
+	}
+
+	return nr;
+}
+
+/*
+ * Lookup items, starting at first_index.
+ */
+uint32_t radix_tree_gang_lookup(struct radix_tree_root *root, void **results, uint32_t first_index, uint32_t max_items)
+{
+	return __radix_tree_gang_lookup(root, results, first_index, max_items, -1);
+}
+
+/*
+ * Lookup tagged items, starting at first_index.
+ */
+uint32_t radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results, uint32_t first_index, uint32_t max_items, int tag)
+{
+	return __radix_tree_gang_lookup(root, results, first_index, max_items, tag);
+}
@@ -1,4 +1,5 @@
 #include <grub/multiboot2.h>
+#include <mm/paging.h>
 #include <string.h>
 #include <stdio.h>
 #include <stderr.h>
@@ -9,8 +10,8 @@
  * Bios map structure.
  */
 struct bios_map {
-	uint32_t	start;
-	uint32_t	end;
+	uint64_t	start;
+	uint64_t	end;
 	int 		type;
 };
 
@@ -21,7 +22,7 @@ static size_t nr_entries = 0;
 /*
  * Is an address available ?
  */
-int bios_map_address_available(uint32_t addr)
+int bios_map_address_available(uint64_t addr)
 {
 	int ret = 0;
 	size_t n;
@@ -40,7 +41,7 @@ int bios_map_address_available(uint32_t addr)
 /*
  * Add an entry.
  */
-int bios_map_add_entry(uint32_t start, uint32_t end, int type)
+int bios_map_add_entry(uint64_t start, uint64_t end, int type)
 {
 	/* no available entry */
 	if (nr_entries >= NR_BIOS_MAP_ENTRIES)
@@ -55,37 +56,41 @@ int bios_map_add_entry(uint32_t start, uint32_t end, int type)
 	return 0;
 }
 
+/*
+ * Get first page frame after available memory.
+ */
+uint32_t bios_map_end_pfn()
+{
+	uint64_t end = 0;
+	size_t n;
+
+	for (n = 0; n < nr_entries; n++)
+		if (bios_map[n].type == MULTIBOOT_MEMORY_AVAILABLE && bios_map[n].end > end)
+			end = bios_map[n].end;
+
+	/* limit to 32 bits page frame numbers */
+	end >>= PAGE_SHIFT;
+	return end > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t) end;
+}
+
 /*
  * Init bios map.
  */
 void init_bios_map(struct multiboot_tag_mmap *mbi_mmap)
 {
-	uint32_t start_low, start_high, end_low, end_high, i;
 	struct multiboot_mmap_entry *entry;
-	uint64_t end;
+	uint8_t *end;
 
 	/* reset bios map */
 	memset(bios_map, 0, sizeof(struct bios_map) * NR_BIOS_MAP_ENTRIES);
 
-	/* for each entry */
-	for (i = 0; i < mbi_mmap->entry_size; i++) {
-		entry = &mbi_mmap->entries[i];
-
-		/* compute start address */
-		start_low = entry->addr & 0xFFFFFFFF;
-		start_high = entry->addr >> 32;
-
-		/* compute end address */
-		end = entry->addr + entry->len;
-		end_low = end & 0xFFFFFFFF;
-		end_high = end >> 32;
-
-		/* add mapping */
-		if (!start_high && !end_high && nr_entries < NR_BIOS_MAP_ENTRIES) {
-			bios_map[nr_entries].start = start_low;
-			bios_map[nr_entries].end = end_low;
-			bios_map[nr_entries].type = entry->type;
-			nr_entries++;
-		}
+	/* for each entry (entries above 4 GB are kept : they are used with PAE) */
+	end = (uint8_t *) mbi_mmap + mbi_mmap->size;
+	for (entry = mbi_mmap->entries; (uint8_t *) entry < end && nr_entries < NR_BIOS_MAP_ENTRIES;
+	     entry = (struct multiboot_mmap_entry *) ((uint8_t *) entry + mbi_mmap->entry_size)) {
+		bios_map[nr_entries].start = entry->addr;
+		bios_map[nr_entries].end = entry->addr + entry->len;
+		bios_map[nr_entries].type = entry->type;
+		nr_entries++;
 	}
 }
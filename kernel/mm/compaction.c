@@ -0,0 +1,299 @@
+#include <mm/compaction.h>
+#include <mm/highmem.h>
+#include <mm/mm.h>
+#include <mm/paging.h>
+#include <lib/radix_tree.h>
+#include <fs/fs.h>
+#include <proc/sched.h>
+#include <kernel_stat.h>
+#include <stderr.h>
+#include <string.h>
+
+#define COMPACT_MAX_PAGES		128			/* largest block compaction can assemble */
+
+/*
+ * Candidate block.
+ */
+struct compact_window {
+	uint32_t		start;				/* first page */
+	uint32_t		nr_movable;			/* number of pages to migrate */
+};
+
+/*
+ * Check if a page can be migrated (page tables references are checked later).
+ */
+static int page_movable(struct page *page, int zone)
+{
+	/* wrong zone, reserved or free page */
+	if (page->priority != zone || PageReserved(page) || page->count <= 0)
+		return 0;
+
+	/* page under i/o, with buffers or mapped in kernel space */
+	if (PageLocked(page) || PageWriteback(page) || page->buffers || page->virtual)
+		return 0;
+
+	/* cached page must be the one referenced by the cache */
+	if (page->inode && radix_tree_lookup(&page->inode->i_pages, PAGE_INDEX(page->offset)) != page)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Check if a memory descriptor has already been walked (threads share their memory descriptor).
+ */
+static int mm_walked(struct task *task)
+{
+	struct list_head *pos;
+	struct task *prev;
+
+	list_for_each(pos, &tasks_list) {
+		prev = list_entry(pos, struct task, list);
+		if (prev == task)
+			return 0;
+		if (prev->mm == task->mm)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Walk user page tables : count mappings of pages [start, start + n[ or remap them to new pages.
+ */
+static void walk_window_ptes(uint32_t start, uint32_t n, uint16_t *mapcount, struct page **new_pages)
+{
+	uint32_t address, nr, remapped;
+	struct vm_area *vma;
+	struct list_head *pos;
+	struct task *task;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	list_for_each(pos, &tasks_list) {
+		task = list_entry(pos, struct task, list);
+
+		/* kernel threads and shared memory descriptors */
+		if (!task->mm || task->mm->pgd == pgd_kernel || mm_walked(task))
+			continue;
+
+		remapped = 0;
+		for (vma = task->mm->mmap; vma != NULL; vma = vma->vm_next) {
+			for (address = vma->vm_start; address < vma->vm_end; address += PAGE_SIZE) {
+				/* no page table or large page : skip page table */
+				pmd = pmd_offset(pgd_offset(task->mm->pgd, address), address);
+				if (pmd_none(*pmd) || pmd_huge(*pmd)) {
+					address = (address & PMD_MASK) + PMD_SIZE - PAGE_SIZE;
+					continue;
+				}
+
+				/* page not in window */
+				pte = pte_offset(pmd, address);
+				if (!pte_present(*pte))
+					continue;
+				nr = pte_page(*pte) - page_array;
+				if (nr < start || nr >= start + n)
+					continue;
+
+				/* count or remap */
+				if (!new_pages) {
+					mapcount[nr - start]++;
+				} else if (new_pages[nr - start]) {
+					*pte = mk_pte(new_pages[nr - start], pte_prot(*pte));
+					remapped++;
+				}
+			}
+		}
+
+		/* flush remapped pages */
+		if (remapped)
+			flush_tlb(task->mm->pgd);
+	}
+}
+
+/*
+ * Check that all references of window pages are known (page tables and page cache).
+ */
+static int window_movable(uint32_t start, uint32_t n)
+{
+	uint16_t mapcount[COMPACT_MAX_PAGES];
+	struct page *page;
+	uint32_t i;
+	int expected;
+
+	/* count page tables references */
+	memset(mapcount, 0, sizeof(uint16_t) * n);
+	walk_window_ptes(start, n, mapcount, NULL);
+
+	for (i = 0; i < n; i++) {
+		/* free page */
+		page = &page_array[start + i];
+		if (!page->count)
+			continue;
+
+		/* unknown reference (kernel, i/o, pinned page) */
+		expected = mapcount[i] + (page->inode ? 1 : 0);
+		if (!expected || page->count != expected || !page_movable(page, page->priority))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Migrate used pages of a window and free the whole window.
+ */
+static int migrate_window(uint32_t start, uint32_t n)
+{
+	struct page *new_pages[COMPACT_MAX_PAGES], *old, *new;
+	uint32_t i, j, nr_isolated, nr_used = 0, nr_migrated = 0;
+	uint8_t isolated[COMPACT_MAX_PAGES];
+
+	/* take free pages of the window out of free lists */
+	memset(new_pages, 0, sizeof(struct page *) * n);
+	memset(isolated, 0, n);
+	nr_isolated = isolate_free_range(start, start + n, isolated);
+
+	/* allocate new pages (outside window) */
+	for (i = 0; i < n; i++) {
+		old = &page_array[start + i];
+		if (!old->count)
+			continue;
+
+		new_pages[i] = __get_free_pages_noreclaim(old->priority, 0);
+		if (!new_pages[i])
+			goto err;
+		nr_used++;
+	}
+
+	/* unused pages must all be free */
+	if (nr_isolated + nr_used != n)
+		goto err;
+
+	/* copy pages */
+	for (i = 0; i < n; i++) {
+		old = &page_array[start + i];
+		new = new_pages[i];
+		if (!new)
+			continue;
+
+		copy_user_highpage(new, old);
+		new->inode = old->inode;
+		new->offset = old->offset;
+		new->flags = old->flags;
+		new->count = old->count;
+
+		/* replace page in cache */
+		if (old->inode)
+			radix_tree_replace(&old->inode->i_pages, PAGE_INDEX(old->offset), new);
+
+		/* clear old page */
+		old->inode = NULL;
+		old->offset = 0;
+		old->flags = 0;
+		old->count = 0;
+		nr_migrated++;
+	}
+
+	/* remap user pages */
+	walk_window_ptes(start, n, NULL, new_pages);
+
+	/* give back whole window */
+	release_free_range(start, n);
+	kstat.compact_migrated += nr_migrated;
+
+	return 0;
+err:
+	for (i = 0; i < n; i++)
+		if (new_pages[i])
+			__free_page(new_pages[i]);
+
+	/* give back isolated pages (free pages are scattered in window : release each run) */
+	for (i = 0; i < n; i = j) {
+		for (j = i; j < n && isolated[j]; j++);
+		release_free_range(start + i, j - i);
+		if (j == i)
+			j++;
+	}
+
+	return -ENOMEM;
+}
+
+/*
+ * Find candidate windows in a zone (blocks with only free and movable pages, fewest movable pages first).
+ */
+static uint32_t find_windows(int zone, uint32_t n, struct compact_window *windows)
+{
+	uint32_t start, i, free_end = 0, nr_movable, nr_windows = 0, j;
+	struct page *page;
+	size_t size;
+
+	for (start = 0; start + n <= nr_pages; start += n) {
+		for (i = start, nr_movable = 0; i < start + n; i++) {
+			page = &page_array[i];
+
+			/* free page (free blocks may span windows) */
+			size = free_block_size(page);
+			if (size)
+				free_end = i + size;
+			if (i < free_end && page->priority == zone)
+				continue;
+
+			/* unmovable page */
+			if (!page_movable(page, zone))
+				break;
+
+			nr_movable++;
+		}
+
+		/* unmovable page found or window already free */
+		if (i < start + n || !nr_movable)
+			continue;
+
+		/* insert window, sorted by number of movable pages */
+		for (j = nr_windows; j > 0 && windows[j - 1].nr_movable > nr_movable; j--)
+			if (j < COMPACT_MAX_WINDOWS)
+				windows[j] = windows[j - 1];
+		if (j >= COMPACT_MAX_WINDOWS)
+			continue;
+
+		windows[j].start = start;
+		windows[j].nr_movable = nr_movable;
+		if (nr_windows < COMPACT_MAX_WINDOWS)
+			nr_windows++;
+	}
+
+	return nr_windows;
+}
+
+/*
+ * Compact a zone to get a free block of 2^order pages (returns 1 on success).
+ */
+int compact_zone_order(int zone, uint32_t order)
+{
+	struct compact_window windows[COMPACT_MAX_WINDOWS];
+	uint32_t n = 1 << order, nr_windows, i;
+
+	/* too large block */
+	if (!order || n > COMPACT_MAX_PAGES)
+		return 0;
+
+	/* find candidates */
+	kstat.compact_stall++;
+	nr_windows = find_windows(zone, n, windows);
+
+	/* try to migrate candidates */
+	for (i = 0; i < nr_windows; i++) {
+		/* not enough free pages outside window (kernel pages can't be replaced by high memory pages) */
+		if (nr_free_zone_pages(zone) < n + windows[i].nr_movable)
+			break;
+
+		if (window_movable(windows[i].start, n) && migrate_window(windows[i].start, n) == 0) {
+			kstat.compact_success++;
+			return 1;
+		}
+	}
+
+	kstat.compact_fail++;
+	return 0;
+}
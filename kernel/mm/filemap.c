@@ -3,12 +3,19 @@
 #include <mm/highmem.h>
 #include <mm/swap.h>
 #include <drivers/block/blk_dev.h>
+#include <x86/uaccess.h>
 #include <proc/sched.h>
+#include <kernel_stat.h>
 #include <fcntl.h>
 #include <stderr.h>
 #include <stdio.h>
 
-#define MAX_READ_AHEAD_PAGES		32
+#define PAGEVEC_SIZE			16
+
+/* maximum read ahead window (in pages) */
+int sysctl_max_readahead = DEFAULT_READ_AHEAD_PAGES;
+
+static uint32_t do_page_cache_readahead(struct inode *inode, uint32_t start, uint32_t nr_pages, uint32_t marker);
 
 /*
  * Get a page from cache or create it.
@@ -28,7 +35,10 @@ static struct page *grab_cache_page(struct inode *inode, off_t offset)
 		return NULL;
 
 	/* add it to cache */
-	add_to_page_cache(page, inode, offset);
+	if (add_to_page_cache(page, inode, offset)) {
+		__free_page(page);
+		return NULL;
+	}
 
 	return page;
 }
@@ -50,11 +60,23 @@ static struct page *filemap_nopage(struct vm_area *vma, uint32_t address)
 	if (offset >= inode->i_size)
 		return NULL;
 
+	/* cache miss : major fault */
+	if (!radix_tree_lookup(&inode->i_pages, PAGE_INDEX(offset))) {
+		current_task->maj_flt++;
+
+		/* sequential hint : read ahead a window */
+		if (vma->vm_flags & VM_SEQ_READ)
+			do_page_cache_readahead(inode, PAGE_INDEX(offset), 2 * sysctl_max_readahead, 0xFFFFFFFF);
+	}
+
 	/* get page */
 	page = grab_cache_page(inode, offset);
 	if (!page)
 		return NULL;
 
+	/* wait for read ahead i/o */
+	wait_on_page(page);
+
 	/* page up to date */
 	if (PageUptodate(page))
 		return page;
@@ -78,6 +100,63 @@ err_kmap:
 	return NULL;
 }
 
+/*
+ * Map pages already cached and up to date around a faulting address (start and end must be in the same page table).
+ */
+static void filemap_map_pages(struct vm_area *vma, uint32_t start, uint32_t end)
+{
+	struct inode *inode = vma->vm_file->f_dentry->d_inode;
+	struct page *pages[PAGEVEC_SIZE], *page;
+	uint32_t offset, address, nr, i;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	/* get page table */
+	pmd = pmd_offset(pgd_offset(vma->vm_mm->pgd, start), start);
+	if (pmd_none(*pmd))
+		return;
+
+	while (start < end) {
+		/* stop at end of file */
+		offset = start - vma->vm_start + vma->vm_offset;
+		if (offset >= inode->i_size)
+			break;
+
+		/* find cached pages */
+		nr = (end - start) >> PAGE_SHIFT;
+		if (nr > PAGEVEC_SIZE)
+			nr = PAGEVEC_SIZE;
+		nr = find_get_pages(inode, offset, nr, pages);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			page = pages[i];
+
+			/* compute virtual address */
+			address = page->offset - vma->vm_offset + vma->vm_start;
+			if (page->offset >= inode->i_size || address >= end)
+				goto next;
+
+			/* page not ready or already mapped */
+			pte = pte_offset(pmd, address);
+			if (!pte_none(*pte) || !PageUptodate(page) || PageLocked(page))
+				goto next;
+
+			/* map page (keep reference) */
+			*pte = mk_pte(page, vma->vm_page_prot);
+			vma->vm_mm->rss++;
+			kstat.fault_around_pages++;
+			continue;
+next:
+			__free_page(page);
+		}
+
+		/* go to next pages */
+		start = pages[nr - 1]->offset - vma->vm_offset + vma->vm_start + PAGE_SIZE;
+	}
+}
+
 /*
  * Write a page.
  */
@@ -86,6 +165,9 @@ static int filemap_writepage(struct vm_area *vma, struct page *page)
 	struct inode *inode = vma->vm_file->f_dentry->d_inode;
 	int ret;
 
+	/* wait for page i/o */
+	wait_on_page(page);
+
 	/* map page in kernel address space */
 	if (!kmap(page))
 		return -ENOMEM;
@@ -117,7 +199,7 @@ static int filemap_sync_pte(pte_t *pte, struct vm_area *vma, uint32_t address, u
 		return 0;
 
 	if (!pte_present(*pte)) {
-		swap_free(*pte);
+		swap_free(pte_to_swp_entry(*pte));
 		return 0;
 	}
 
@@ -174,7 +256,7 @@ static int filemap_sync_pmd_range(pgd_t *pgd, uint32_t address, size_t size, str
 	int ret = 0;
 	pmd_t *pmd;
 
-	pmd = pmd_offset(pgd);
+	pmd = pmd_offset(pgd, address);
 	offset = address & PGDIR_MASK;
 	address &= ~PGDIR_MASK;
 	end = address + size;
@@ -233,7 +315,9 @@ static int filemap_swapout(struct vm_area *vma, struct page *page)
 static struct vm_operations file_shared_mmap = {
 	.unmap		= filemap_unmap,
 	.nopage		= filemap_nopage,
+	.map_pages	= filemap_map_pages,
 	.swapout	= filemap_swapout,
+	.sync		= filemap_sync,
 };
 
 /*
@@ -241,6 +325,7 @@ static struct vm_operations file_shared_mmap = {
  */
 static struct vm_operations file_private_mmap = {
 	.nopage		= filemap_nopage,
+	.map_pages	= filemap_map_pages,
 };
 
 /*
@@ -251,21 +336,16 @@ int generic_file_mmap(struct file *filp, struct vm_area *vma)
 	struct inode *inode = filp->f_dentry->d_inode;
 	struct vm_operations *ops;
 
+	/* offset must be page aligned (page cache is indexed by page) */
+	if (vma->vm_offset & (PAGE_SIZE - 1))
+		return -EINVAL;
+
 	/* choose operations */
-	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_WRITE)) {
+	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_WRITE))
 		ops = &file_shared_mmap;
-
-		/* offset must be page aligned */
-		if (vma->vm_offset & (PAGE_SIZE - 1))
-			return -EINVAL;
-	} else {
+	else
 		ops = &file_private_mmap;
 
-		/* offset must be block aligned */
-		if (vma->vm_offset & (inode->i_sb->s_blocksize - 1))
-			return -EINVAL;
-	}
-
 	/* inode must be a regular file */
 	if (!inode->i_sb || !S_ISREG(inode->i_mode))
 		return -EACCES;
@@ -284,58 +364,225 @@ int generic_file_mmap(struct file *filp, struct vm_area *vma)
 }
 
 /*
- * Read ahead some pages = try to grab maximum up to date ahead pages.
+ * Read ahead pages [start, start + nr_pages[ (marker page is tagged to trigger next asynchronous read ahead).
  */
-static int generic_file_readahead(struct inode *inode, off_t page_offset, size_t max_pages)
+static uint32_t do_page_cache_readahead(struct inode *inode, uint32_t start, uint32_t nr_pages, uint32_t marker)
 {
-	struct page *page, *pages_list[MAX_READ_AHEAD_PAGES];
-	size_t nr_pages_read = 0, i;
+	uint32_t last_index, index, nr_read = 0;
+	struct page *page;
+
+	/* empty file */
+	if (!inode->i_size)
+		return 0;
 
-	/* limit max pages */
-	if (max_pages > MAX_READ_AHEAD_PAGES)
-		max_pages = MAX_READ_AHEAD_PAGES;
+	/* do not read beyond end of file */
+	last_index = (inode->i_size - 1) >> PAGE_SHIFT;
+	if (start > last_index)
+		return 0;
+	if (nr_pages > last_index - start + 1)
+		nr_pages = last_index - start + 1;
 
-	/* read */
-	for (i = 0; i < max_pages; i++, page_offset += PAGE_SIZE) {
-		/* get page */
-		page = grab_cache_page(inode, page_offset);
+	for (index = start; index < start + nr_pages; index++) {
+		/* page already cached */
+		page = radix_tree_lookup(&inode->i_pages, index);
+		if (page)
+			continue;
+
+		/* get a new page (read ahead is optional : don't kill tasks for it) */
+		page = __get_free_page(GFP_HIGHUSER | __GFP_NORETRY);
 		if (!page)
 			break;
 
-		/* page up to date */
-		if (PageUptodate(page))
-			goto next;
-
-		/* map page in kernel address space */
-		if (!kmap(page)) {
+		/* add it to cache */
+		if (add_to_page_cache(page, inode, (off_t) index << PAGE_SHIFT)) {
 			__free_page(page);
 			break;
 		}
 
-		/* read page */
+		/* map page in kernel address space */
+		if (!kmap(page))
+			goto err;
+
+		/* read page (do not wait for completion) */
 		if (inode->i_op->readpage(inode, page)) {
 			kunmap(page);
-			__free_page(page);
-			break;
+			goto err;
 		}
 
-		/* page must be read */
-		nr_pages_read++;
-next:
-		pages_list[i] = page;
+		/* set marker */
+		if (index == marker)
+			SetPageReadahead(page);
+
+		__free_page(page);
+		nr_read++;
+		continue;
+err:
+		remove_from_page_cache(page);
+		__free_page(page);
+		__free_page(page);
+		break;
 	}
 
-	/* no way to get a page */
-	if (i == 0)
-		return -EINVAL;
+	/* update statistics */
+	kstat.ra_pages += nr_read;
+
+	return nr_read;
+}
+
+/*
+ * Get initial read ahead window size.
+ */
+static uint32_t get_init_ra_size(uint32_t req_size, uint32_t max)
+{
+	uint32_t size = 1;
+
+	/* round up request size to power of 2 */
+	while (size < req_size)
+		size <<= 1;
+
+	/* small requests get a bigger window */
+	if (size <= max / 32)
+		size <<= 2;
+	else if (size <= max / 4)
+		size <<= 1;
 
-	/* release pages */
-	while (i--) {
-		wait_on_page(pages_list[i]);
-		__free_page(pages_list[i]);
+	return size < max ? size : max;
+}
+
+/*
+ * Get next read ahead window size (ramp up).
+ */
+static uint32_t get_next_ra_size(struct file_ra_state *ra, uint32_t max)
+{
+	uint32_t size = ra->size;
+
+	if (size < max / 16)
+		size <<= 2;
+	else
+		size <<= 1;
+
+	return size < max ? size : max;
+}
+
+/*
+ * Submit current read ahead window.
+ */
+static void ra_submit(struct inode *inode, struct file_ra_state *ra)
+{
+	uint32_t marker = ra->start + ra->size - ra->async_size;
+
+	/* no asynchronous part = no marker */
+	if (!ra->async_size)
+		marker = 0xFFFFFFFF;
+
+	do_page_cache_readahead(inode, ra->start, ra->size, marker);
+}
+
+/*
+ * Get maximum read ahead window (sequential hint doubles it).
+ */
+static inline uint32_t ra_max_size(struct file_ra_state *ra)
+{
+	if (ra->flags & RA_FLAG_SEQUENTIAL)
+		return 2 * sysctl_max_readahead;
+
+	return sysctl_max_readahead;
+}
+
+/*
+ * Synchronous read ahead = page index is not cached.
+ */
+static void page_cache_sync_readahead(struct file *filp, struct inode *inode, uint32_t index, uint32_t req_size)
+{
+	struct file_ra_state *ra = &filp->f_ra;
+	uint32_t max = ra_max_size(ra);
+
+	/* limit request size */
+	if (req_size > max)
+		req_size = max;
+
+	if (ra->flags & RA_FLAG_RANDOM) {
+		/* random hint : read request only */
+		ra->size = req_size;
+		ra->async_size = 0;
+	} else if (!index || (ra->size && (index == ra->prev_index + 1 || index == ra->start + ra->size))) {
+		/* sequential access : ramp up window */
+		ra->size = ra->size ? get_next_ra_size(ra, max) : get_init_ra_size(req_size, max);
+		if (ra->size < req_size)
+			ra->size = req_size;
+		ra->async_size = ra->size - req_size;
+	} else {
+		/* random access : shrink window to request size */
+		ra->size = req_size;
+		ra->async_size = 0;
 	}
 
-	return 0;
+	/* read window */
+	ra->start = index;
+	ra_submit(inode, ra);
+}
+
+/*
+ * Asynchronous read ahead = marker page has been hit.
+ */
+static void page_cache_async_readahead(struct file *filp, struct inode *inode, uint32_t index)
+{
+	struct file_ra_state *ra = &filp->f_ra;
+	uint32_t max = ra_max_size(ra);
+
+	/* random hint : no read ahead */
+	if (ra->flags & RA_FLAG_RANDOM)
+		return;
+
+	/* marker from another window (file shared or seek) : restart from here */
+	if (index != ra->start + ra->size - ra->async_size) {
+		ra->start = index;
+		ra->size = 0;
+	}
+
+	/* push window forward */
+	ra->start += ra->size;
+	ra->size = ra->size ? get_next_ra_size(ra, max) : get_init_ra_size(1, max);
+	ra->async_size = ra->size;
+	ra_submit(inode, ra);
+
+	/* update statistics */
+	kstat.ra_async++;
+}
+
+/*
+ * Force read ahead of pages [index, index + nr_pages[ (used by madvise and fadvise).
+ */
+uint32_t force_page_cache_readahead(struct inode *inode, uint32_t index, uint32_t nr_pages)
+{
+	uint32_t last_index, chunk, ret = 0;
+
+	/* inode must implement readpage */
+	if (!inode->i_op || !inode->i_op->readpage || !inode->i_size)
+		return 0;
+
+	/* do not read beyond end of file */
+	last_index = (inode->i_size - 1) >> PAGE_SHIFT;
+	if (index > last_index)
+		return 0;
+	if (nr_pages > last_index - index + 1)
+		nr_pages = last_index - index + 1;
+
+	while (nr_pages) {
+		/* do not eat all free memory */
+		if (nr_free_pages() < 2 * SWAP_CLUSTER_MAX)
+			break;
+
+		/* read a chunk */
+		chunk = nr_pages < (uint32_t) sysctl_max_readahead ? nr_pages : (uint32_t) sysctl_max_readahead;
+		ret += do_page_cache_readahead(inode, index, chunk, 0xFFFFFFFF);
+
+		/* go to next chunk */
+		index += chunk;
+		nr_pages -= chunk;
+	}
+
+	return ret;
 }
 
 /*
@@ -345,10 +592,11 @@ int generic_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 {
 	off_t offset, page_offset;
 	int read = 0, ret = 0;
+	uint32_t index;
 	struct inode *inode;
 	struct page *page;
+	size_t nr, left;
 	char *kaddr;
-	size_t nr;
 
 	/* check inode */
 	if (!filp->f_dentry || !filp->f_dentry->d_inode)
@@ -366,30 +614,61 @@ int generic_file_read(struct file *filp, char *buf, size_t count, off_t *ppos)
 		/* compute offset in page */
 		page_offset = *ppos & PAGE_MASK;
 		offset = *ppos & ~PAGE_MASK;
+		index = PAGE_INDEX(*ppos);
 		nr = PAGE_SIZE - offset;
 		if (nr > count)
 			nr = count;
 
-repeat:
 		/* try to find page in cache */
 		page = find_page(inode, page_offset);
-		if (page)
-			goto found_page;
+		if (page) {
+			kstat.ra_hits++;
+		} else {
+			kstat.ra_misses++;
+
+			/* read ahead some pages */
+			page_cache_sync_readahead(filp, inode, index, PAGE_INDEX(*ppos + count - 1) - index + 1);
+
+			/* page must be cached now */
+			page = find_page(inode, page_offset);
+			if (!page) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		/* marker reached : read next window */
+		if (PageReadahead(page)) {
+			ClearPageReadahead(page);
+			page_cache_async_readahead(filp, inode, index);
+		}
 
-		/* try to read some pages */
-		ret = generic_file_readahead(inode, page_offset, ((*ppos + count) >> PAGE_SHIFT) - (*ppos >> PAGE_SHIFT) + 1);
-		if (ret)
+		/* wait for page */
+		wait_on_page(page);
+		if (!PageUptodate(page)) {
+			__free_page(page);
+			ret = -EIO;
 			break;
+		}
 
-		goto repeat;
-found_page:
-		/* copy to user buffer */
-		kaddr = kmap(page);
-		memcpy(buf, kaddr + offset, nr);
-		kunmap(page);
+		/* copy to user buffer (user page taken away meanwhile : copy again with a sleeping mapping) */
+		fault_in_pages(buf, nr, 1);
+		kaddr = kmap_atomic(page, KM_USER_COPY);
+		left = copy_to_user_inatomic(buf, kaddr + offset, nr);
+		kunmap_atomic(kaddr, KM_USER_COPY);
+		if (left) {
+			kaddr = kmap(page);
+			left = copy_to_user(buf, kaddr + offset, nr);
+			kunmap(page);
+		}
 
 		/* release page */
 		__free_page(page);
+		if (left) {
+			ret = -EFAULT;
+			break;
+		}
+		filp->f_ra.prev_index = index;
 
 		/* update sizes */
 		buf += nr;
@@ -404,12 +683,40 @@ found_page:
 	return read ? read : ret;
 }
 
+/*
+ * Read a page synchronously (page beyond end of file is zero filled).
+ */
+static int filemap_read_page(struct inode *inode, struct page *page)
+{
+	/* page beyond end of file */
+	if (page->offset >= inode->i_size) {
+		clear_user_highpage(page);
+		SetPageUptodate(page);
+		return 0;
+	}
+
+	/* map page in kernel address space */
+	if (!kmap(page))
+		return -ENOMEM;
+
+	/* read page */
+	if (inode->i_op->readpage(inode, page)) {
+		kunmap(page);
+		return -EIO;
+	}
+
+	/* wait for completion */
+	wait_on_page(page);
+
+	return PageUptodate(page) ? 0 : -EIO;
+}
+
 /*
  * Generic file write.
  */
 int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *ppos)
 {
-	struct page *page, *tmp = NULL;
+	struct page *page;
 	int written = 0, ret = 0;
 	struct inode *inode;
 	off_t offset;
@@ -446,6 +753,18 @@ int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *
 			break;
 		}
 
+		/* wait for page i/o */
+		wait_on_page(page);
+
+		/* partial write : make page up to date first */
+		if (!PageUptodate(page) && nr != PAGE_SIZE) {
+			ret = filemap_read_page(inode, page);
+			if (ret) {
+				__free_page(page);
+				break;
+			}
+		}
+
 		/* lock page */
 		LockPage(page);
 
@@ -470,7 +789,6 @@ int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *
 		}
 
 		/* release page */
-		tmp = page;
 		__free_page(page);
 
 		/* update sizes */
@@ -480,11 +798,10 @@ int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *
 		count -= nr;
 		if (*ppos > inode->i_size)
 			inode->i_size = *ppos;
-	}
 
-	/* execute block requests */
-	if (tmp)
-		wait_on_page(tmp);
+		/* throttle heavy writers */
+		balance_dirty_pages();
+	}
 
 	/* update inode */
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
@@ -498,47 +815,100 @@ int generic_file_write(struct file *filp, const char *buf, size_t count, off_t *
  */
 void invalidate_inode_pages(struct inode *inode)
 {
-	struct list_head *pos, *n;
-	struct page *page;
+	struct page *pages[PAGEVEC_SIZE];
+	uint32_t nr, i, index = 0;
 
-	list_for_each_safe(pos, n, &inode->i_pages) {
-		page = list_entry(pos, struct page, list);
+	while ((nr = radix_tree_gang_lookup(&inode->i_pages, (void **) pages, index, PAGEVEC_SIZE)) > 0) {
+		for (i = 0; i < nr; i++) {
+			index = PAGE_INDEX(pages[i]->offset) + 1;
 
-		/* page locked */
-		if (PageLocked(page))
-			continue;
+			/* page locked or dirty */
+			if (PageLocked(pages[i]) || PageDirty(pages[i]))
+				continue;
 
-		/* remove page from cache */
-		remove_from_page_cache(page);
-		page->inode = NULL;
-		__free_page(page);
+			/* remove page from cache */
+			remove_from_page_cache(pages[i]);
+			pages[i]->inode = NULL;
+			__free_page(pages[i]);
+		}
 	}
 }
 
+/*
+ * Drop clean and unused cached pages [start_index, end_index] (returns number of dropped pages).
+ */
+uint32_t invalidate_mapping_pages(struct inode *inode, uint32_t start_index, uint32_t end_index)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	uint32_t nr, i, index = start_index, ret = 0;
+
+	/* shared memory pages are the only copy of data */
+	if (inode->i_shm == 1)
+		return 0;
+
+	while (index <= end_index && (nr = radix_tree_gang_lookup(&inode->i_pages, (void **) pages, index, PAGEVEC_SIZE)) > 0) {
+		for (i = 0; i < nr; i++) {
+			index = PAGE_INDEX(pages[i]->offset);
+			if (index > end_index)
+				break;
+
+			/* page locked, dirty or mapped */
+			if (PageLocked(pages[i]) || PageDirty(pages[i]) || pages[i]->count > 1)
+				continue;
+
+			/* remove page from cache */
+			remove_from_page_cache(pages[i]);
+			pages[i]->inode = NULL;
+			__free_page(pages[i]);
+			ret++;
+		}
+
+		/* end of index space */
+		if (index == 0xFFFFFFFF || i < nr)
+			break;
+		index++;
+	}
+
+	kstat.pginvalidate += ret;
+	return ret;
+}
+
 /*
  * Truncate inode pages.
  */
 void truncate_inode_pages(struct inode *inode, off_t start)
 {
-	struct list_head *pos, *n;
-	struct page *page;
+	struct page *pages[PAGEVEC_SIZE], *page;
+	uint32_t nr, i, index;
 	off_t offset;
 
-	list_for_each_safe(pos, n, &inode->i_pages) {
-		page = list_entry(pos, struct page, list);
-		offset = page->offset;
+	/* partial page truncate */
+	offset = start & ~PAGE_MASK;
+	if (offset) {
+		page = radix_tree_lookup(&inode->i_pages, PAGE_INDEX(start));
+		if (page)
+			clear_user_highpage_partial(page, offset);
+	}
+
+	/* full pages truncate */
+	index = PAGE_INDEX(start + PAGE_SIZE - 1);
+	while ((nr = find_get_pages(inode, (off_t) index << PAGE_SHIFT, PAGEVEC_SIZE, pages)) > 0) {
+		for (i = 0; i < nr; i++) {
+			page = pages[i];
+			index = PAGE_INDEX(page->offset) + 1;
+
+			/* wait for end of i/o */
+			wait_on_page(page);
+			wait_on_page_writeback(page);
+
+			/* remove page from cache (unless it was removed while we were sleeping) */
+			if (radix_tree_lookup(&inode->i_pages, PAGE_INDEX(page->offset)) == page) {
+				remove_from_page_cache(page);
+				__free_page(page);
+			}
 
-		/* full page truncate */
-		if (offset >= start) {
-			remove_from_page_cache(page);
 			__free_page(page);
-			continue;
 		}
-
-		/* partial page truncate */
-		offset = start - offset;
-		if (offset < PAGE_SIZE)
-			clear_user_highpage_partial(page, offset);
 	}
 }
 
@@ -564,6 +934,10 @@ int shrink_mmap(int priority)
 		if (page->count > 1)
 			continue;
 
+		/* skip pages under i/o and dirty pages */
+		if (PageLocked(page) || PageDirty(page))
+			continue;
+
 		/* skip shared memory pages */
 		if (page->inode && page->inode->i_shm == 1)
 			continue;
@@ -576,6 +950,12 @@ int shrink_mmap(int priority)
 			continue;
 		}
 
+		/* free swap cached page and its swap entry */
+		if (PageSwapCache(page)) {
+			delete_from_swap_cache(page);
+			return 1;
+		}
+
 		/* free cached page */
 		if (page->inode) {
 			remove_from_page_cache(page);
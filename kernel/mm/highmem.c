@@ -8,6 +8,7 @@ static uint32_t last_pkmap_nr = LAST_PKMAP;
 static int pkmap_count[LAST_PKMAP];
 struct page *highmem_start_page;
 pte_t *pkmap_page_table;
+pte_t *fixmap_page_table;
 
 /*
  * Clear unused virtual mapping.
@@ -37,10 +38,10 @@ static void flush_all_zero_pkmaps()
 		/* clear entry */
 		pte_clear(&pkmap_page_table[i]);
 		page->virtual = NULL;
-	}
 
-	/* flush tlb */
-	flush_tlb(current_task->mm->pgd);
+		/* flush tlb */
+		flush_tlb_kernel_page(PKMAP_ADDR(i));
+	}
 }
 
 /*
@@ -79,7 +80,7 @@ static uint32_t map_new_virtual(struct page *page)
 	pkmap_count[last_pkmap_nr] = 1;
 
 	/* flush TLB */
-	flush_tlb_page(current_task->mm->pgd, vaddr);
+	flush_tlb_kernel_page(vaddr);
 
 	return vaddr;
 }
@@ -127,14 +128,61 @@ void kunmap(struct page *page)
 	pkmap_count[PKMAP_NR(vaddr)]--;
 }
 
+/*
+ * Map a page in kernel address space for a short time (no reference counting : one fixed slot per type).
+ */
+void *kmap_atomic(struct page *page, enum km_type type)
+{
+	uint32_t vaddr;
+
+	/* low memory page : already mapped */
+	if (page < highmem_start_page)
+		return page_address(page);
+
+	/* set slot */
+	vaddr = FIX_KMAP_ADDR(type);
+	fixmap_page_table[type] = mk_pte(page, PAGE_KERNEL);
+	flush_tlb_kernel_page(vaddr);
+
+	return (void *) vaddr;
+}
+
+/*
+ * Unmap an atomic mapping (slot is just left for next user, which will flush it).
+ */
+void kunmap_atomic(void *kvaddr, enum km_type type)
+{
+	UNUSED(kvaddr);
+	UNUSED(type);
+}
+
+/*
+ * Fault in a buffer (so that a copy through an atomic mapping won't fault).
+ */
+void fault_in_pages(const char *buf, size_t size, int write)
+{
+	volatile char *p = (volatile char *) buf, *end = (volatile char *) buf + size;
+	char c;
+
+	while (p < end) {
+		/* touch page */
+		c = *p;
+		if (write)
+			*p = c;
+
+		/* go to next page */
+		p = (volatile char *) (PAGE_ALIGN_DOWN((uint32_t) p) + PAGE_SIZE);
+	}
+}
+
 /*
  * Clear a user high page.
  */
 void clear_user_highpage(struct page *page)
 {
-	char *vpage = kmap(page);
+	char *vpage = kmap_atomic(page, KM_USER0);
 	memset(vpage, 0, PAGE_SIZE);
-	kunmap(page);
+	kunmap_atomic(vpage, KM_USER0);
 }
 
 /*
@@ -142,9 +190,9 @@ void clear_user_highpage(struct page *page)
  */
 void clear_user_highpage_partial(struct page *page, off_t offset)
 {
-	char *vpage = kmap(page);
+	char *vpage = kmap_atomic(page, KM_USER0);
 	memset(vpage + offset, 0, PAGE_SIZE - offset);
-	kunmap(page);
+	kunmap_atomic(vpage, KM_USER0);
 }
 
 /*
@@ -155,13 +203,13 @@ void copy_user_highpage(struct page *dst, struct page *src)
 	char *vdst, *vsrc;
 
 	/* map pages in kernel adress space */
-	vdst = kmap(dst);
-	vsrc = kmap(src);
+	vdst = kmap_atomic(dst, KM_USER0);
+	vsrc = kmap_atomic(src, KM_USER1);
 
 	/* copy page */
 	memcpy(vdst, vsrc, PAGE_SIZE);
 
 	/* unmap pages */
-	kunmap(src);
-	kunmap(dst);
+	kunmap_atomic(vsrc, KM_USER1);
+	kunmap_atomic(vdst, KM_USER0);
 }
@@ -0,0 +1,422 @@
+#include <mm/ksm.h>
+#include <mm/highmem.h>
+#include <mm/mm.h>
+#include <mm/mmap.h>
+#include <mm/paging.h>
+#include <proc/sched.h>
+#include <x86/interrupt.h>
+#include <kernel_stat.h>
+#include <string.h>
+#include <time.h>
+
+#define KSM_HASH_BITS			8
+#define KSM_HASH_SIZE			(1 << KSM_HASH_BITS)
+#define KSM_HASH_MASK			(KSM_HASH_SIZE - 1)
+
+/* tunables */
+int sysctl_ksm_run = KSM_RUN_STOP;
+int sysctl_ksm_pages_to_scan = 100;
+int sysctl_ksm_sleep_millisecs = 20;
+
+/*
+ * Merged page (write protected in all page tables, holds an extra reference).
+ */
+struct ksm_stable_node {
+	uint32_t		checksum;			/* page checksum */
+	struct page *		page;				/* merged page */
+	struct list_head	list;				/* next node in hash bucket */
+};
+
+/*
+ * Candidate page seen during current scan (no reference : page is checked again on match).
+ */
+struct ksm_rmap_item {
+	uint32_t		checksum;			/* page checksum */
+	struct page *		page;				/* candidate page */
+	struct list_head	list;				/* next item in hash bucket */
+};
+
+/* stable and unstable tables */
+static struct list_head ksm_stable_table[KSM_HASH_SIZE];
+static struct list_head ksm_unstable_table[KSM_HASH_SIZE];
+static int ksm_tables_initialized = 0;
+
+/* scan cursor */
+static pid_t ksm_scan_pid = 0;
+static uint32_t ksm_scan_address = 0;
+
+/*
+ * Compute checksum of a page.
+ */
+static uint32_t ksm_checksum(struct page *page)
+{
+	uint32_t *addr, checksum = 5381;
+	int i;
+
+	addr = kmap_atomic(page, KM_USER0);
+	for (i = 0; i < PAGE_SIZE / 4; i++)
+		checksum = ((checksum << 5) + checksum) ^ addr[i];
+	kunmap_atomic(addr, KM_USER0);
+
+	return checksum;
+}
+
+/*
+ * Check if two pages are identical.
+ */
+static int ksm_same_page(struct page *page1, struct page *page2)
+{
+	void *addr1, *addr2;
+	int ret;
+
+	addr1 = kmap_atomic(page1, KM_USER0);
+	addr2 = kmap_atomic(page2, KM_USER1);
+	ret = memcmp(addr1, addr2, PAGE_SIZE) == 0;
+	kunmap_atomic(addr2, KM_USER1);
+	kunmap_atomic(addr1, KM_USER0);
+
+	return ret;
+}
+
+/*
+ * Find a merged page identical to a page.
+ */
+static struct ksm_stable_node *ksm_stable_search(struct page *page, uint32_t checksum)
+{
+	struct ksm_stable_node *node;
+	struct list_head *pos;
+
+	list_for_each(pos, &ksm_stable_table[checksum & KSM_HASH_MASK]) {
+		node = list_entry(pos, struct ksm_stable_node, list);
+		if (node->checksum == checksum && (node->page == page || ksm_same_page(node->page, page)))
+			return node;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find a candidate page identical to a page.
+ */
+static struct ksm_rmap_item *ksm_unstable_search(struct page *page, uint32_t checksum)
+{
+	struct ksm_rmap_item *item;
+	struct list_head *pos;
+
+	list_for_each(pos, &ksm_unstable_table[checksum & KSM_HASH_MASK]) {
+		item = list_entry(pos, struct ksm_rmap_item, list);
+		if (item->checksum != checksum || item->page == page)
+			continue;
+
+		/* candidate page may have been freed or reused since it was seen */
+		if (item->page->count <= 0 || item->page->inode || PageReserved(item->page))
+			continue;
+
+		if (ksm_same_page(item->page, page))
+			return item;
+	}
+
+	return NULL;
+}
+
+/*
+ * Add a page to unstable table.
+ */
+static void ksm_unstable_insert(struct page *page, uint32_t checksum)
+{
+	struct ksm_rmap_item *item;
+
+	item = (struct ksm_rmap_item *) kmalloc(sizeof(struct ksm_rmap_item));
+	if (!item)
+		return;
+
+	item->checksum = checksum;
+	item->page = page;
+	list_add(&item->list, &ksm_unstable_table[checksum & KSM_HASH_MASK]);
+}
+
+/*
+ * Turn a page into a merged page.
+ */
+static void ksm_stable_insert(struct vm_area *vma, uint32_t address, pte_t *pte, struct page *page, uint32_t checksum)
+{
+	struct ksm_stable_node *node;
+
+	node = (struct ksm_stable_node *) kmalloc(sizeof(struct ksm_stable_node));
+	if (!node)
+		return;
+
+	/* write protect page (next write will copy it) */
+	*pte = pte_wrprotect(*pte);
+	flush_tlb_page(vma->vm_mm->pgd, address);
+
+	/* keep a reference on merged page */
+	SetPageKsm(page);
+	page->count++;
+
+	node->checksum = checksum;
+	node->page = page;
+	list_add(&node->list, &ksm_stable_table[checksum & KSM_HASH_MASK]);
+}
+
+/*
+ * Map a merged page instead of a page.
+ */
+static void ksm_merge_pte(struct vm_area *vma, uint32_t address, pte_t *pte, struct page *kpage)
+{
+	struct page *page = pte_page(*pte);
+
+	/* map merged page read only */
+	*pte = pte_wrprotect(mk_pte(kpage, pte_prot(*pte)));
+	kpage->count++;
+	flush_tlb_page(vma->vm_mm->pgd, address);
+
+	/* release old page */
+	__free_page(page);
+	kstat.ksm_merged++;
+}
+
+/*
+ * Check if a memory region can be scanned.
+ */
+static int ksm_vma_mergeable(struct vm_area *vma)
+{
+	if (vma->vm_flags & VM_SHARED)
+		return 0;
+
+	return sysctl_ksm_run == KSM_RUN_ALL || (vma->vm_flags & VM_MERGEABLE);
+}
+
+/*
+ * Scan a page table entry (returns 1 if a page has been examined).
+ */
+static int ksm_scan_pte(struct vm_area *vma, uint32_t address, pte_t *pte)
+{
+	struct ksm_stable_node *node;
+	struct page *page;
+	uint32_t checksum;
+
+	/* page not present */
+	if (!pte_present(*pte))
+		return 0;
+
+	/* only anonymous pages */
+	page = pte_page(*pte);
+	if (!VALID_PAGE(page) || PageReserved(page) || page->inode)
+		return 0;
+
+	/* already merged, in swap cache or under i/o */
+	if (PageKsm(page) || PageSwapCache(page) || PageLocked(page))
+		return 0;
+
+	/* merge with an identical merged page */
+	checksum = ksm_checksum(page);
+	node = ksm_stable_search(page, checksum);
+	if (node) {
+		ksm_merge_pte(vma, address, pte, node->page);
+		return 1;
+	}
+
+	/* identical candidate page : promote this page (candidate will be merged on next scan) */
+	if (page->count == 1 && ksm_unstable_search(page, checksum)) {
+		ksm_stable_insert(vma, address, pte, page, checksum);
+		return 1;
+	}
+
+	/* remember page */
+	ksm_unstable_insert(page, checksum);
+	return 1;
+}
+
+/*
+ * Check if a task address space must be scanned (threads sharing an address space are scanned once).
+ */
+static int ksm_task_scannable(struct task *task)
+{
+	struct list_head *pos;
+	struct task *other;
+
+	/* kernel threads */
+	if (!task->mm || task->mm->pgd == pgd_kernel || task->state == TASK_ZOMBIE)
+		return 0;
+
+	list_for_each(pos, &tasks_list) {
+		other = list_entry(pos, struct task, list);
+		if (other != task && other->mm == task->mm && other->pid < task->pid)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Find next task to scan (lowest pid greater or equal to pid).
+ */
+static struct task *ksm_next_task(pid_t pid)
+{
+	struct task *task, *next = NULL;
+	struct list_head *pos;
+
+	list_for_each(pos, &tasks_list) {
+		task = list_entry(pos, struct task, list);
+		if (task->pid >= pid && (!next || task->pid < next->pid) && ksm_task_scannable(task))
+			next = task;
+	}
+
+	return next;
+}
+
+/*
+ * End of a full scan : forget candidate pages and release unused merged pages.
+ */
+static void ksm_end_scan()
+{
+	struct ksm_stable_node *node;
+	struct ksm_rmap_item *item;
+	struct list_head *pos, *n;
+	int i;
+
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		/* clear unstable table */
+		list_for_each_safe(pos, n, &ksm_unstable_table[i]) {
+			item = list_entry(pos, struct ksm_rmap_item, list);
+			list_del(&item->list);
+			kfree(item);
+		}
+
+		/* release merged pages not mapped anymore */
+		list_for_each_safe(pos, n, &ksm_stable_table[i]) {
+			node = list_entry(pos, struct ksm_stable_node, list);
+			if (node->page->count > 1)
+				continue;
+
+			ClearPageKsm(node->page);
+			__free_page(node->page);
+			list_del(&node->list);
+			kfree(node);
+		}
+	}
+
+	/* restart from first task */
+	ksm_scan_pid = 0;
+	ksm_scan_address = 0;
+	kstat.ksm_full_scans++;
+}
+
+/*
+ * Scan pages.
+ */
+static void ksm_do_scan(int nr)
+{
+	struct vm_area *vma;
+	struct task *task;
+	uint32_t address;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	while (nr > 0) {
+		/* find current task */
+		task = ksm_next_task(ksm_scan_pid);
+		if (!task) {
+			ksm_end_scan();
+			return;
+		}
+
+		/* task exited : restart on next one */
+		if (task->pid != ksm_scan_pid) {
+			ksm_scan_pid = task->pid;
+			ksm_scan_address = 0;
+		}
+
+		/* find next memory region */
+		vma = find_vma(task->mm, ksm_scan_address);
+		if (!vma)
+			goto next_task;
+
+		/* skip non mergeable memory regions */
+		address = ksm_scan_address > vma->vm_start ? ksm_scan_address : vma->vm_start;
+		if (!ksm_vma_mergeable(vma)) {
+			ksm_scan_address = vma->vm_end;
+			continue;
+		}
+
+		/* no page table or large page : skip page table */
+		pmd = pmd_offset(pgd_offset(task->mm->pgd, address), address);
+		if (pmd_none(*pmd) || pmd_huge(*pmd)) {
+			ksm_scan_address = (address & PMD_MASK) + PMD_SIZE;
+			if (!ksm_scan_address)
+				goto next_task;
+			continue;
+		}
+
+		/* scan page */
+		pte = pte_offset(pmd, address);
+		nr -= ksm_scan_pte(vma, address, pte);
+
+		/* go to next page */
+		ksm_scan_address = address + PAGE_SIZE;
+		if (ksm_scan_address)
+			continue;
+next_task:
+		ksm_scan_pid++;
+		ksm_scan_address = 0;
+	}
+}
+
+/*
+ * Get number of merged pages and number of page table entries sharing them.
+ */
+void ksm_get_stats(uint32_t *pages_shared, uint32_t *pages_sharing)
+{
+	struct ksm_stable_node *node;
+	struct list_head *pos;
+	int i;
+
+	*pages_shared = 0;
+	*pages_sharing = 0;
+
+	if (!ksm_tables_initialized)
+		return;
+
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_for_each(pos, &ksm_stable_table[i]) {
+			node = list_entry(pos, struct ksm_stable_node, list);
+			if (node->page->count < 2)
+				continue;
+
+			/* merged page holds an extra reference */
+			(*pages_shared)++;
+			*pages_sharing += node->page->count - 2;
+		}
+	}
+}
+
+/*
+ * Samepage merging thread = merge identical anonymous pages.
+ */
+int ksmd(void *arg)
+{
+	int i;
+
+	UNUSED(arg);
+
+	/* init tables */
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		INIT_LIST_HEAD(&ksm_stable_table[i]);
+		INIT_LIST_HEAD(&ksm_unstable_table[i]);
+	}
+	ksm_tables_initialized = 1;
+
+	for (;;) {
+		/* scan pages */
+		irq_disable();
+		if (sysctl_ksm_run != KSM_RUN_STOP)
+			ksm_do_scan(sysctl_ksm_pages_to_scan);
+
+		/* go to sleep */
+		current_task->state = TASK_SLEEPING;
+		schedule_timeout(ms_to_jiffies(sysctl_ksm_sleep_millisecs));
+	}
+
+	return 0;
+}
@@ -26,7 +26,8 @@ void init_mem(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_end)
  */
 void si_meminfo(struct sysinfo *info)
 {
-	info->totalram = totalram_pages << PAGE_SHIFT;
-	info->freeram = nr_free_pages() << PAGE_SHIFT;
-	info->bufferram = buffermem_pages << PAGE_SHIFT;
+	info->totalram = totalram_pages;
+	info->freeram = nr_free_pages();
+	info->bufferram = buffermem_pages;
+	info->mem_unit = PAGE_SIZE;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <mm/mmap.h>
 #include <mm/mm.h>
+#include <ipc/shm.h>
 #include <proc/sched.h>
 #include <stdio.h>
 #include <stderr.h>
@@ -253,10 +254,14 @@ static pte_t *get_one_pte(struct mm_struct *mm, uint32_t address)
 	pgd = pgd_offset(mm->pgd, address);
 
 	/* get pmd */
-	pmd = pmd_offset(pgd);
+	pmd = pmd_offset(pgd, address);
 	if (pmd_none(*pmd))
 		return NULL;
 
+	/* large page : split it */
+	if (pmd_huge(*pmd) && split_huge_pmd(pmd))
+		return NULL;
+
 	/* get pte */
 	pte = pte_offset(pmd, address);
 	if (pte_none(*pte))
@@ -474,7 +479,8 @@ uint32_t do_mmap(struct file *filp, uint32_t addr, size_t len, int prot, int fla
 	vma->vm_start = addr;
 	vma->vm_end = addr + len;
 	vma->vm_flags = prot & (VM_READ | VM_WRITE | VM_EXEC);
-	vma->vm_flags |= flags & (VM_GROWSDOWN | VM_DENYWRITE | VM_EXECUTABLE);
+	vma->vm_flags |= flags & (VM_GROWSDOWN | VM_DENYWRITE | VM_EXECUTABLE | VM_LOCKED);
+	vma->vm_flags |= current_task->mm->def_flags;
 	vma->vm_page_prot = protection_map[vma->vm_flags & 0x0F];
 	vma->vm_offset = offset;
 	vma->vm_file = NULL;
@@ -509,9 +515,13 @@ uint32_t do_mmap(struct file *filp, uint32_t addr, size_t len, int prot, int fla
 	insert_vma(vma);
 
 	/* merge segments */
-	merge_segments(current_task->mm, vma->vm_start, vma->vm_end);
+	merge_segments(current_task->mm, addr, addr + len);
 
-	return vma->vm_start;
+	/* locked or populated mapping : prefault pages */
+	if ((flags & (MAP_LOCKED | MAP_POPULATE)) || (current_task->mm->def_flags & VM_LOCKED))
+		make_pages_present(addr, addr + len);
+
+	return addr;
 err:
 	kfree(vma);
 	return ret;
@@ -946,6 +956,12 @@ int do_mprotect(uint32_t start, size_t size, int prot)
 		/* compute new flags */
 		newflags = prot | (vma->vm_flags & ~(PROT_READ | PROT_WRITE | PROT_EXEC));
 
+		/* write sealed memfd can't be mapped shared writable */
+		if ((newflags & VM_WRITE) && (newflags & VM_SHARED) && vma->vm_file && shm_write_sealed(vma->vm_file->f_dentry->d_inode)) {
+			ret = -EACCES;
+			break;
+		}
+
 		/* last memory region */
 		if (vma->vm_end >= end) {
 			ret = mprotect_fixup(vma, nstart, end, newflags);
@@ -976,6 +992,187 @@ int do_mprotect(uint32_t start, size_t size, int prot)
 	return ret;
 }
 
+/*
+ * Lock/unlock a memory region (split memory region if needed).
+ */
+static int mlock_fixup(struct vm_area *vma, uint32_t start, uint32_t end, int on)
+{
+	uint16_t newflags;
+	int ret;
+
+	/* compute new flags */
+	newflags = on ? vma->vm_flags | VM_LOCKED : vma->vm_flags & ~VM_LOCKED;
+
+	/* split region (protection is unchanged) */
+	ret = mprotect_fixup(vma, start, end, newflags);
+	if (ret)
+		return ret;
+
+	/* fault in locked pages (failures are ignored : region stays locked, missing pages are faulted on access) */
+	if (on)
+		make_pages_present(start, end);
+
+	return 0;
+}
+
+/*
+ * Get size of memory regions (all of them or only those having flags).
+ */
+static uint32_t vm_size(struct mm_struct *mm, uint16_t flags)
+{
+	struct vm_area *vma;
+	uint32_t size = 0;
+
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+		if ((vma->vm_flags & flags) == flags)
+			size += vma->vm_end - vma->vm_start;
+
+	return size;
+}
+
+/*
+ * Lock/unlock memory.
+ */
+static int do_mlock(uint32_t start, size_t len, int on)
+{
+	struct vm_area *vma, *next;
+	uint32_t nstart, end, tmp;
+	int ret = 0;
+
+	/* page align range */
+	len = PAGE_ALIGN_UP(len + (start & ~PAGE_MASK));
+	start &= PAGE_MASK;
+
+	/* compute end address */
+	end = start + len;
+	if (end < start)
+		return -EINVAL;
+
+	/* empty region */
+	if (end == start)
+		return 0;
+
+	/* check locked memory limit */
+	if (on && !suser() && vm_size(current_task->mm, VM_LOCKED) + len > current_task->rlim[RLIMIT_MEMLOCK].rlim_cur)
+		return -ENOMEM;
+
+	/* find first memory region */
+	vma = find_vma(current_task->mm, start);
+	if (!vma || vma->vm_start > start)
+		return -ENOMEM;
+
+	/* lock memory regions */
+	for (nstart = start;;) {
+		/* last memory region */
+		if (vma->vm_end >= end) {
+			ret = mlock_fixup(vma, nstart, end, on);
+			break;
+		}
+
+		/* lock memory region */
+		tmp = vma->vm_end;
+		next = vma->vm_next;
+		ret = mlock_fixup(vma, nstart, tmp, on);
+		if (ret)
+			break;
+
+		/* go to next memory region */
+		nstart = tmp;
+		vma = next;
+
+		/* hole or no more regions */
+		if (!vma || vma->vm_start != nstart) {
+			ret = -ENOMEM;
+			break;
+		}
+	}
+
+	/* merge segments */
+	merge_segments(current_task->mm, start, end);
+
+	return ret;
+}
+
+/*
+ * Lock/unlock all memory.
+ */
+static int do_mlockall(int flags)
+{
+	struct mm_struct *mm = current_task->mm;
+	struct vm_area *vma, *next;
+
+	/* lock future mappings */
+	mm->def_flags = (flags & MCL_FUTURE) ? VM_LOCKED : 0;
+
+	/* lock current mappings (errors are ignored : lock as many regions as possible) */
+	for (vma = mm->mmap; vma != NULL; vma = next) {
+		next = vma->vm_next;
+		mlock_fixup(vma, vma->vm_start, vma->vm_end, flags & MCL_CURRENT);
+	}
+
+	return 0;
+}
+
+/*
+ * Synchronize a file mapping.
+ */
+static int do_msync(uint32_t start, size_t len, int flags)
+{
+	struct vm_area *vma;
+	uint32_t end, vma_start, vma_end;
+	int ret = 0, err;
+
+	/* address must be page aligned */
+	if (start & ~PAGE_MASK)
+		return -EINVAL;
+
+	/* check flags */
+	if ((flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) || ((flags & MS_ASYNC) && (flags & MS_SYNC)))
+		return -EINVAL;
+
+	/* compute end address */
+	end = start + PAGE_ALIGN_UP(len);
+	if (end < start)
+		return -ENOMEM;
+
+	for (; start < end; start = vma_end) {
+		/* find next memory region */
+		vma = find_vma(current_task->mm, start);
+		if (!vma || vma->vm_start >= end)
+			return -ENOMEM;
+
+		/* hole */
+		if (vma->vm_start > start)
+			ret = -ENOMEM;
+
+		/* compute area */
+		vma_start = start > vma->vm_start ? start : vma->vm_start;
+		vma_end = end < vma->vm_end ? end : vma->vm_end;
+
+		/* locked pages can't be invalidated */
+		if ((flags & MS_INVALIDATE) && (vma->vm_flags & VM_LOCKED))
+			return -EBUSY;
+
+		/* only shared file mappings have something to write */
+		if (!vma->vm_file || !vma->vm_ops || !vma->vm_ops->sync)
+			continue;
+
+		/* write dirty ptes to page cache */
+		err = vma->vm_ops->sync(vma, vma_start, vma_end - vma_start, flags);
+		if (err)
+			return err;
+
+		/* synchronous : write page cache and wait */
+		if (flags & MS_SYNC) {
+			err = filemap_write_and_wait(vma->vm_file->f_dentry->d_inode);
+			if (err)
+				return err;
+		}
+	}
+
+	return ret;
+}
+
 /*
  * Truncate memory regions.
  */
@@ -1082,15 +1279,142 @@ int sys_mremap(uint32_t old_address, size_t old_size, size_t new_size, int flags
 	return do_mremap(old_address, old_size, new_size, flags, new_address);
 }
 
+/*
+ * Set access pattern hint on a memory region (hint applies to the whole region, which is not split).
+ */
+static void madvise_behavior(struct vm_area *vma, int advice)
+{
+	vma->vm_flags &= ~(VM_SEQ_READ | VM_RAND_READ);
+
+	if (advice == MADV_SEQUENTIAL)
+		vma->vm_flags |= VM_SEQ_READ;
+	else if (advice == MADV_RANDOM)
+		vma->vm_flags |= VM_RAND_READ;
+}
+
+/*
+ * Allow or forbid samepage merging on a memory region (shared regions are never merged, merged pages are unshared on write).
+ */
+static void madvise_merge(struct vm_area *vma, int advice)
+{
+	if (advice == MADV_MERGEABLE && !(vma->vm_flags & VM_SHARED))
+		vma->vm_flags |= VM_MERGEABLE;
+	else if (advice == MADV_UNMERGEABLE)
+		vma->vm_flags &= ~VM_MERGEABLE;
+}
+
+/*
+ * Read ahead file pages of a memory region.
+ */
+static void madvise_willneed(struct vm_area *vma, uint32_t start, uint32_t end)
+{
+	struct inode *inode;
+
+	/* anonymous memory region */
+	if (!vma->vm_file || !vma->vm_file->f_dentry)
+		return;
+
+	/* read ahead pages */
+	inode = vma->vm_file->f_dentry->d_inode;
+	force_page_cache_readahead(inode, (start - vma->vm_start + vma->vm_offset) >> PAGE_SHIFT, (end - start) >> PAGE_SHIFT);
+}
+
+/*
+ * Drop pages of a memory region (anonymous pages will be zero filled on next access).
+ */
+static int madvise_dontneed(struct vm_area *vma, uint32_t start, uint32_t end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct inode *inode;
+	uint32_t index;
+	size_t nr;
+
+	/* locked pages can't be dropped */
+	if (vma->vm_flags & VM_LOCKED)
+		return -EINVAL;
+
+	/* write back shared dirty pages */
+	if (vma->vm_ops && vma->vm_ops->unmap)
+		vma->vm_ops->unmap(vma, start, end - start);
+
+	/* unmap pages */
+	nr = zap_page_range(mm->pgd, start, end - start);
+
+	/* update resident memory size */
+	if (nr >= mm->rss)
+		mm->rss -= nr;
+	else
+		mm->rss = 0;
+
+	/* drop unused file pages from page cache */
+	if (vma->vm_file && vma->vm_file->f_dentry) {
+		inode = vma->vm_file->f_dentry->d_inode;
+		index = (start - vma->vm_start + vma->vm_offset) >> PAGE_SHIFT;
+		invalidate_mapping_pages(inode, index, index + ((end - start) >> PAGE_SHIFT) - 1);
+	}
+
+	return 0;
+}
+
 /*
  * Madvise system call.
  */
 int sys_madvise(uint32_t addr, size_t length, int advice)
 {
-	UNUSED(addr);
-	UNUSED(length);
-	UNUSED(advice);
-	return 0;
+	uint32_t start, end, vma_start, vma_end;
+	struct vm_area *vma;
+	int ret = 0, err;
+
+	/* address must be page aligned */
+	if (addr & ~PAGE_MASK)
+		return -EINVAL;
+
+	/* check advice */
+	if ((advice < MADV_NORMAL || advice > MADV_DONTNEED) && advice != MADV_MERGEABLE && advice != MADV_UNMERGEABLE)
+		return -EINVAL;
+
+	/* compute end address */
+	end = addr + PAGE_ALIGN_UP(length);
+	if (end < addr)
+		return -EINVAL;
+
+	/* apply advice on each memory region */
+	for (start = addr; start < end; start = vma_end) {
+		/* find next memory region */
+		vma = find_vma(current_task->mm, start);
+		if (!vma || vma->vm_start >= end)
+			return -ENOMEM;
+
+		/* hole */
+		if (vma->vm_start > start)
+			ret = -ENOMEM;
+
+		/* compute area */
+		vma_start = start > vma->vm_start ? start : vma->vm_start;
+		vma_end = end < vma->vm_end ? end : vma->vm_end;
+
+		switch (advice) {
+			case MADV_NORMAL:
+			case MADV_RANDOM:
+			case MADV_SEQUENTIAL:
+				madvise_behavior(vma, advice);
+				break;
+			case MADV_WILLNEED:
+				madvise_willneed(vma, vma_start, vma_end);
+				break;
+			case MADV_DONTNEED:
+				err = madvise_dontneed(vma, vma_start, vma_end);
+				if (err)
+					return err;
+				break;
+			case MADV_MERGEABLE:
+			case MADV_UNMERGEABLE:
+				madvise_merge(vma, advice);
+				break;
+		}
+	}
+
+	return ret;
 }
 
 /*
@@ -1101,6 +1425,54 @@ int sys_mprotect(uint32_t addr, size_t len, int prot)
 	return do_mprotect(addr, len, prot);
 }
 
+/*
+ * Msync system call.
+ */
+int sys_msync(uint32_t addr, size_t len, int flags)
+{
+	return do_msync(addr, len, flags);
+}
+
+/*
+ * Mlock system call.
+ */
+int sys_mlock(uint32_t addr, size_t len)
+{
+	return do_mlock(addr, len, 1);
+}
+
+/*
+ * Munlock system call.
+ */
+int sys_munlock(uint32_t addr, size_t len)
+{
+	return do_mlock(addr, len, 0);
+}
+
+/*
+ * Mlockall system call.
+ */
+int sys_mlockall(int flags)
+{
+	/* check flags */
+	if (!flags || (flags & ~(MCL_CURRENT | MCL_FUTURE)))
+		return -EINVAL;
+
+	/* check locked memory limit */
+	if ((flags & MCL_CURRENT) && !suser() && vm_size(current_task->mm, 0) > current_task->rlim[RLIMIT_MEMLOCK].rlim_cur)
+		return -ENOMEM;
+
+	return do_mlockall(flags);
+}
+
+/*
+ * Munlockall system call.
+ */
+int sys_munlockall()
+{
+	return do_mlockall(0);
+}
+
 /*
  * Change data segment end address.
  */
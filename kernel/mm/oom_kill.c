@@ -0,0 +1,193 @@
+#include <mm/oom.h>
+#include <mm/mm.h>
+#include <mm/mmap.h>
+#include <mm/paging.h>
+#include <mm/swap.h>
+#include <proc/sched.h>
+#include <kernel_stat.h>
+#include <stdio.h>
+
+/*
+ * Count swapped out pages of a memory region.
+ */
+static uint32_t vma_swap_pages(struct vm_area *vma)
+{
+	uint32_t address, nr = 0;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	for (address = vma->vm_start; address < vma->vm_end; address += PAGE_SIZE) {
+		/* no page table or large page : skip page table */
+		pmd = pmd_offset(pgd_offset(vma->vm_mm->pgd, address), address);
+		if (pmd_none(*pmd) || pmd_huge(*pmd)) {
+			address = (address & PMD_MASK) + PMD_SIZE - PAGE_SIZE;
+			continue;
+		}
+
+		/* swap entry */
+		pte = pte_offset(pmd, address);
+		if (!pte_none(*pte) && !pte_present(*pte))
+			nr++;
+	}
+
+	return nr;
+}
+
+/*
+ * Get total number of pages (memory and swap).
+ */
+uint32_t oom_totalpages()
+{
+	struct sysinfo info;
+
+	si_swapinfo(&info);
+	return totalram_pages + info.totalswap;
+}
+
+/*
+ * Check if a task can be killed.
+ */
+static int oom_killable(struct task *task)
+{
+	/* zombie, init and kernel threads */
+	if (task->state == TASK_ZOMBIE || task->pid == 1)
+		return 0;
+	if (!task->mm || task->mm->pgd == pgd_kernel)
+		return 0;
+
+	return task->oom_score_adj != OOM_SCORE_ADJ_MIN;
+}
+
+/*
+ * Compute badness of a task = resident and swapped out pages, adjusted by oom_score_adj (0 = never kill).
+ */
+uint32_t oom_badness(struct task *task, uint32_t totalpages)
+{
+	struct vm_area *vma;
+	int points, adj;
+
+	if (!oom_killable(task))
+		return 0;
+
+	/* resident and swapped out pages */
+	points = task->mm->rss;
+	for (vma = task->mm->mmap; vma != NULL; vma = vma->vm_next)
+		points += vma_swap_pages(vma);
+
+	/* adjust : oom_score_adj is in thousandths of total pages */
+	adj = task->oom_score_adj * (int) (totalpages / 1000);
+	points += adj;
+
+	return points > 0 ? (uint32_t) points : 1;
+}
+
+/*
+ * Select task with the highest badness.
+ */
+static struct task *select_bad_process(uint32_t *ppoints)
+{
+	struct task *task, *chosen = NULL;
+	uint32_t totalpages, points;
+	struct list_head *pos;
+
+	totalpages = oom_totalpages();
+	*ppoints = 0;
+
+	list_for_each(pos, &tasks_list) {
+		task = list_entry(pos, struct task, list);
+
+		/* already killed : its memory has been released */
+		if (sigismember(&task->pending.signal, SIGKILL))
+			continue;
+
+		points = oom_badness(task, totalpages);
+		if (points > *ppoints) {
+			chosen = task;
+			*ppoints = points;
+		}
+	}
+
+	return chosen;
+}
+
+/*
+ * Check if a killed address space is still in use (its tasks may sleep in kernel : memory is only released at exit).
+ */
+static int oom_victim_exiting()
+{
+	struct list_head *pos;
+	struct task *task;
+
+	list_for_each(pos, &tasks_list) {
+		task = list_entry(pos, struct task, list);
+		if (task->mm && task->mm->oom_killed && task->state != TASK_ZOMBIE)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Give killed tasks a chance to run and exit.
+ */
+static void oom_wait_victim()
+{
+	/* kinit can't sleep */
+	if (!current_task->pid)
+		return;
+
+	current_task->state = TASK_SLEEPING;
+	schedule_timeout(1);
+}
+
+/*
+ * Out of memory : kill task with the highest badness (returns 1 if caller should retry).
+ */
+int out_of_memory(uint32_t order)
+{
+	static time_t kill_time = 0;
+	struct task *victim, *task;
+	struct list_head *pos;
+	struct mm_struct *mm;
+	uint32_t points;
+
+	/* killed address space can't allocate anymore : caller must fail */
+	if (current_task->mm && current_task->mm->oom_killed)
+		return 0;
+
+	/* previous victim still exiting : wait for it instead of killing another task */
+	if (oom_victim_exiting() && jiffies - kill_time < OOM_VICTIM_TIMEOUT) {
+		oom_wait_victim();
+		return 1;
+	}
+
+	/* choose a victim */
+	victim = select_bad_process(&points);
+	if (!victim) {
+		printf("Out of memory (order %d): no killable process\n", order);
+		return 0;
+	}
+
+	/* log decision */
+	mm = victim->mm;
+	printf("Out of memory (order %d): killed process %d (%s) score %u, rss %u pages, oom_score_adj %d\n",
+	       order, victim->pid, victim->name, points, mm->rss, victim->oom_score_adj);
+	kstat.oom_kill++;
+
+	/* kill all tasks sharing victim address space (memory is released when last of them exits) */
+	mm->oom_killed = 1;
+	kill_time = jiffies;
+	list_for_each(pos, &tasks_list) {
+		task = list_entry(pos, struct task, list);
+		if (task->mm == mm && task->state != TASK_ZOMBIE)
+			send_sig(task, SIGKILL, 1);
+	}
+
+	/* current address space is killed : caller must fail */
+	if (mm == current_task->mm)
+		return 0;
+
+	/* let victim exit */
+	oom_wait_victim();
+	return 1;
+}
@@ -1,11 +1,22 @@
 #include <fs/fs.h>
 #include <mm/highmem.h>
 #include <mm/swap.h>
+#include <mm/oom.h>
+#include <mm/compaction.h>
+#include <proc/sched.h>
+#include <drivers/char/pit.h>
+#include <x86/interrupt.h>
+#include <kernel_stat.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #define NR_NODES		8
 #define NR_FREE_PAGES_LOW	32
+#define MAX_RECLAIM_RETRIES	16
+#define COSTLY_ORDER		3
+#define NR_ZEROED_PAGES_MAX	64
+#define DEFERRED_INIT_PAGES	8192			/* struct pages initialized per deferred run (32 MB) */
 
 /*
  * Memory node.
@@ -29,7 +40,17 @@ struct zone {
 static struct zone zones[NR_ZONES];
 uint32_t totalram_pages = 0;
 
+/* pre zeroed pages pool */
+static LIST_HEAD(zeroed_pages);
+uint32_t nr_zeroed_pages = 0;
+
+/* deferred struct pages initialization (pages [nr_pages, deferred_end_pfn[ are not initialized yet) */
+static uint32_t deferred_end_pfn = 0;
+static uint64_t deferred_init_cycles = 0;
+
 static void reclaim_pages();
+static void drain_zeroed_pages();
+static void merge_free_pages();
 
 /*
  * Get number of free pages.
@@ -45,6 +66,14 @@ uint32_t nr_free_pages()
 	return ret;
 }
 
+/*
+ * Get number of free pages usable by allocations of a zone (high memory allocations fall back to kernel pages).
+ */
+uint32_t nr_free_zone_pages(int zone)
+{
+	return zone == GFP_KERNEL ? zones[GFP_KERNEL].nr_free_pages : nr_free_pages();
+}
+
 /*
  * Add to free pages.
  */
@@ -115,52 +144,255 @@ static struct node *__find_free_node(int priority, uint32_t order)
 	return NULL;
 }
 
+/*
+ * Take pages from a free node.
+ */
+static struct page *__take_free_pages(struct node *node, uint32_t order)
+{
+	size_t npages = 1 << order;
+	struct page *page;
+
+	/* get first free page */
+	page = list_first_entry(&node->free_pages, struct page, list);
+	page->inode = NULL;
+	page->offset = 0;
+	page->buffers = NULL;
+	page->count = 1;
+	page->flags = 0;
+	__delete_from_free_pages(page);
+
+	/* add remaining pages to free list */
+	if (order != node->order)
+		__add_to_free_pages(page + npages, page->priority, node->order_nr_pages - npages);
+
+	return page;
+}
+
 /*
  * Get free pages.
  */
 struct page *__get_free_pages(int priority, uint32_t order)
 {
-	size_t npages = 1 << order;
+	int zone = priority & GFP_ZONE_MASK, retries = 0;
 	struct node *node;
 	struct page *page;
 
 	for (;;) {
 		/* find free node */
-		node = __find_free_node(priority, order);
+		node = __find_free_node(zone, order);
 		if (node)
 			goto found;
 
+		/* high memory not fully initialized : initialize more pages first */
+		if (zone != GFP_KERNEL && deferred_init_pages())
+			continue;
+
 		/* try to use kernel pages */
-		if (priority != GFP_KERNEL) {
+		if (zone != GFP_KERNEL) {
 			node = __find_free_node(GFP_KERNEL, order);
 			if (node)
 				goto found;
 		}
 
+		/* caller can handle failure */
+		if ((priority & __GFP_NORETRY) && retries)
+			break;
+
+		/* high order allocation : merge free pages and compact memory first */
+		if (order) {
+			drain_zeroed_pages();
+			merge_free_pages();
+			if (__find_free_node(zone, order) || compact_zone_order(zone, order))
+				continue;
+		}
+
 		/* reclaim memory */
 		reclaim_pages();
+		if (++retries < MAX_RECLAIM_RETRIES)
+			continue;
+
+		/* large allocations fail instead of killing tasks */
+		if (order > COSTLY_ORDER)
+			break;
+
+		/* out of memory : kill a task and retry */
+		if (!out_of_memory(order))
+			break;
+		retries = 0;
 	}
 
+	kstat.alloc_fail++;
 	return NULL;
 found:
-	/* get first free page */
-	page = list_first_entry(&node->free_pages, struct page, list);
+	page = __take_free_pages(node, order);
+
+	/* low memory : reclaim pages */
+	if (nr_free_pages() < NR_FREE_PAGES_LOW)
+		reclaim_pages();
+
+	return page;
+}
+
+/*
+ * Get free pages without reclaiming memory (used from i/o paths, returns NULL if no pages are free).
+ */
+struct page *__get_free_pages_noreclaim(int priority, uint32_t order)
+{
+	struct node *node;
+
+	/* find free node */
+	node = __find_free_node(priority & GFP_ZONE_MASK, order);
+	if (!node && (priority & GFP_ZONE_MASK) != GFP_KERNEL)
+		node = __find_free_node(GFP_KERNEL, order);
+	if (!node)
+		return NULL;
+
+	return __take_free_pages(node, order);
+}
+
+/*
+ * Check if a large page is free (returns first and end pages of free blocks covering it).
+ */
+static int huge_page_free(uint32_t start, uint32_t *first, uint32_t *end)
+{
+	struct node *node;
+	int priority;
+
+	/* find free block containing first page */
+	for (*first = start; !page_array[*first].private; (*first)--)
+		if (!*first || start - *first >= (1 << (NR_NODES - 1)))
+			return 0;
+
+	/* first page not free */
+	node = page_array[*first].private;
+	if (*first + node->order_nr_pages <= start)
+		return 0;
+
+	/* check that all pages are free and in the same zone */
+	priority = page_array[*first].priority;
+	for (*end = *first; *end < start + HPAGE_NR_PAGES; *end += node->order_nr_pages) {
+		node = page_array[*end].private;
+		if (!node || page_array[*end].priority != priority)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Get a free large page (HPAGE_NR_PAGES contiguous pages, physically aligned on a large page boundary).
+ */
+struct page *get_free_huge_page()
+{
+	uint32_t start, first, end, i;
+	struct node *node;
+	struct page *page;
+	int priority;
+
+	/* keep enough free pages for others */
+	if (nr_free_pages() < HPAGE_NR_PAGES + 2 * NR_FREE_PAGES_LOW)
+		return NULL;
+
+	/* find a free large page (try high memory first) */
+	for (start = nr_pages & ~(HPAGE_NR_PAGES - 1); start >= HPAGE_NR_PAGES; )
+		if (huge_page_free(start -= HPAGE_NR_PAGES, &first, &end))
+			goto found;
+
+	return NULL;
+found:
+	/* remove free blocks */
+	priority = page_array[first].priority;
+	for (i = first; i < end; i += node->order_nr_pages) {
+		node = page_array[i].private;
+		__delete_from_free_pages(&page_array[i]);
+	}
+
+	/* give back pages before and after large page */
+	if (first < start)
+		__add_to_free_pages(&page_array[first], priority, start - first);
+	if (end > start + HPAGE_NR_PAGES)
+		__add_to_free_pages(&page_array[start + HPAGE_NR_PAGES], priority, end - start - HPAGE_NR_PAGES);
+
+	/* init first page */
+	page = &page_array[start];
 	page->inode = NULL;
 	page->offset = 0;
 	page->buffers = NULL;
 	page->count = 1;
 	page->flags = 0;
-	__delete_from_free_pages(page);
 
-	/* add remaining pages to free list */
-	if (order != node->order)
-		__add_to_free_pages(page + npages, page->priority, node->order_nr_pages - npages);
+	return page;
+}
 
-	/* low memory : reclaim pages */
-	if (nr_free_pages() < NR_FREE_PAGES_LOW)
-		reclaim_pages();
+/*
+ * Get size of the free block starting at page (0 if page does not start a free block).
+ */
+uint32_t free_block_size(struct page *page)
+{
+	struct node *node = page->private;
 
-	return page;
+	return node ? node->order_nr_pages : 0;
+}
+
+/*
+ * Take free pages of [start, end[ out of free lists (parts of free blocks outside the range are given back,
+ * isolated pages are marked in isolated[page - start]).
+ */
+uint32_t isolate_free_range(uint32_t start, uint32_t end, uint8_t *isolated)
+{
+	uint32_t j;
+	uint32_t i, block_end, size, nr = 0;
+	struct page *page;
+	int priority;
+
+	/* a free block covering start begins at most one max order block before */
+	i = start >= (1 << (NR_NODES - 1)) ? start - (1 << (NR_NODES - 1)) + 1 : 0;
+
+	while (i < end) {
+		/* not a free block */
+		page = &page_array[i];
+		size = free_block_size(page);
+		if (!size) {
+			i++;
+			continue;
+		}
+
+		/* free block before range */
+		block_end = i + size;
+		if (block_end <= start) {
+			i = block_end;
+			continue;
+		}
+
+		/* take free block */
+		priority = page->priority;
+		__delete_from_free_pages(page);
+
+		/* give back pages outside range */
+		if (i < start)
+			__add_to_free_pages(page, priority, start - i);
+		if (block_end > end)
+			__add_to_free_pages(&page_array[end], priority, block_end - end);
+
+		/* mark isolated pages */
+		for (j = i > start ? i : start; j < block_end && j < end; j++) {
+			isolated[j - start] = 1;
+			nr++;
+		}
+
+		i = block_end;
+	}
+
+	return nr;
+}
+
+/*
+ * Give back a range of isolated pages to free lists.
+ */
+void release_free_range(uint32_t start, uint32_t nr)
+{
+	if (nr)
+		__add_to_free_pages(&page_array[start], page_array[start].priority, nr);
 }
 
 /*
@@ -209,6 +441,72 @@ void free_pages(void *address, uint32_t order)
 		__free_pages(&page_array[page_idx], order);
 }
 
+/*
+ * Get a zeroed user page (from pre zeroed pool if possible).
+ */
+struct page *get_zeroed_user_page()
+{
+	struct page *page;
+
+	/* get a page from pre zeroed pool */
+	if (!list_empty(&zeroed_pages)) {
+		page = list_first_entry(&zeroed_pages, struct page, list);
+		list_del(&page->list);
+		nr_zeroed_pages--;
+		kstat.zeroed_pool_hits++;
+		return page;
+	}
+
+	/* else get a new page and clear it */
+	page = __get_free_page(GFP_HIGHUSER);
+	if (!page)
+		return NULL;
+
+	clear_user_highpage(page);
+	kstat.zeroed_pool_misses++;
+
+	return page;
+}
+
+/*
+ * Refill pre zeroed pool (called from idle loop, stops as soon as a task needs the cpu).
+ */
+void refill_zeroed_pages()
+{
+	struct page *page;
+
+	while (nr_zeroed_pages < NR_ZEROED_PAGES_MAX && !need_resched) {
+		/* don't eat memory needed by others */
+		if (nr_free_pages() <= 2 * NR_FREE_PAGES_LOW)
+			break;
+
+		/* get a page */
+		page = __get_free_page(GFP_HIGHUSER);
+		if (!page)
+			break;
+
+		/* clear it and add it to the pool */
+		clear_user_highpage(page);
+		list_add_tail(&page->list, &zeroed_pages);
+		nr_zeroed_pages++;
+	}
+}
+
+/*
+ * Release pre zeroed pool.
+ */
+static void drain_zeroed_pages()
+{
+	struct page *page;
+
+	while (!list_empty(&zeroed_pages)) {
+		page = list_first_entry(&zeroed_pages, struct page, list);
+		list_del(&page->list);
+		nr_zeroed_pages--;
+		__free_page(page);
+	}
+}
+
 /*
  * Merge free contiguous pages.
  */
@@ -285,6 +583,9 @@ static void reclaim_pages()
 	else
 		lock++;
 
+	/* release pre zeroed pages first */
+	drain_zeroed_pages();
+
 	/* synchronize buffers */
 	sync_dev(0);
 
@@ -304,6 +605,9 @@ static void reclaim_pages()
 	} while (--priority > 0);
 
 done:
+	/* start queued swap out writes */
+	swap_write_flush();
+
 	/* merge free pages */
 	if (count != SWAP_CLUSTER_MAX)
 		merge_free_pages();
@@ -317,9 +621,8 @@ done:
  */
 static void __init_zone(int priority)
 {
-	uint32_t order, start = 0, end = 0, addr, i;
 	struct zone *zone = &zones[priority];
-	struct page *first_free_page = NULL;
+	uint32_t order;
 
 	/* clear number of free pages */
 	zone->nr_free_pages = 0;
@@ -331,23 +634,26 @@ static void __init_zone(int priority)
 		zone->nodes[order].order_nr_pages = (1 << order);
 		INIT_LIST_HEAD(&zone->nodes[order].free_pages);
 	}
+}
 
-	/* kernel pages from 0 to PAGE_OFFSET */
-	if (priority == GFP_KERNEL) {
-		start = 0;
-		end = __pa(KPAGE_END);
-	} else if (priority == GFP_HIGHUSER) {
-		start = __pa(KPAGE_END);
-		end = nr_pages * PAGE_SIZE;
-	}
+/*
+ * Init pages [start, end[ of a zone and free available ones.
+ */
+static void __init_pages(int priority, uint32_t start, uint32_t end)
+{
+	struct page *first_free_page = NULL;
+	uint32_t i;
+
+	/* clear pages */
+	memset(&page_array[start], 0, sizeof(struct page) * (end - start));
 
 	/* for each page */
-	for (addr = start, i = start / PAGE_SIZE; i < nr_pages && addr < end; i++, addr += PAGE_SIZE) {
+	for (i = start; i < end; i++) {
 		/* set priority */
 		page_array[i].priority = priority;
 
 		/* page not available */
-		if (!bios_map_address_available(addr)) {
+		if (!bios_map_address_available((uint64_t) i << PAGE_SHIFT)) {
 			page_array[i].count = 1;
 			page_array[i].flags |= (1 << PG_reserved);
 
@@ -372,17 +678,50 @@ static void __init_zone(int priority)
 	}
 }
 
+/*
+ * Init next run of deferred high memory pages (called from idle loop and when high memory is exhausted).
+ */
+uint32_t deferred_init_pages()
+{
+	uint32_t start = nr_pages, end, flags;
+	uint64_t cycles;
+
+	/* all pages initialized */
+	if (start >= deferred_end_pfn)
+		return 0;
+
+	/* compute run */
+	end = start + DEFERRED_INIT_PAGES;
+	if (end > deferred_end_pfn)
+		end = deferred_end_pfn;
+
+	/* init pages and make them visible */
+	irq_save(flags);
+	cycles = get_cycles();
+	__init_pages(GFP_HIGHUSER, start, end);
+	nr_pages = end;
+	deferred_init_cycles += get_cycles() - cycles;
+	irq_restore(flags);
+
+	/* log */
+	if (end == deferred_end_pfn)
+		printf("[Kernel] Deferred page init done: %u pages in %u us\n",
+		       deferred_end_pfn - __pa(KPAGE_END) / PAGE_SIZE, cycles_to_usecs(deferred_init_cycles));
+
+	return end - start;
+}
+
 /*
  * Init page allocation.
  */
 int init_page_alloc(uint32_t kernel_start, uint32_t kernel_end)
 {
+	uint32_t lowmem_pages;
 	int ret;
 
-	/* allocate global pages array */
+	/* allocate global pages array (pages are cleared when they are initialized) */
 	page_array = (struct page *) __va(kernel_end);
 	kernel_end += sizeof(struct page) * nr_pages;
-	memset(page_array, 0, sizeof(struct page) * nr_pages);
 
 	/* reserve memory for kernel code */
 	ret = bios_map_add_entry(kernel_start, kernel_end, MULTIBOOT_MEMORY_RESERVED);
@@ -394,10 +733,16 @@ int init_page_alloc(uint32_t kernel_start, uint32_t kernel_end)
 	__init_zone(GFP_HIGHUSER);
 
 	/* set first high mem page */
-	if (nr_pages > __pa(KPAGE_END) / PAGE_SIZE)
-		highmem_start_page = &page_array[__pa(KPAGE_END) / PAGE_SIZE];
-	else
-		highmem_start_page = &page_array[nr_pages];
+	lowmem_pages = __pa(KPAGE_END) / PAGE_SIZE;
+	if (lowmem_pages > nr_pages)
+		lowmem_pages = nr_pages;
+	highmem_start_page = &page_array[lowmem_pages];
+
+	/* init low memory pages now, high memory pages are initialized later by runs (first run now) */
+	deferred_end_pfn = nr_pages;
+	__init_pages(GFP_KERNEL, 0, lowmem_pages);
+	nr_pages = lowmem_pages;
+	deferred_init_pages();
 
 	return 0;
 }
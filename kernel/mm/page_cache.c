@@ -1,82 +1,46 @@
 #include <mm/mm.h>
 #include <fs/fs.h>
 #include <stderr.h>
+#include <stdio.h>
 
-#define HASH_BITS 		11
-#define HASH_SIZE 		(1 << HASH_BITS)
-
-/* pages hash table */
-static struct page *page_hash_table[HASH_SIZE];
 uint32_t page_cache_size = 0;
 
 /*
- * Hash an inode/offset.
- */
-static inline uint32_t __page_hashfn(struct inode *inode, off_t offset)
-{
-#define i (((uint32_t) inode) / (sizeof(struct inode) & ~(sizeof(struct inode) - 1)))
-#define o (offset >> PAGE_SHIFT)
-#define s(x) ((x) + ((x) >> HASH_BITS))
-	return s(i + o) & (HASH_SIZE - 1);
-#undef i
-#undef o
-#undef s
-}
-
-/*
- * Get hash bucket.
- */
-static inline struct page **page_hash(struct inode *inode, off_t offset)
-{
-	return page_hash_table + __page_hashfn(inode, offset);
-}
-
-/*
- * Find a page in hash table.
+ * Find a page in cache.
  */
 struct page *find_page(struct inode *inode, off_t offset)
 {
 	struct page *page;
 
-	for (page = *page_hash(inode, offset); page != NULL; page = page->next_hash) {
-		if (page->inode == inode && page->offset == offset) {
-			page->count++;
-			return page;
-		}
-	}
+	page = radix_tree_lookup(&inode->i_pages, PAGE_INDEX(offset));
+	if (page)
+		page->count++;
 
-	return NULL;
+	return page;
 }
 
 /*
  * Cache a page.
  */
-void add_to_page_cache(struct page *page, struct inode *inode, off_t offset)
+int add_to_page_cache(struct page *page, struct inode *inode, off_t offset)
 {
-	struct page **p;
+	int ret;
+
+	/* insert page in inode tree */
+	ret = radix_tree_insert(&inode->i_pages, PAGE_INDEX(offset), page);
+	if (ret)
+		return ret;
 
 	/* set page */
 	page->count++;
 	page->inode = inode;
 	page->offset = offset;
 
-	/* insert page at the head */
-	p = page_hash(inode, offset);
-	page->prev_hash = NULL;
-	page->next_hash = *p;
-
-	/* update next page */
-	if (*p)
-		page->next_hash->prev_hash = page;
-
-	/* update head */
-	*p = page;
-
-	/* add page to inode */
-	list_add(&page->list, &inode->i_pages);
-
 	/* update cache size */
+	inode->i_nrpages++;
 	page_cache_size++;
+
+	return 0;
 }
 
 /*
@@ -84,40 +48,62 @@ void add_to_page_cache(struct page *page, struct inode *inode, off_t offset)
  */
 void remove_from_page_cache(struct page *page)
 {
-	struct page *next_hash = page->next_hash, *prev_hash = page->prev_hash;
-	struct page **p;
+	struct inode *inode = page->inode;
+
+	/* cancel dirty state */
+	clear_page_dirty(page);
 
-	/* unlink this page */
-	page->next_hash = NULL;
-	page->prev_hash = NULL;
+	/* remove it from inode tree */
+	if (radix_tree_delete(&inode->i_pages, PAGE_INDEX(page->offset)) != page)
+		panic("remove_from_page_cache: page not in cache\n");
 
-	/* update next */
-	if (next_hash)
-		next_hash->prev_hash = prev_hash;
+	/* update cache size */
+	inode->i_nrpages--;
+	page_cache_size--;
+}
 
-	/* update previous */
-	if (prev_hash)
-		prev_hash->next_hash = next_hash;
+/*
+ * Get up to nr_pages cached pages, starting at offset start.
+ */
+uint32_t find_get_pages(struct inode *inode, off_t start, uint32_t nr_pages, struct page **pages)
+{
+	uint32_t ret, i;
 
-	/* update head */
-	p = page_hash(page->inode, page->offset);
-	if (*p == page)
-		*p = next_hash;
+	ret = radix_tree_gang_lookup(&inode->i_pages, (void **) pages, PAGE_INDEX(start), nr_pages);
+	for (i = 0; i < ret; i++)
+		pages[i]->count++;
 
-	/* remove it from inode list */
-	list_del(&page->list);
+	return ret;
+}
 
-	/* update cache size */
-	page_cache_size--;
+/*
+ * Get up to nr_pages tagged cached pages, starting at offset start.
+ */
+uint32_t find_get_pages_tag(struct inode *inode, off_t start, int tag, uint32_t nr_pages, struct page **pages)
+{
+	uint32_t ret, i;
+
+	ret = radix_tree_gang_lookup_tag(&inode->i_pages, (void **) pages, PAGE_INDEX(start), nr_pages, tag);
+	for (i = 0; i < ret; i++)
+		pages[i]->count++;
+
+	return ret;
 }
 
 /*
- * Init page cache.
+ * Tag a cached page.
  */
-void  init_page_cache()
+void page_cache_tag_set(struct page *page, int tag)
 {
-	int i;
+	if (page->inode)
+		radix_tree_tag_set(&page->inode->i_pages, PAGE_INDEX(page->offset), tag);
+}
 
-	for (i = 0; i < HASH_SIZE; i++)
-		page_hash_table[i] = NULL;
+/*
+ * Untag a cached page.
+ */
+void page_cache_tag_clear(struct page *page, int tag)
+{
+	if (page->inode)
+		radix_tree_tag_clear(&page->inode->i_pages, PAGE_INDEX(page->offset), tag);
 }
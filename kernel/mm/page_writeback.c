@@ -0,0 +1,268 @@
+#include <mm/mm.h>
+#include <fs/fs.h>
+#include <proc/sched.h>
+#include <drivers/block/blk_dev.h>
+#include <kernel_stat.h>
+#include <stderr.h>
+#include <stdio.h>
+#include <time.h>
+
+#define PAGEVEC_SIZE			16
+#define WRITEBACK_CHUNK			256
+#define DIRTY_RATELIMIT			32
+
+/* dirty pages */
+uint32_t nr_dirty_pages = 0;
+
+/* flusher thread */
+struct task *bdflush_task = NULL;
+
+/* tunables */
+int sysctl_dirty_background_ratio = 10;
+int sysctl_dirty_ratio = 20;
+int sysctl_dirty_expire_centisecs = 3000;
+int sysctl_dirty_writeback_centisecs = 500;
+
+/*
+ * Mark a cached page dirty.
+ */
+void set_page_dirty(struct page *page)
+{
+	struct inode *inode = page->inode;
+
+	/* already dirty */
+	if (PageDirty(page))
+		return;
+
+	/* mark page dirty */
+	SetPageDirty(page);
+	if (!inode)
+		return;
+
+	/* tag page and update statistics */
+	page_cache_tag_set(page, PAGECACHE_TAG_DIRTY);
+	nr_dirty_pages++;
+	kstat.pgdirtied++;
+
+	/* first dirty page : queue inode on super block */
+	if (!inode->i_nrdirty++) {
+		inode->i_dirtied_when = jiffies;
+		if (inode->i_sb)
+			list_add_tail(&inode->i_dirty_list, &inode->i_sb->s_dirty);
+	}
+}
+
+/*
+ * Clear a page dirty state (returns 1 if page was dirty).
+ */
+int clear_page_dirty(struct page *page)
+{
+	struct inode *inode = page->inode;
+
+	/* clean page */
+	if (!PageDirty(page))
+		return 0;
+
+	/* mark page clean */
+	ClearPageDirty(page);
+	if (!inode)
+		return 1;
+
+	/* untag page and update statistics */
+	page_cache_tag_clear(page, PAGECACHE_TAG_DIRTY);
+	nr_dirty_pages--;
+
+	/* last dirty page : remove inode from super block */
+	if (!--inode->i_nrdirty && inode->i_sb)
+		list_del(&inode->i_dirty_list);
+
+	return 1;
+}
+
+/*
+ * End page writeback.
+ */
+void end_page_writeback(struct page *page)
+{
+	if (!PageWriteback(page))
+		return;
+
+	ClearPageWriteback(page);
+	page_cache_tag_clear(page, PAGECACHE_TAG_WRITEBACK);
+	wake_up_page(page);
+}
+
+/*
+ * Write a dirty page.
+ */
+static int write_one_page(struct inode *inode, struct page *page)
+{
+	int ret;
+
+	/* wait for previous i/o */
+	wait_on_page(page);
+
+	/* writepage not implemented (keep page dirty) */
+	if (!inode->i_op->writepage)
+		return -EINVAL;
+
+	/* page cleaned meanwhile */
+	if (!clear_page_dirty(page))
+		return 0;
+
+	/* start writeback */
+	SetPageWriteback(page);
+	page_cache_tag_set(page, PAGECACHE_TAG_WRITEBACK);
+
+	/* write page */
+	ret = inode->i_op->writepage(inode, page);
+	if (ret) {
+		end_page_writeback(page);
+		set_page_dirty(page);
+		return ret;
+	}
+
+	kstat.pgwriteback++;
+	return 0;
+}
+
+/*
+ * Start writeback of all inode dirty pages.
+ */
+int filemap_fdatawrite(struct inode *inode)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	uint32_t nr, i, index = 0;
+	int ret = 0, err;
+
+	while ((nr = find_get_pages_tag(inode, (off_t) index << PAGE_SHIFT, PAGECACHE_TAG_DIRTY, PAGEVEC_SIZE, pages)) > 0) {
+		for (i = 0; i < nr; i++) {
+			index = PAGE_INDEX(pages[i]->offset) + 1;
+
+			/* write page */
+			err = write_one_page(inode, pages[i]);
+			if (err && !ret)
+				ret = err;
+
+			__free_page(pages[i]);
+		}
+
+		/* end of index space */
+		if (!index)
+			break;
+	}
+
+	return ret;
+}
+
+/*
+ * Wait for writeback of all inode pages.
+ */
+void filemap_fdatawait(struct inode *inode)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	uint32_t nr, i, index = 0;
+
+	while ((nr = find_get_pages_tag(inode, (off_t) index << PAGE_SHIFT, PAGECACHE_TAG_WRITEBACK, PAGEVEC_SIZE, pages)) > 0) {
+		for (i = 0; i < nr; i++) {
+			index = PAGE_INDEX(pages[i]->offset) + 1;
+			wait_on_page_writeback(pages[i]);
+			__free_page(pages[i]);
+		}
+
+		/* end of index space */
+		if (!index)
+			break;
+	}
+}
+
+/*
+ * Write all inode dirty pages and wait for completion.
+ */
+int filemap_write_and_wait(struct inode *inode)
+{
+	int ret;
+
+	ret = filemap_fdatawrite(inode);
+	filemap_fdatawait(inode);
+
+	return ret;
+}
+
+/*
+ * Compute dirty thresholds (in pages).
+ */
+static void get_dirty_limits(uint32_t *background, uint32_t *limit)
+{
+	uint32_t available = nr_free_pages() + page_cache_size;
+
+	*background = available / 100 * sysctl_dirty_background_ratio;
+	*limit = available / 100 * sysctl_dirty_ratio;
+
+	/* background writeback must start before throttling */
+	if (*background >= *limit)
+		*background = *limit / 2;
+}
+
+/*
+ * Wake up flusher thread.
+ */
+static void wakeup_bdflush()
+{
+	if (bdflush_task && bdflush_task->state == TASK_SLEEPING)
+		wake_up_process(bdflush_task);
+}
+
+/*
+ * Throttle a process dirtying pages : write back dirty pages synchronously above dirty limit.
+ */
+void balance_dirty_pages()
+{
+	static uint32_t ratelimit = 0;
+	uint32_t background, limit, nr_dirty;
+
+	/* check dirty limits only every DIRTY_RATELIMIT pages */
+	if (++ratelimit < DIRTY_RATELIMIT)
+		return;
+	ratelimit = 0;
+
+	/* get thresholds */
+	get_dirty_limits(&background, &limit);
+
+	/* heavy writer : do writeback ourself (stop if a pass doesn't clean any page) */
+	while (nr_dirty_pages > limit) {
+		kstat.dirty_throttle++;
+		nr_dirty = nr_dirty_pages;
+		if (!writeback_inodes(0, WRITEBACK_CHUNK, 0) || nr_dirty_pages >= nr_dirty)
+			break;
+		execute_block_requests();
+	}
+
+	/* above background threshold : wake up flusher */
+	if (nr_dirty_pages > background)
+		wakeup_bdflush();
+}
+
+/*
+ * Flusher work : write back expired inodes and dirty pages above background threshold.
+ */
+void wb_writeback()
+{
+	time_t older_than = jiffies - ms_to_jiffies(sysctl_dirty_expire_centisecs * 10);
+	uint32_t background, limit, nr_dirty;
+
+	/* write back expired inodes */
+	if (older_than > 0)
+		writeback_inodes(0, nr_dirty_pages, older_than);
+
+	/* write back until below background threshold (stop if a pass doesn't clean any page) */
+	get_dirty_limits(&background, &limit);
+	while (nr_dirty_pages > background) {
+		nr_dirty = nr_dirty_pages;
+		if (!writeback_inodes(0, WRITEBACK_CHUNK, 0) || nr_dirty_pages >= nr_dirty)
+			break;
+	}
+
+	/* start i/o */
+	execute_block_requests();
+}
@@ -5,16 +5,47 @@
 #include <mm/highmem.h>
 #include <mm/swap.h>
 #include <sys/syscall.h>
+#include <x86/cpu.h>
+#include <x86/uaccess.h>
+#include <kernel_stat.h>
 #include <stdio.h>
 #include <string.h>
 #include <stderr.h>
 
+#define PAGE_WAIT_TABLE_SIZE		64
+
 /* global pages */
 uint32_t nr_pages;
 struct page *page_array;
 
+/* tasks waiting for page unlock (hashed by page) */
+static struct wait_queue_head page_wait_table[PAGE_WAIT_TABLE_SIZE];
+
 /* page directories */
 pgd_t *pgd_kernel = NULL;
+static pgd_t *current_pgd = NULL;
+
+/* user readable kernel code (defined in linker script) */
+extern uint32_t usertext_start;
+extern uint32_t usertext_end;
+
+/* shared zero page */
+struct page *zero_page = NULL;
+
+/* large pages supported */
+static int pse_enabled = 0;
+
+/* tunables */
+int sysctl_fault_around_pages = 16;
+int sysctl_transparent_hugepage = 0;
+
+/*
+ * Get wait queue of a page.
+ */
+static inline struct wait_queue_head *page_waitqueue(struct page *page)
+{
+	return &page_wait_table[(page - page_array) % PAGE_WAIT_TABLE_SIZE];
+}
 
 /*
  * Wait on a page.
@@ -24,28 +55,76 @@ void wait_on_page(struct page *page)
 	if (!PageLocked(page))
 		return;
 
+	/* start queued requests */
 	execute_block_requests();
 
-	if (PageLocked(page))
-		panic("wait_on_page: page still locked after execute_block_requests()\n");
+	/* sleep until page is unlocked (run pending block work ourself : kinit can't wait for completion thread) */
+	wait_event(page_waitqueue(page), (blk_run_pending(), !PageLocked(page)));
+}
+
+/*
+ * Wait for end of page writeback.
+ */
+void wait_on_page_writeback(struct page *page)
+{
+	if (!PageWriteback(page))
+		return;
+
+	/* start queued requests */
+	execute_block_requests();
+
+	/* sleep until end of writeback */
+	wait_event(page_waitqueue(page), (blk_run_pending(), !PageWriteback(page)));
+}
+
+/*
+ * Wake up page waiters.
+ */
+void wake_up_page(struct page *page)
+{
+	wake_up(page_waitqueue(page));
 }
 
 /*
- * Flush a Translation Lookaside Buffer entry.
+ * Unlock a page and wake up waiters.
+ */
+void unlock_page(struct page *page)
+{
+	clear_bit(&page->flags, PG_lock);
+	wake_up_page(page);
+}
+
+/*
+ * Flush a Translation Lookaside Buffer entry (only if page directory is loaded).
  */
 void flush_tlb_page(pgd_t *pgd, uint32_t address)
 {
-	if (pgd == current_task->mm->pgd)
-		__asm__ __volatile__("invlpg (%0)" :: "r" (address) : "memory");
+	if (pgd != current_pgd)
+		return;
+
+	__asm__ __volatile__("invlpg (%0)" :: "r" (address) : "memory");
+	kstat.tlb_flush_page++;
+}
+
+/*
+ * Flush a kernel Translation Lookaside Buffer entry (kernel mappings are the same in all page directories).
+ */
+void flush_tlb_kernel_page(uint32_t address)
+{
+	__asm__ __volatile__("invlpg (%0)" :: "r" (address) : "memory");
+	kstat.tlb_flush_page++;
 }
 
 /*
- * Flush Translation Lookaside Buffers.
+ * Flush Translation Lookaside Buffers (global kernel entries are kept).
  */
 void flush_tlb(pgd_t *pgd)
 {
-	if (pgd == current_task->mm->pgd)
-		switch_pgd(pgd);
+	if (pgd != current_pgd)
+		return;
+
+	__asm__ __volatile__("mov %0, %%cr3" :: "r" (__pa(pgd)) : "memory");
+	kstat.tlb_flush_all++;
 }
 
 /*
@@ -53,8 +132,44 @@ void flush_tlb(pgd_t *pgd)
  */
 pmd_t *pmd_alloc(pgd_t *pgd, uint32_t address)
 {
-	UNUSED(address);
-	return (pmd_t *) pgd;
+	/* page middle directories are allocated with the page directory */
+	return pmd_offset(pgd, address);
+}
+
+/*
+ * Split a large page mapping into a page table (each page of the large page becomes a normal page).
+ */
+int split_huge_pmd(pmd_t *pmd)
+{
+	struct page *page;
+	uint32_t prot, i;
+	pte_t *ptes;
+
+	/* allocate a page table */
+	ptes = (pte_t *) get_free_page();
+	if (!ptes)
+		return -ENOMEM;
+
+	/* map each page */
+	page = pmd_huge_page(*pmd);
+	prot = *pmd & (PAGE_SIZE - 1) & ~PAGE_PSE;
+	for (i = 0; i < PTRS_PER_PTE; i++) {
+		if (i) {
+			page[i].inode = NULL;
+			page[i].offset = 0;
+			page[i].buffers = NULL;
+			page[i].count = 1;
+			page[i].flags = 0;
+		}
+
+		ptes[i] = mk_pte(&page[i], prot);
+	}
+
+	/* replace large page */
+	*pmd = __pa(ptes) | PAGE_TABLE;
+	kstat.thp_split++;
+
+	return 0;
 }
 
 /*
@@ -62,9 +177,12 @@ pmd_t *pmd_alloc(pgd_t *pgd, uint32_t address)
  */
 pte_t *pte_alloc(pmd_t *pmd, uint32_t address)
 {
-	uint32_t offset = address = (address >> (PAGE_SHIFT - 2)) & 4 * (PTRS_PER_PTE - 1);
 	pte_t *pte;
 
+	/* large page : split it */
+	if (pmd_huge(*pmd) && split_huge_pmd(pmd))
+		return NULL;
+
 	/* page table already allocated */
 	if (!pmd_none(*pmd))
 		goto out;
@@ -80,7 +198,7 @@ pte_t *pte_alloc(pmd_t *pmd, uint32_t address)
 	/* set page table */
 	*pmd = __pa(pte) | PAGE_TABLE;
 out:
-	return (pte_t *) (pmd_page(*pmd) + offset);
+	return pte_offset(pmd, address);
 }
 
 /*
@@ -94,7 +212,7 @@ static int pte_free(pte_t pte)
 		return 0;
 
 	if (!pte_present(pte)) {
-		swap_free(pte);
+		swap_free(pte_to_swp_entry(pte));
 		return 0;
 	}
 
@@ -174,7 +292,7 @@ int remap_pmd_range(pmd_t *pmd, uint32_t start, size_t size, uint32_t phys_addr,
 		/* remap */
 		remap_pte_range(pte, start, end - start, phys_addr + start, pgprot);
 
-		start += (start + PMD_SIZE) & PMD_MASK;
+		start = (start + PMD_SIZE) & PMD_MASK;
 		pmd++;
 	} while (start < end);
 
@@ -207,7 +325,7 @@ int remap_page_range(uint32_t start, uint32_t phys_addr, size_t size, int pgprot
 		}
 
 		/* remap */
-		ret = remap_pmd_range((pmd_t *) dir, start, end - start, phys_addr + start, pgprot);
+		ret = remap_pmd_range(pmd, start, end - start, phys_addr + start, pgprot);
 		if (ret)
 			break;
 
@@ -239,6 +357,18 @@ static size_t zap_pte_range(pmd_t *pmd, uint32_t address, size_t size)
 	if (end > ((address + PMD_SIZE) & PMD_MASK))
 		end = ((address + PMD_SIZE) & PMD_MASK);
 
+	/* large page : free it if fully unmapped, else split it */
+	if (pmd_huge(*pmd)) {
+		if (!(address & ~PMD_MASK) && end - address == PMD_SIZE) {
+			__free_pages(pmd_huge_page(*pmd), HPAGE_ORDER);
+			*pmd = 0;
+			return HPAGE_NR_PAGES;
+		}
+
+		if (split_huge_pmd(pmd))
+			return 0;
+	}
+
 	/* free page table entries */
 	do {
 		/* get page table entry */
@@ -267,7 +397,7 @@ static size_t zap_pmd_range(pgd_t *dir, uint32_t address, size_t size)
 	pmd_t *pmd;
 
 	/* get page table */
-	pmd = pmd_offset(dir);
+	pmd = pmd_offset(dir, address);
 
 	/* compute end address */
 	end = address + size;
@@ -277,7 +407,7 @@ static size_t zap_pmd_range(pgd_t *dir, uint32_t address, size_t size)
 	/* free page table */
 	do {
 		freed += zap_pte_range(pmd, address, end - address);
-		address += (address + PMD_SIZE) & PMD_MASK;
+		address = (address + PMD_SIZE) & PMD_MASK;
 		pmd++;
 	} while (address < end);
 
@@ -316,14 +446,18 @@ static int do_anonymous_page(struct vm_area *vma, pte_t *pte, int write_access)
 {
 	struct page *page;
 
-	/* try to get a page */
-	page = __get_free_page(GFP_HIGHUSER);
+	/* read access on private mapping : map shared zero page (copy on write) */
+	if (!write_access && !(vma->vm_flags & VM_SHARED)) {
+		*pte = pte_wrprotect(mk_pte(zero_page, vma->vm_page_prot));
+		kstat.zero_page_hits++;
+		return 1;
+	}
+
+	/* get a zeroed page */
+	page = get_zeroed_user_page();
 	if (!page)
 		return 0;
 
-	/* clear page */
-	clear_user_highpage(page);
-
 	/* make page table entry */
 	*pte = mk_pte(page, vma->vm_page_prot);
 	if (write_access)
@@ -335,6 +469,33 @@ static int do_anonymous_page(struct vm_area *vma, pte_t *pte, int write_access)
 	return 1;
 }
 
+/*
+ * Map cached pages around a faulting address (window is aligned on fault around size and limited to vma and page table).
+ */
+static void do_fault_around(struct vm_area *vma, uint32_t address)
+{
+	uint32_t index, start, end, pmd_start = address & PMD_MASK;
+
+	/* align window on file offset */
+	index = (address - vma->vm_start + vma->vm_offset) >> PAGE_SHIFT;
+	start = address - ((index % sysctl_fault_around_pages) << PAGE_SHIFT);
+	if (start < vma->vm_start || start > address)
+		start = vma->vm_start;
+	if (start < pmd_start)
+		start = pmd_start;
+
+	/* limit window to vma and page table */
+	end = start + (sysctl_fault_around_pages << PAGE_SHIFT);
+	if (end > vma->vm_end || end < start)
+		end = vma->vm_end;
+	if (end - pmd_start > PMD_SIZE)
+		end = pmd_start + PMD_SIZE;
+
+	/* map pages */
+	vma->vm_ops->map_pages(vma, start, end);
+	kstat.fault_around++;
+}
+
 /*
  * Handle a no page fault.
  */
@@ -349,6 +510,13 @@ static int do_no_page(struct vm_area *vma, uint32_t address, int write_access, p
 	if (!vma->vm_ops || !vma->vm_ops->nopage)
 		return do_anonymous_page(vma, pte, write_access);
 
+	/* read fault : try to map cached pages around first (not on random access hint) */
+	if (!write_access && vma->vm_ops->map_pages && sysctl_fault_around_pages > 1 && !(vma->vm_flags & VM_RAND_READ)) {
+		do_fault_around(vma, address);
+		if (!pte_none(*pte))
+			return 1;
+	}
+
 	/* specific mapping */
 	new_page = vma->vm_ops->nopage(vma, address);
 	if (!new_page)
@@ -392,6 +560,22 @@ static int do_wp_page(struct vm_area *vma, uint32_t address, pte_t *pte)
 	/* get page */
 	old_page = pte_page(*pte);
 
+	/* shared zero page : just get a new zeroed page */
+	if (old_page == zero_page) {
+		new_page = get_zeroed_user_page();
+		if (!new_page)
+			return 0;
+
+		/* set pte */
+		*pte = pte_mkdirty(pte_mkwrite(mk_pte(new_page, vma->vm_page_prot)));
+		flush_tlb_page(vma->vm_mm->pgd, address);
+
+		/* update memory size */
+		vma->vm_mm->rss++;
+
+		return 1;
+	}
+
 	/* only one user make page table entry writable */
 	if (old_page->count == 1) {
 		*pte = pte_mkdirty(pte_mkwrite(*pte));
@@ -447,7 +631,7 @@ static int handle_pte_fault(struct vm_area *vma, uint32_t address, int write_acc
 	if (!pte_present(*pte)) {
 		if (pte_none(*pte))
 			return do_no_page(vma, address, write_access, pte);
-		return swap_in(vma, pte, *pte, write_access);
+		return swap_in(vma, pte, pte_to_swp_entry(*pte), write_access);
 	}
 
 	/* write access */
@@ -457,26 +641,148 @@ static int handle_pte_fault(struct vm_area *vma, uint32_t address, int write_acc
 	return 0;
 }
 
+/*
+ * Check if a large page can be used to map an address.
+ */
+static int huge_page_possible(struct vm_area *vma, uint32_t address)
+{
+	uint32_t start = address & PMD_MASK;
+
+	/* disabled or not supported */
+	if (!sysctl_transparent_hugepage || !pse_enabled)
+		return 0;
+
+	/* only private writable anonymous memory */
+	if (vma->vm_ops || (vma->vm_flags & (VM_SHARED | VM_WRITE | VM_GROWSDOWN)) != VM_WRITE)
+		return 0;
+
+	/* large page must be fully inside memory region */
+	return start >= vma->vm_start && start + PMD_SIZE <= vma->vm_end && start + PMD_SIZE > start;
+}
+
+/*
+ * Map a large page.
+ */
+static int do_huge_page(struct vm_area *vma, pmd_t *pmd)
+{
+	struct page *page;
+	uint32_t i;
+
+	/* get a large page */
+	page = get_free_huge_page();
+	if (!page) {
+		kstat.thp_fault_fallback++;
+		return 0;
+	}
+
+	/* clear it */
+	for (i = 0; i < HPAGE_NR_PAGES; i++)
+		clear_user_highpage(&page[i]);
+
+	/* map it */
+	*pmd = ((pmd_t) (page - page_array) << PAGE_SHIFT) | vma->vm_page_prot | PAGE_RW | PAGE_DIRTY | PAGE_PSE;
+
+	/* update memory size */
+	vma->vm_mm->rss += HPAGE_NR_PAGES;
+	kstat.thp_fault_alloc++;
+
+	return 1;
+}
+
 /*
  * Handle memory fault.
  */
 static int handle_mm_fault(struct vm_area *vma, uint32_t address, int write_access)
 {
+	uint32_t maj_flt = current_task->maj_flt;
 	pgd_t *pgd;
 	pmd_t *pmd;
 	pte_t *pte;
+	int ret;
 
 	/* get page table entry */
 	pgd = pgd_offset(vma->vm_mm->pgd, address);
 	pmd = pmd_alloc(pgd, address);
 	if (!pmd)
 		return -1;
+
+	/* try to map a large page */
+	if (pmd_none(*pmd) && huge_page_possible(vma, address) && do_huge_page(vma, pmd)) {
+		current_task->min_flt++;
+		return 1;
+	}
+
 	pte = pte_alloc(pmd, address);
 	if (!pte)
 		return -1;
 
 	/* handle fault */
-	return handle_pte_fault(vma, address, write_access, pte);
+	ret = handle_pte_fault(vma, address, write_access, pte);
+
+	/* no page read from disk or swap : minor fault */
+	if (current_task->maj_flt == maj_flt)
+		current_task->min_flt++;
+
+	return ret;
+}
+
+/*
+ * Prefault all pages of [start, end[ (used by mlock and MAP_POPULATE : failures are not fatal, pages which
+ * can't be prefaulted are faulted on access).
+ */
+int make_pages_present(uint32_t start, uint32_t end)
+{
+	int write_access, ret = 0;
+	struct vm_area *vma;
+	uint32_t address;
+	pgd_t *pgd;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	for (address = start & PAGE_MASK; address < end; address += PAGE_SIZE) {
+		/* get memory region */
+		vma = find_vma(current_task->mm, address);
+		if (!vma || vma->vm_start >= end)
+			break;
+
+		/* hole : go to next memory region */
+		if (vma->vm_start > address) {
+			ret = -EFAULT;
+			address = vma->vm_start;
+		}
+
+		/* no access allowed : nothing to prefault */
+		if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC))) {
+			address = vma->vm_end - PAGE_SIZE;
+			continue;
+		}
+
+		/* private writable mapping : break copy on write now */
+		write_access = (vma->vm_flags & (VM_WRITE | VM_SHARED)) == VM_WRITE;
+
+		/* large page : already mapped */
+		pgd = pgd_offset(vma->vm_mm->pgd, address);
+		pmd = pmd_offset(pgd, address);
+		if (!pmd_none(*pmd) && pmd_huge(*pmd)) {
+			address = (address & PMD_MASK) + PMD_SIZE - PAGE_SIZE;
+			continue;
+		}
+
+		/* page already present */
+		if (!pmd_none(*pmd)) {
+			pte = pte_offset(pmd, address);
+			if (pte_present(*pte) && (!write_access || (*pte & PAGE_RW)))
+				continue;
+		}
+
+		/* fault page (beyond end of file or no memory : skip rest of memory region) */
+		if (handle_mm_fault(vma, address, write_access) <= 0) {
+			ret = -ENOMEM;
+			address = vma->vm_end - PAGE_SIZE;
+		}
+	}
+
+	return ret;
 }
 
 /*
@@ -491,6 +797,9 @@ void page_fault_handler(struct registers *regs)
 	/* faulting address is stored in CR2 register */
 	__asm__ volatile("mov %%cr2, %0" : "=r" (fault_addr));
 
+	/* update statistics */
+	kstat.pgfault++;
+
 	/* page fault on task end : kill current task */
 	if (fault_addr == TASK_RETURN_ADDRESS) {
 		do_exit(0);
@@ -504,6 +813,10 @@ void page_fault_handler(struct registers *regs)
 	reserved = regs->err_code & 0x8 ? 1 : 0;
 	id = regs->err_code & 0x10 ? 1 : 0;
 
+	/* atomic copy to/from user space : can't sleep, let caller retry */
+	if (!user && pagefault_disabled && fixup_exception(regs))
+		return;
+
 	/* get memory region */
 	vma = find_vma(current_task->mm, fault_addr);
 	if (!vma)
@@ -535,12 +848,16 @@ good_area:
 
 	return;
 bad_area:
+	/* kernel access to user space through a copy routine : caller returns -EFAULT */
+	if (!user && fixup_exception(regs))
+		return;
+
 	/* output message */
 	printf("Page fault at address=0x%x | present=%d write-access=%d user-mode=%d reserved=%d instruction-fetch=%d (process %d - %s at 0x%x)\n",
 	       fault_addr, present, write_access, user, reserved, id, current_task->pid, current_task->name, regs->eip);
 
-	/* user mode : exit process */
-	if (user)
+	/* user mode or bad user pointer passed to kernel : exit process */
+	if (user || (fault_addr < PAGE_OFFSET && current_task->mm && current_task->mm->pgd != pgd_kernel))
 		do_exit(SIGKILL);
 
 	/* otherwise panic */
@@ -552,14 +869,43 @@ bad_area:
  */
 void switch_pgd(pgd_t *pgd)
 {
-	uint32_t cr0;
+	/* same address space : keep TLB */
+	if (pgd == current_pgd) {
+		kstat.tlb_switch_skipped++;
+		return;
+	}
 
 	/* switch */
+	__asm__ volatile("mov %0, %%cr3" :: "r" (__pa(pgd)) : "memory");
+	current_pgd = pgd;
+	kstat.tlb_switch++;
+}
+
+/*
+ * Enable paging.
+ */
+static void enable_paging(pgd_t *pgd)
+{
+	uint32_t cr0, cr4;
+
+	/* load page directory */
 	__asm__ volatile("mov %0, %%cr3" :: "r" (__pa(pgd)));
+	current_pgd = pgd;
+
+	/* enable large pages, physical address extension and global pages */
+	__asm__ volatile("mov %%cr4, %0" : "=r" (cr4));
+	if (pse_enabled)
+		cr4 |= 0x00000010;
+#ifdef CONFIG_X86_PAE
+	cr4 |= 0x00000020;
+#endif
+	if (cpu_has(X86_FEATURE_PGE))
+		cr4 |= 0x00000080;
+	__asm__ volatile("mov %0, %%cr4" :: "r" (cr4));
+
+	/* enable paging and write protection of read only pages in kernel mode (needed for copy on write) */
 	__asm__ volatile("mov %%cr0, %0" : "=r" (cr0));
-
-	/* enable paging */
-	cr0 |= 0x80000000;
+	cr0 |= 0x80010000;
 	__asm__ volatile("mov %0, %%cr0" :: "r" (cr0));
 }
 
@@ -569,16 +915,42 @@ void switch_pgd(pgd_t *pgd)
 pgd_t *create_page_directory()
 {
 	pgd_t *pgd_new;
+#ifdef CONFIG_X86_PAE
+	pmd_t *pmd;
+	int i;
+#endif
 
 	/* create a new page directory */
 	pgd_new = (pgd_t *) get_free_page();
 	if (!pgd_new)
 		return NULL;
 
+#ifdef CONFIG_X86_PAE
+	/* allocate all page middle directories (page directory pointers are loaded once, with cr3) */
+	memset(pgd_new, 0, PAGE_SIZE);
+	for (i = 0; i < PTRS_PER_PGD; i++) {
+		pmd = (pmd_t *) get_free_page();
+		if (!pmd)
+			goto err;
+
+		/* copy kernel page middle directory */
+		memcpy(pmd, pmd_offset(&pgd_kernel[i], 0), PAGE_SIZE);
+		pgd_new[i] = __pa(pmd) | PAGE_PRESENT;
+	}
+#else
 	/* copy kernel page directory */
 	memcpy(pgd_new, pgd_kernel, PAGE_SIZE);
+#endif
 
 	return pgd_new;
+#ifdef CONFIG_X86_PAE
+err:
+	for (i = 0; i < PTRS_PER_PGD; i++)
+		if (pgd_new[i])
+			free_page(pmd_offset(&pgd_new[i], 0));
+	free_page(pgd_new);
+	return NULL;
+#endif
 }
 
 /*
@@ -602,17 +974,23 @@ int copy_page_range(pgd_t *pgd_src, pgd_t *pgd_dst, struct vm_area *vma)
 		pgd_src++;
 		pgd_dst++;
 
-		pmd_src = pmd_offset(pgd_src);
-		pmd_dst = pmd_offset(pgd_dst);
+		pmd_src = pmd_offset(pgd_src, address);
+		pmd_dst = pmd_offset(pgd_dst, address);
 
 		/* for each page table */
 		do {
+			/* no page table : go to next one */
 			if (pmd_none(*pmd_src)) {
 				address = (address + PMD_SIZE) & PMD_MASK;
-				if (address >= end)
+				if (address >= end || !address)
 					goto out;
+				goto next_pmd;
 			}
 
+			/* large page : split it (pages are then shared page by page) */
+			if (pmd_huge(*pmd_src) && split_huge_pmd(pmd_src))
+				goto nomem;
+
 			/* allocate a new pmd */
 			if (pmd_none(*pmd_dst))
 				if (!pte_alloc(pmd_dst, 0))
@@ -660,7 +1038,7 @@ next_pte:
 				pte_src++;
 				pte_dst++;
 			} while ((uint32_t) pte_src & PTE_TABLE_MASK);
-
+next_pmd:
 			pmd_src++;
 			pmd_dst++;
 		} while ((uint32_t) pmd_src & PMD_TABLE_MASK);
@@ -681,6 +1059,12 @@ static void free_pmd(pmd_t *pmd)
 	pte_t *ptes;
 	int i;
 
+	/* large page */
+	if (pmd_huge(*pmd)) {
+		__free_pages(pmd_huge_page(*pmd), HPAGE_ORDER);
+		return;
+	}
+
 	/* get table entries */
 	ptes = (pte_t *) pmd_page(*pmd);
 	if (ptes < (pte_t *) PAGE_OFFSET)
@@ -706,45 +1090,108 @@ static void free_pmd(pmd_t *pmd)
 void free_pgd(pgd_t *pgd)
 {
 	pmd_t *pmd, *pmd_kernel;
-	int i;
+	int i, j;
 
 	if (!pgd)
 		return;
 
-	/* get page tables */
-	pmd = pmd_offset(pgd);
-	pmd_kernel = pmd_offset(pgd_kernel);
+	/* page directory still loaded (exiting task or lazy kernel thread) : leave it */
+	if (pgd == current_pgd)
+		switch_pgd(pgd_kernel);
 
-	/* free page tables */
-	for (i = 0; i < PTRS_PER_PTE; i++, pmd++, pmd_kernel++)
-		if (pmd_page(*pmd) != pmd_page(*pmd_kernel))
-			free_pmd(pmd);
+	for (i = 0; i < PTRS_PER_PGD; i++) {
+		/* get page tables */
+		pmd = pmd_offset(&pgd[i], 0);
+		pmd_kernel = pmd_offset(&pgd_kernel[i], 0);
+
+		/* free page tables */
+		for (j = 0; j < PTRS_PER_PMD; j++)
+			if (pmd_page(pmd[j]) != pmd_page(pmd_kernel[j]))
+				free_pmd(&pmd[j]);
+
+#ifdef CONFIG_X86_PAE
+		/* free page middle directory */
+		free_page(pmd);
+#endif
+	}
 
 	/* free page directory */
 	free_page(pgd);
 }
 
+/*
+ * Get a kernel page table before paging is enabled (page directories are accessed with physical addresses).
+ */
+static pmd_t *boot_pmd_offset(uint32_t address)
+{
+#ifdef CONFIG_X86_PAE
+	return (pmd_t *) (uint32_t) (pgd_kernel[address >> PGDIR_SHIFT] & PAGE_MASK) + ((address >> PMD_SHIFT) & (PTRS_PER_PMD - 1));
+#else
+	return (pmd_t *) pgd_offset(pgd_kernel, address);
+#endif
+}
+
 /*
  * Init paging.
  */
 int init_paging(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_end)
 {
-	uint32_t addr, i;
-	pgd_t *pgd;
+	uint32_t addr, lowmem_end, max_pages, global = 0, i;
 	pmd_t *pmd;
 	pte_t *pte;
 	int ret;
 
-	/* compute number of pages */
-	nr_pages = mem_end / PAGE_SIZE;
+#ifdef CONFIG_X86_PAE
+	/* physical address extension needed */
+	if (!cpu_has(X86_FEATURE_PAE)) {
+		printf("Paging: PAE not supported by CPU\n");
+		return -ENOSYS;
+	}
+#endif
+
+	/* compute number of pages (memory map may report memory above 4 GB) */
+	nr_pages = bios_map_end_pfn();
+	if (nr_pages < mem_end / PAGE_SIZE)
+		nr_pages = mem_end / PAGE_SIZE;
+
+	/* limit memory to physical address space and to pages array size (array is stored in low memory) */
+	max_pages = (KPAGE_END - KPAGE_START) / 2 / sizeof(struct page);
+	if (max_pages > MAX_PHYS_PAGES)
+		max_pages = MAX_PHYS_PAGES;
+	if (nr_pages > max_pages) {
+		printf("Paging: only %u MB of %u MB memory are usable\n", max_pages >> (20 - PAGE_SHIFT), nr_pages >> (20 - PAGE_SHIFT));
+		nr_pages = max_pages;
+	}
+
+	/* compute end of low memory */
+	if (nr_pages < __pa(KPAGE_END) / PAGE_SIZE)
+		lowmem_end = nr_pages * PAGE_SIZE;
+	else
+		lowmem_end = __pa(KPAGE_END);
+
+	/* kernel mappings are global if possible (kept in TLB on page directory switch) */
+	if (cpu_has(X86_FEATURE_PGE))
+		global = PAGE_GLOBAL;
+
+	/* large pages supported */
+	pse_enabled = cpu_has(X86_FEATURE_PSE);
 
 	/* allocate kernel page directory after kernel code */
 	pgd_kernel = (pgd_t *) PAGE_ALIGN_UP(kernel_end);
 	memset(pgd_kernel, 0, PAGE_SIZE);
 	kernel_end = (uint32_t) pgd_kernel + PAGE_SIZE;
 
-	/* map kernel code pages to low memory */
-	pmd = pmd_offset(pgd_kernel);
+#ifdef CONFIG_X86_PAE
+	/* allocate kernel page middle directories */
+	for (i = 0; i < PTRS_PER_PGD; i++) {
+		memset((void *) kernel_end, 0, PAGE_SIZE);
+		pgd_kernel[i] = (pgd_t) kernel_end | PAGE_PRESENT;
+		kernel_end += PAGE_SIZE;
+	}
+#endif
+
+	/* map kernel code pages to low memory (only user trampolines are visible from user mode) */
+	pmd = boot_pmd_offset(KCODE_START);
 	for (addr = KCODE_START; addr < KCODE_END; ) {
 		/* allocate page table */
 		*pmd = (pmd_t) kernel_end | PAGE_TABLE;
@@ -752,8 +1199,11 @@ int init_paging(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_end)
 
 		/* set page table entries */
 		for (i = 0; i < PTRS_PER_PTE; i++) {
-			pte = (pte_t *) (*pmd & PAGE_MASK) + i;
-			*pte = mk_pte_phys(addr, PAGE_READONLY);
+			pte = (pte_t *) (uint32_t) (*pmd & PAGE_MASK) + i;
+			if (addr >= (uint32_t) &usertext_start && addr < (uint32_t) &usertext_end)
+				*pte = mk_pte_phys(addr, PAGE_READONLY | global);
+			else
+				*pte = mk_pte_phys(addr, PAGE_KERNEL | global);
 			addr += PAGE_SIZE;
 		}
 
@@ -762,18 +1212,26 @@ int init_paging(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_end)
 	}
 
 	/* map kernel pages to high memory */
-	pmd = pmd_offset(pgd_kernel) + 768;
-	for (addr = 0; addr < mem_end && addr < __pa(KPAGE_END);) {
+	pmd = boot_pmd_offset(KPAGE_START);
+	for (addr = 0; addr < lowmem_end;) {
+		/* use a large page if possible */
+		if (pse_enabled && addr + PMD_SIZE <= lowmem_end) {
+			*pmd = (pmd_t) addr | PAGE_KERNEL | PAGE_PSE | global;
+			addr += PMD_SIZE;
+			pmd++;
+			continue;
+		}
+
 		/* allocate page table */
 		*pmd = (pmd_t) kernel_end | PAGE_TABLE;
 		kernel_end += PAGE_SIZE;
 
 		/* set page table entries */
 		for (i = 0; i < PTRS_PER_PTE; i++) {
-			pte = (pte_t *) (*pmd & PAGE_MASK) + i;
+			pte = (pte_t *) (uint32_t) (*pmd & PAGE_MASK) + i;
 
-			if (addr < mem_end && addr < __pa(KPAGE_END))
-				*pte = mk_pte_phys(addr, PAGE_KERNEL);
+			if (addr < lowmem_end)
+				*pte = mk_pte_phys(addr, PAGE_KERNEL | global);
 			else
 				*pte = 0;
 
@@ -784,28 +1242,45 @@ int init_paging(uint32_t kernel_start, uint32_t kernel_end, uint32_t mem_end)
 		pmd++;
 	}
 
-	/* allocate pkmap page table entries */
-	addr = PKMAP_BASE;
-	pgd = pgd_offset(pgd_kernel, addr);
-	pmd = pmd_offset(pgd);
+	/* allocate pkmap page table entries (page tables are contiguous) */
+	for (addr = PKMAP_BASE; addr < PKMAP_ADDR(LAST_PKMAP); addr += PMD_SIZE) {
+		pmd = boot_pmd_offset(addr);
+		memset((void *) kernel_end, 0, PAGE_SIZE);
+		*pmd = (pmd_t) kernel_end | PAGE_TABLE;
+		kernel_end += PAGE_SIZE;
+	}
+	pkmap_page_table = pte_offset(boot_pmd_offset(PKMAP_BASE), PKMAP_BASE);
+
+	/* allocate fixmap page table entries (used by atomic kmaps) */
+	addr = FIXADDR_START;
+	pmd = boot_pmd_offset(addr);
+	memset((void *) kernel_end, 0, PAGE_SIZE);
 	*pmd = (pmd_t) kernel_end | PAGE_TABLE;
 	kernel_end += PAGE_SIZE;
-	pkmap_page_table = pte_offset(pmd, addr);
+	fixmap_page_table = pte_offset(pmd, addr);
+
+	/* init page wait queues */
+	for (i = 0; i < PAGE_WAIT_TABLE_SIZE; i++)
+		init_waitqueue_head(&page_wait_table[i]);
 
 	/* register page fault handler */
 	register_exception_handler(14, page_fault_handler);
 
 	/* move kernel's pgd to high memory and enable paging */
 	pgd_kernel = __va(pgd_kernel);
-	switch_pgd(pgd_kernel);
+	enable_paging(pgd_kernel);
 
 	/* init page allocation */
 	ret = init_page_alloc(kernel_start, kernel_end);
 	if (ret)
 		return ret;
 
-	/* init page cache */
-	init_page_cache();
+	/* allocate shared zero page */
+	zero_page = __get_free_page(GFP_KERNEL);
+	if (!zero_page)
+		return -ENOMEM;
+	memset(page_address(zero_page), 0, PAGE_SIZE);
+	SetPageReserved(zero_page);
 
 	return 0;
 }
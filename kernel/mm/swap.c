@@ -12,6 +12,10 @@ static size_t nr_swapfiles = 0;
 static struct inode swapper_inode;
 static int least_priority = 0;
 static LIST_HEAD(swap_list);
+static uint32_t nr_swap_writes = 0;
+
+/* tunables */
+int sysctl_page_cluster = 3;
 
 /*
  * Get informations on swap.
@@ -37,9 +41,6 @@ void si_swapinfo(struct sysinfo *info)
 			info->totalswap++;
 		}
 	}
-
-	info->freeswap <<= PAGE_SHIFT;
-	info->totalswap <<= PAGE_SHIFT;
 }
 
 /*
@@ -99,7 +100,7 @@ static struct page *lookup_swap_cache(uint32_t entry)
 	struct page *page;
 
 	for (;;) {
-		page = find_page(&swapper_inode, entry);
+		page = find_page(&swapper_inode, SWP_CACHE_OFFSET(entry));
 		if (!page)
 			return NULL;
 		if (page->inode != &swapper_inode || !PageSwapCache(page))
@@ -122,13 +123,16 @@ err:
 static int add_to_swap_cache(struct page *page, uint32_t entry)
 {
 	if (PageSwapCache(page) || page->inode) {
-		printf("swap_cache: replacing non-empty entry %08lx on page %08lx\n", page->offset, page_address(page));
+		printf("swap_cache: replacing non-empty entry %08lx on page %08lx\n", SWP_CACHE_ENTRY(page), page_address(page));
 		return 0;
 	}
 
 	SetPageSwapCache(page);
 	page->flags = page->flags & ~(1 << PG_uptodate);
-	add_to_page_cache(page, &swapper_inode, entry);
+	if (add_to_page_cache(page, &swapper_inode, SWP_CACHE_OFFSET(entry))) {
+		ClearPageSwapCache(page);
+		return 0;
+	}
 
 	return 1;
 }
@@ -151,25 +155,57 @@ static void remove_from_swap_cache(struct page *page)
 }
 
 /*
- * Find a free swap entry.
+ * Find a free swap entry (slots are handed out in contiguous clusters, so that swap out writes are sequential).
  */
 static int scan_swap_map(struct swap_info *si)
 {
-	uint32_t offset;
+	uint32_t offset, base, i;
 
-	for (offset = si->lowest_bit; offset <= si->highest_bit; offset++) {
-		if (si->swap_map[offset])
-			continue;
+	/* try to continue current cluster */
+	while (si->cluster_nr) {
+		offset = si->cluster_next++;
+		si->cluster_nr--;
 
-		si->lowest_bit = offset;
-		si->swap_map[offset] = 1;
-		if (offset == si->highest_bit)
-			si->highest_bit--;
+		if (offset > si->highest_bit)
+			break;
+		if (!si->swap_map[offset])
+			goto got_page;
+	}
+	si->cluster_nr = 0;
+
+	/* find a new free cluster */
+	for (base = si->lowest_bit; base + SWAPFILE_CLUSTER - 1 <= si->highest_bit; base++) {
+		for (i = 0; i < SWAPFILE_CLUSTER; i++)
+			if (si->swap_map[base + i])
+				break;
 
-		return offset;
+		/* free cluster found */
+		if (i == SWAPFILE_CLUSTER) {
+			si->cluster_next = base + 1;
+			si->cluster_nr = SWAPFILE_CLUSTER - 1;
+			kstat.swap_cluster_alloc++;
+			offset = base;
+			goto got_page;
+		}
+
+		/* skip used slot */
+		base += i;
 	}
 
+	/* no free cluster : take first free slot */
+	for (offset = si->lowest_bit; offset <= si->highest_bit; offset++)
+		if (!si->swap_map[offset])
+			goto got_page;
+
 	return 0;
+got_page:
+	si->swap_map[offset] = 1;
+	if (offset == si->lowest_bit)
+		si->lowest_bit++;
+	if (offset == si->highest_bit)
+		si->highest_bit--;
+
+	return offset;
 }
 
 /*
@@ -270,6 +306,10 @@ void swap_free(uint32_t entry)
 				si->lowest_bit = offset;
 			if (offset > si->highest_bit)
 				si->highest_bit = offset;
+
+			/* let the swap device release the slot */
+			if (si->swap_device && blk_dev[major(si->swap_device)].swap_slot_free_notify)
+				blk_dev[major(si->swap_device)].swap_slot_free_notify(si->swap_device, offset);
 		}
 	}
 
@@ -335,9 +375,9 @@ err:
 }
 
 /*
- * Read/write a swap page.
+ * Read/write a swap page (if wait is not set, i/o is only queued and the page stays locked until completion).
  */
-static void rw_swap_page_base(int rw, uint32_t entry, struct page *page)
+static void rw_swap_page_base(int rw, uint32_t entry, struct page *page, int wait)
 {
 	uint32_t type, offset, block, blocks[PAGE_SIZE / 512];
 	size_t block_size, nr_blocks;
@@ -380,7 +420,7 @@ static void rw_swap_page_base(int rw, uint32_t entry, struct page *page)
 	}
 
 	/* check page */
-	if (PageSwapCache(page) && page->offset != entry) {
+	if (PageSwapCache(page) && SWP_CACHE_ENTRY(page) != entry) {
 		printf("rw_swap_page_base: swap entry mismatch\n");
 		return;
 	}
@@ -425,6 +465,13 @@ static void rw_swap_page_base(int rw, uint32_t entry, struct page *page)
 
 	 /* read/write page */
  	brw_page(rw, page, dev, blocks, nr_blocks, block_size);
+
+	/* asynchronous i/o : swap cache reference keeps the page until completion */
+	if (!wait) {
+		page->count--;
+		return;
+	}
+
 	wait_on_page(page);
 	__free_page(page);
 }
@@ -432,7 +479,7 @@ static void rw_swap_page_base(int rw, uint32_t entry, struct page *page)
 /*
  * Read/write a swap page.
  */
-static void rw_swap_page(int rw, uint32_t entry, char *buffer)
+static void rw_swap_page(int rw, uint32_t entry, char *buffer, int wait)
 {
 	struct page *page = &page_array[MAP_NR(buffer)];
 
@@ -443,13 +490,13 @@ static void rw_swap_page(int rw, uint32_t entry, char *buffer)
 		printf("rw_swap_page: swap page is not in swap cache\n");
 		return;
 	}
-	if (page->offset != entry) {
+	if (SWP_CACHE_ENTRY(page) != entry) {
 		printf("rw_swap_page: swap entry mismatch\n");
 		return;
 	}
 
 	/* read/write swap page */
-	rw_swap_page_base(rw, entry, page);
+	rw_swap_page_base(rw, entry, page, wait);
 }
 
 /*
@@ -472,18 +519,18 @@ static void rw_swap_page_nocache(int rw, uint32_t entry, char *buffer)
 	/* read/write page */
 	set_bit(&page->flags, PG_swap_cache);
 	page->inode = &swapper_inode;
-	page->offset = entry;
+	page->offset = SWP_CACHE_OFFSET(entry);
 	page->count++;
-	rw_swap_page(rw, entry, buffer);
+	rw_swap_page(rw, entry, buffer, 1);
 	page->count--;
 	page->inode = NULL;
 	clear_bit(&page->flags, PG_swap_cache);
 }
 
 /*
- * Read a page from disk and store it in cache.
+ * Read a page from disk and store it in cache (if wait is not set, the returned page may still be locked under i/o).
  */
-static struct page *read_swap_cache(uint32_t entry)
+static struct page *read_swap_cache(uint32_t entry, int wait)
 {
 	struct page *found_page = NULL, *new_page;
 
@@ -512,7 +559,7 @@ static struct page *read_swap_cache(uint32_t entry)
 
 	/* read page from disk */
 	set_bit(&new_page->flags, PG_lock);
-	rw_swap_page(READ, entry, page_address(new_page));
+	rw_swap_page(READ, entry, page_address(new_page), wait);
 
 	return new_page;
 out_free_page:
@@ -535,7 +582,7 @@ static int is_page_shared(struct page *page)
 
 	count = page->count;
 	if (PageSwapCache(page))
-		count += swap_count(page->offset) - 2;
+		count += swap_count(SWP_CACHE_ENTRY(page)) - 2;
 
 	return count > 1;
 }
@@ -543,12 +590,15 @@ static int is_page_shared(struct page *page)
 /*
  * Delete a page from swap cache.
  */
-static void delete_from_swap_cache(struct page *page)
+void delete_from_swap_cache(struct page *page)
 {
-	uint32_t entry = page->offset;
+	uint32_t entry = SWP_CACHE_ENTRY(page);
 
 	remove_from_swap_cache(page);
 	swap_free(entry);
+
+	/* release swap cache reference */
+	__free_page(page);
 }
 
 /*
@@ -563,6 +613,60 @@ void free_page_and_swap_cache(struct page *page)
 	__free_page(page);
 }
 
+/*
+ * Read ahead the allocated slots of the cluster around entry into the swap cache.
+ */
+static void swapin_readahead(uint32_t entry)
+{
+	uint32_t type, offset, start, end, nr;
+	struct swap_info *si;
+	struct page *page;
+
+	/* readahead disabled or memory low */
+	if (!sysctl_page_cluster || nr_free_pages() < 2 * SWAP_CLUSTER_MAX)
+		return;
+
+	/* get swap file */
+	type = SWP_TYPE(entry);
+	if (type >= nr_swapfiles)
+		return;
+	si = &swap_info[type];
+	if (!(si->flags & SWP_USED))
+		return;
+
+	/* compute aligned window (slot 0 holds swap header) */
+	nr = 1 << sysctl_page_cluster;
+	start = SWP_OFFSET(entry) & ~(nr - 1);
+	end = start + nr;
+	if (!start)
+		start = 1;
+	if (end > si->max)
+		end = si->max;
+
+	for (offset = start; offset < end; offset++) {
+		/* skip faulting, free and bad slots */
+		if (offset == SWP_OFFSET(entry))
+			continue;
+		if (!si->swap_map[offset] || si->swap_map[offset] == SWAP_MAP_BAD)
+			continue;
+
+		/* skip slots already cached */
+		page = find_page(&swapper_inode, SWP_CACHE_OFFSET(SWP_ENTRY(type, offset)));
+		if (page) {
+			__free_page(page);
+			continue;
+		}
+
+		/* queue read (only the swap cache keeps the page) */
+		page = read_swap_cache(SWP_ENTRY(type, offset), 0);
+		if (page) {
+			SetPageReadahead(page);
+			kstat.swap_ra++;
+			__free_page(page);
+		}
+	}
+}
+
 /*
  * Swap in a page.
  */
@@ -573,12 +677,23 @@ int swap_in(struct vm_area *vma, pte_t *pte, uint32_t entry, int write_access)
 	/* try to find swap page in cache */
 	page = lookup_swap_cache(entry);
 
-	/* read page on disk if needed */
-	if (!page)
-		page = read_swap_cache(entry);
+	/* read page on disk if needed, with its neighbours */
+	if (!page) {
+		current_task->maj_flt++;
+		page = read_swap_cache(entry, 0);
+		swapin_readahead(entry);
+		if (page)
+			wait_on_page(page);
+	}
+
+	/* page was read ahead */
+	if (page && PageReadahead(page)) {
+		ClearPageReadahead(page);
+		kstat.swap_ra_hit++;
+	}
 
 	/* check entry */
-	if (*pte != entry) {
+	if (*pte != swp_entry_to_pte(entry)) {
 		if (page)
 			free_page_and_swap_cache(page);
 		return 1;
@@ -621,15 +736,15 @@ static int try_to_swap_out(struct vm_area *vma, uint32_t address, pte_t *pte)
 	if (!VALID_PAGE(page))
 		return 0;
 
-	/* skip reserved pages */
-	if (PageReserved(page))
+	/* skip reserved and merged pages */
+	if (PageReserved(page) || PageKsm(page))
 		return 0;
 
 	/* page already in swap cache */
 	if (PageSwapCache(page)) {
-		entry = page->offset;
+		entry = SWP_CACHE_ENTRY(page);
 		swap_duplicate(entry);
-		*pte = entry;
+		*pte = swp_entry_to_pte(entry);
 		goto drop_pte;
 	}
 
@@ -638,6 +753,16 @@ static int try_to_swap_out(struct vm_area *vma, uint32_t address, pte_t *pte)
 		/* clean page : drop pte */
 		if (!pte_dirty(*pte)) {
 			pte_clear(pte);
+
+			/* sequential hint : drop page from cache if nobody else uses it (shared memory pages are the only copy of data) */
+			if ((vma->vm_flags & VM_SEQ_READ) && page->count == 2 && !PageLocked(page) && !PageDirty(page)
+				&& page->inode->i_shm != 1) {
+				remove_from_page_cache(page);
+				page->inode = NULL;
+				__free_page(page);
+				kstat.pgdropbehind++;
+			}
+
 			goto drop_pte;
 		}
 
@@ -656,20 +781,29 @@ static int try_to_swap_out(struct vm_area *vma, uint32_t address, pte_t *pte)
 	if (!entry)
 		return 0;
 
+	/* store page in swap cache */
+	if (!add_to_swap_cache(page, entry)) {
+		swap_free(entry);
+		return 0;
+	}
+	swap_duplicate(entry);
+
 	/* update page table */
 	vma->vm_mm->rss--;
-	*pte = entry;
+	*pte = swp_entry_to_pte(entry);
 	flush_tlb_page(vma->vm_mm->pgd, address);
 
-	/* store page in swap cache */
-	swap_duplicate(entry);
-	add_to_swap_cache(page, entry);
+	/* lock page */
 	set_bit(&page->flags, PG_lock);
 
-	/* write page on disk */
-	rw_swap_page(WRITE, entry, page_address(page));
+	/* queue write : pages are written in batches */
+	rw_swap_page(WRITE, entry, page_address(page), 0);
 	__free_page(page);
 
+	/* batch full : start i/o */
+	if (++nr_swap_writes >= SWAP_CLUSTER_MAX)
+		swap_write_flush();
+
 	return 1;
 drop_pte:
 	vma->vm_mm->rss--;
@@ -678,6 +812,19 @@ drop_pte:
 	return 1;
 }
 
+/*
+ * Start queued swap out writes.
+ */
+void swap_write_flush()
+{
+	if (!nr_swap_writes)
+		return;
+
+	execute_block_requests();
+	kstat.swap_write_batch++;
+	nr_swap_writes = 0;
+}
+
 /*
  * Try to swap out a page table.
  */
@@ -687,7 +834,8 @@ static int swap_out_pmd(struct vm_area *vma, pmd_t *pmd, uint32_t address, uint3
 	pte_t *pte;
 	int ret;
 
-	if (pmd_none(*pmd))
+	/* large pages are never swapped out */
+	if (pmd_none(*pmd) || pmd_huge(*pmd))
 		return 0;
 
 	pte = pte_offset(pmd, address);
@@ -719,7 +867,7 @@ static int swap_out_pgd(struct vm_area *vma, pgd_t *pgd, uint32_t address, uint3
 	pmd_t *pmd;
 	int ret;
 
-	pmd = pmd_offset(pgd);
+	pmd = pmd_offset(pgd, address);
 
 	pgd_end = (address + PGDIR_SIZE) & PGDIR_MASK;
 	if (end > pgd_end)
@@ -921,6 +1069,8 @@ int sys_swapon(const char *path, int swap_flags)
 	p->swap_map = NULL;
 	p->lowest_bit = 0;
 	p->highest_bit = 0;
+	p->cluster_next = 1;
+	p->cluster_nr = 0;
 	p->max = 1;
 	if (swap_flags & SWAP_FLAG_PREFER)
 		p->priority = (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
@@ -1094,7 +1244,7 @@ static void unuse_pte(struct vm_area *vma, pte_t *pte, uint32_t entry, struct pa
 		*pte = pte_mkdirty(*pte);
 		return;
 	}
-	if (*pte != entry)
+	if (*pte != swp_entry_to_pte(entry))
 		return;
 
 	*pte = pte_mkdirty(mk_pte(page, vma->vm_page_prot));
@@ -1110,7 +1260,8 @@ static void unuse_pmd(struct vm_area *vma, pmd_t *pmd, uint32_t address, size_t
 	uint32_t end;
 	pte_t *pte;
 
-	if (pmd_none(*pmd))
+	/* large pages are never swapped out */
+	if (pmd_none(*pmd) || pmd_huge(*pmd))
 		return;
 
 	pte = pte_offset(pmd, address);
@@ -1135,7 +1286,7 @@ static void unuse_pgd(struct vm_area *vma, pgd_t *pgd, uint32_t address, size_t
 	uint32_t offset, end;
 	pmd_t *pmd;
 
-	pmd = pmd_offset(pgd);
+	pmd = pmd_offset(pgd, address);
 	offset = address & PGDIR_MASK;
 	address &= ~PGDIR_MASK;
 	end = address + size;
@@ -1204,7 +1355,7 @@ found_entry:
 		entry = SWP_ENTRY(si->type, i);
 
 		/* read page from disk */
-		page = read_swap_cache(entry);
+		page = read_swap_cache(entry, 1);
 		if (!page) {
 			if (si->swap_map[i] == 0)
 				continue;
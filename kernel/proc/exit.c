@@ -100,6 +100,8 @@ pid_t sys_waitpid(pid_t pid, int *wstatus, int options)
 			if (task->state == TASK_ZOMBIE) {
 				current_task->cutime += task->utime + task->cutime;
 				current_task->cstime += task->stime + task->cstime;
+				current_task->cmin_flt += task->min_flt + task->cmin_flt;
+				current_task->cmaj_flt += task->maj_flt + task->cmaj_flt;
 
 				if (wstatus != NULL)
 					*wstatus = task->exit_code;
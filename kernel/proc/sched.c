@@ -69,7 +69,12 @@ static void switch_to(struct task *prev, struct task *next)
 	switch_ldt(prev, next);
 	load_tss(current_task->thread.kernel_stack);
 	load_tls();
-	switch_pgd(current_task->mm->pgd);
+
+	/* kernel thread : borrow previous address space (kernel mappings are the same everywhere) */
+	if (current_task->mm->pgd != pgd_kernel)
+		switch_pgd(current_task->mm->pgd);
+	else
+		kstat.tlb_switch_lazy++;
 
 	/* switch */
 	scheduler_do_switch(prev ? &prev->thread.esp : 0, current_task->thread.esp);
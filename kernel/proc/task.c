@@ -5,6 +5,7 @@
 #include <proc/task.h>
 #include <proc/sched.h>
 #include <proc/elf.h>
+#include <kernel_stat.h>
 #include <mm/paging.h>
 #include <lib/semaphore.h>
 #include <sys/syscall.h>
@@ -220,7 +221,7 @@ struct mm_struct *task_dup_mm(struct mm_struct *mm)
 		memset(vma_child, 0, sizeof(struct vm_area));
 		vma_child->vm_start = vma_parent->vm_start;
 		vma_child->vm_end = vma_parent->vm_end;
-		vma_child->vm_flags = vma_parent->vm_flags;
+		vma_child->vm_flags = vma_parent->vm_flags & ~VM_LOCKED;
 		vma_child->vm_page_prot = vma_parent->vm_page_prot;
 		vma_child->vm_offset = vma_parent->vm_offset;
 		vma_child->vm_file = vma_parent->vm_file;
@@ -460,8 +461,9 @@ void task_exit_mmap(struct mm_struct *mm)
 {
 	struct vm_area *mpnt = mm->mmap, *next;
 
-	/* clear memory size */
+	/* clear memory size and default flags */
 	mm->rss = 0;
+	mm->def_flags = 0;
 	mm->mmap = NULL;
 	mm->mmap_avl = NULL;
 	mm->mmap_cache = NULL;
@@ -502,6 +504,10 @@ void task_exit_mm(struct task *task)
 		task_release_mmap(task);
 
 		if (--mm->count <= 0) {
+			/* out of memory victim : account released memory */
+			if (mm->oom_killed)
+				kstat.oom_reaped += mm->rss;
+
 			/* free areas */
 			task_exit_mmap(mm);
 
@@ -573,6 +579,7 @@ static struct task *create_task(struct task *parent, uint32_t clone_flags, uint3
 	task->fsgid = parent ? parent->fsgid : 0;
 	task->tty = parent ? parent->tty : 0;
 	task->ptrace = parent ? parent->ptrace : 0;
+	task->oom_score_adj = parent ? parent->oom_score_adj : 0;
 	task->start_time = jiffies;
 	task->vfork_sem = NULL;
 	INIT_LIST_HEAD(&task->list);
@@ -5,6 +5,7 @@
 #include <net/socket.h>
 #include <mm/swap.h>
 #include <ipc/ipc.h>
+#include <ipc/shm.h>
 #include <sys/sys.h>
 #include <x86/tls.h>
 #include <x86/ldt.h>
@@ -136,6 +137,7 @@ static const void *syscalls[] = {
 	[__NR_madvise]			= sys_madvise,
 	[__NR_clone]			= sys_clone,
 	[__NR_getrandom]		= sys_getrandom,
+	[__NR_memfd_create]		= sys_memfd_create,
 	[__NR_mprotect]			= sys_mprotect,
 	[__NR_pread64]			= sys_pread64,
 	[__NR_write64]			= sys_pwrite64,
@@ -158,6 +160,11 @@ static const void *syscalls[] = {
 	[__NR_syslog]			= sys_syslog,
 	[__NR_rt_sigpending]		= sys_rt_sigpending,
 	[__NR_mincore]			= sys_mincore,
+	[__NR_msync]			= sys_msync,
+	[__NR_mlock]			= sys_mlock,
+	[__NR_munlock]			= sys_munlock,
+	[__NR_mlockall]			= sys_mlockall,
+	[__NR_munlockall]		= sys_munlockall,
 	[__NR_getpriority]		= sys_getpriority,
 	[__NR_setpriority]		= sys_setpriority,
 	[__NR_modify_ldt]		= sys_modify_ldt,
@@ -114,12 +114,33 @@ int sys_getrandom(void *buf, size_t buflen, unsigned int flags)
  */
 int sys_getrusage(int who, struct rusage *ru)
 {
+	time_t utime, stime;
+
 	if (who != RUSAGE_SELF && who != RUSAGE_CHILDREN)
 		return -EINVAL;
 
 	/* reset rusage */
 	memset(ru, 0, sizeof(struct rusage));
 
+	/* get times and page faults */
+	if (who == RUSAGE_SELF) {
+		utime = current_task->utime;
+		stime = current_task->stime;
+		ru->ru_minflt = current_task->min_flt;
+		ru->ru_majflt = current_task->maj_flt;
+	} else {
+		utime = current_task->cutime;
+		stime = current_task->cstime;
+		ru->ru_minflt = current_task->cmin_flt;
+		ru->ru_majflt = current_task->cmaj_flt;
+	}
+
+	/* convert times */
+	ru->ru_utime.tv_sec = utime / HZ;
+	ru->ru_utime.tv_usec = (utime % HZ) * (1000000L / HZ);
+	ru->ru_stime.tv_sec = stime / HZ;
+	ru->ru_stime.tv_usec = (stime % HZ) * (1000000L / HZ);
+
 	return 0;
 }
 
@@ -243,6 +264,17 @@ int sys_sysinfo(struct sysinfo *info)
 	si_meminfo(info);
 	si_swapinfo(info);
 
+	/* sizes fit in 32 bits : report them in bytes (in pages otherwise, memory may be above 4 GB) */
+	if (info->totalram + info->totalswap < (1UL << (32 - PAGE_SHIFT))) {
+		info->totalram <<= PAGE_SHIFT;
+		info->freeram <<= PAGE_SHIFT;
+		info->sharedram <<= PAGE_SHIFT;
+		info->bufferram <<= PAGE_SHIFT;
+		info->totalswap <<= PAGE_SHIFT;
+		info->freeswap <<= PAGE_SHIFT;
+		info->mem_unit = 1;
+	}
+
 	return 0;
 }
 
@@ -193,6 +193,14 @@ size_t get_cpuinfo(char *page)
 	return p - page;
 }
 
+/*
+ * Check if boot CPU has a feature.
+ */
+int cpu_has(uint32_t feature)
+{
+	return (boot_cpu_data.x86_capability & feature) != 0;
+}
+
 /*
  * Init boot CPU.
  */
@@ -0,0 +1,46 @@
+#include <x86/uaccess.h>
+
+/* exception table (defined in linker script) */
+extern struct exception_table_entry ex_table_start[];
+extern struct exception_table_entry ex_table_end[];
+
+/* page faults disabled */
+int pagefault_disabled = 0;
+
+/*
+ * Copy from/to user space (a fault resumes after the copy : returns number of bytes not copied).
+ */
+size_t __copy_user(void *to, const void *from, size_t n)
+{
+	uint32_t d0, d1;
+
+	__asm__ __volatile__(
+		"1:	rep movsb\n"
+		"2:\n"
+		".section __ex_table, \"a\"\n"
+		"	.align 4\n"
+		"	.long 1b, 2b\n"
+		".previous\n"
+		: "+c" (n), "=&D" (d0), "=&S" (d1)
+		: "1" (to), "2" (from)
+		: "memory");
+
+	return n;
+}
+
+/*
+ * Resume a faulting kernel instruction at its fixup (returns 1 if a fixup was found).
+ */
+int fixup_exception(struct registers *regs)
+{
+	struct exception_table_entry *entry;
+
+	for (entry = ex_table_start; entry < ex_table_end; entry++) {
+		if (entry->insn == regs->eip) {
+			regs->eip = entry->fixup;
+			return 1;
+		}
+	}
+
+	return 0;
+}